@@ -0,0 +1,493 @@
+#include "common.h"
+#include "commands.h"
+#include "leddecode.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool bringup --file graph [--hosts h1,h2]
+*                 [--timeout sec] [--max-parallel n]
+*                 [--steady-ms ms] [--post-errors n]
+* powers boxes on in dependency order. one box per
+* line, tab separated, followed by the boxes it
+* waits for:
+*   <box description>  [<dependency>  ...]
+* e.g. "RSC2 SN 0042\tRSC2 SN 0007\tRSC2 SN 0008".
+* a box is powered on as soon as all its dependencies
+* are healthy (green status led steady on), up to
+* --max-parallel (32) power-on sequences at a time.
+* boxes whose amber led lights or that are not
+* healthy --timeout (300) seconds after power on
+* fail, and the boxes depending on them are skipped.
+* boxes already healthy at the start count as up:
+* nothing is powered on before --steady-ms (2500)
+* has passed, and a box whose power led is on gets
+* no power button press, only the wait for health.
+* the report shows the critical path: the chain of
+* dependencies that decided when the last box was up.
+* --post-errors makes n boxes fail post (Standin only).
+**************************************************/
+
+#define DESC_LEN        64
+#define LINE_LEN        1024
+#define TICK_MS         50
+
+enum
+{
+    NODE_WAITING,
+    NODE_BOOTING,
+    NODE_HEALTHY,
+    NODE_FAILED,
+    NODE_SKIPPED
+};
+
+static const char *stateNames[] = { "waiting", "booting", "healthy", "failed", "skipped" };
+
+typedef struct BootNode BootNode;
+
+typedef struct
+{
+    BootNode *owner;
+    int index;                  /* 0 green, 1 amber */
+    Rsc2_Signal *sig;
+} BootWatch;
+
+struct BootNode
+{
+    char description[DESC_LEN];
+    char (*depNames)[DESC_LEN];
+    int *deps;
+    int numDeps;
+    Rsc2_Box *box;
+    CRITICAL_SECTION lock;
+    LedDecoder leds[2];
+    BootWatch watch[2];
+    int state;
+    int gate;                   /* dependency that became healthy last, -1 for none */
+    volatile LONG powering;
+    Rsc2_Result result;
+    long long readyAt;          /* dependencies healthy */
+    long long startedAt;        /* power on issued */
+    long long upAt;             /* green led came on */
+    long long healthyAt;        /* green led confirmed steady */
+};
+
+typedef struct
+{
+    Fleet fleet;
+    BootNode *nodes;
+    int numNodes;
+    int *order;                 /* topological order */
+    int steadyMs;
+    int maxParallel;
+    volatile LONG powering;
+    long long startedAt;
+    Rsc2_BoxListener listener;
+} Bringup;
+
+static Bringup bu;
+
+static int find_node(const char *description){
+    int i;
+
+    for(i = 0; i < bu.numNodes; i++){
+        if(strcmp(bu.nodes[i].description, description) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int add_node(const char *description, int *capacity){
+    int index = find_node(description);
+
+    if(index >= 0)
+        return index;
+    if(bu.numNodes == *capacity){
+        *capacity = *capacity ? *capacity * 2 : 64;
+        bu.nodes = realloc(bu.nodes, *capacity * sizeof(BootNode));
+    }
+    index = bu.numNodes++;
+    memset(&bu.nodes[index], 0, sizeof(BootNode));
+    strncpy(bu.nodes[index].description, description, DESC_LEN - 1);
+    bu.nodes[index].gate = -1;
+    return index;
+}
+
+static int load_graph(const char *path){
+    char line[LINE_LEN];
+    int capacity = 0;
+    int lineNo = 0;
+    int i, j;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        printf("unable to open %s\n", path);
+        return -1;
+    }
+    while(fgets(line, LINE_LEN, file) != NULL){
+        char *field = NULL;
+        BootNode *node = NULL;
+        int index;
+
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+        field = strtok(line, "\t");
+        index = add_node(field, &capacity);
+        if(bu.nodes[index].depNames != NULL){
+            printf("%s:%d: %s is listed twice\n", path, lineNo, field);
+            fclose(file);
+            return -1;
+        }
+        bu.nodes[index].depNames = calloc(1, DESC_LEN);
+        for(field = strtok(NULL, "\t"); field != NULL; field = strtok(NULL, "\t")){
+            node = &bu.nodes[index];
+            node->depNames = realloc(node->depNames, (node->numDeps + 1) * DESC_LEN);
+            strncpy(node->depNames[node->numDeps], field, DESC_LEN - 1);
+            node->depNames[node->numDeps++][DESC_LEN - 1] = '\0';
+        }
+    }
+    fclose(file);
+
+    /* dependencies that have no line of their own are boxes without dependencies */
+    for(i = 0; i < bu.numNodes; i++){
+        int numDeps = bu.nodes[i].numDeps;
+
+        bu.nodes[i].deps = calloc(numDeps + 1, sizeof(int));
+        for(j = 0; j < numDeps; j++){
+            int dep = add_node(bu.nodes[i].depNames[j], &capacity);
+
+            bu.nodes[i].deps[j] = dep;
+        }
+    }
+    return 0;
+}
+
+/* kahn's algorithm, fails on a cycle */
+static int sort_graph(void){
+    int *waiting = calloc(bu.numNodes + 1, sizeof(int));
+    int head = 0, count = 0;
+    int i, j;
+
+    bu.order = calloc(bu.numNodes + 1, sizeof(int));
+    for(i = 0; i < bu.numNodes; i++){
+        waiting[i] = bu.nodes[i].numDeps;
+        if(waiting[i] == 0)
+            bu.order[count++] = i;
+    }
+    while(head < count){
+        int done = bu.order[head++];
+
+        for(i = 0; i < bu.numNodes; i++){
+            for(j = 0; j < bu.nodes[i].numDeps; j++){
+                if(bu.nodes[i].deps[j] == done && --waiting[i] == 0)
+                    bu.order[count++] = i;
+            }
+        }
+    }
+    free(waiting);
+    if(count < bu.numNodes){
+        printf("the dependencies form a cycle, e.g. through:");
+        for(i = 0; i < bu.numNodes; i++){
+            for(j = 0; j < count && bu.order[j] != i; j++)
+                ;
+            if(j == count)
+                printf(" \"%s\"", bu.nodes[i].description);
+        }
+        printf("\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* runs on the library's event thread, no remote calls here: the level
+ * is inferred from the transition, update_node re-reads a led that
+ * went steady in case an event was lost */
+static void on_sig_state_changed(Rsc2_Signal *sig){
+    BootWatch *watch = Rsc2_GetObjectClientData((Rsc2_Object *)sig);
+    long long at = now_us();
+    LedDecoder *led = NULL;
+
+    if(watch == NULL)
+        return;
+    led = &watch->owner->leds[watch->index];
+    EnterCriticalSection(&watch->owner->lock);
+    led_decoder_edge(led, !led->level, at);
+    LeaveCriticalSection(&watch->owner->lock);
+}
+
+/* off the event thread: a lost event leaves the inferred level wrong */
+static void resync_led(BootNode *owner, int index, long long now){
+    int level = Rsc2_GetSigAssertionState(owner->watch[index].sig);
+
+    EnterCriticalSection(&owner->lock);
+    if(level >= 0 && level != owner->leds[index].level)
+        led_decoder_init(&owner->leds[index], level, now, bu.steadyMs);
+    LeaveCriticalSection(&owner->lock);
+}
+
+static int watch_node(BootNode *node){
+    static const Rsc2_SignalID ids[2] = { RSC2_ID_LED_STATUS_GREEN, RSC2_ID_LED_STATUS_AMBER };
+    long long now = now_us();
+    int i;
+
+    InitializeCriticalSection(&node->lock);
+    for(i = 0; i < 2; i++){
+        Rsc2_Signal *sig = Rsc2_GetSignal(node->box, ids[i]);
+
+        if(sig == NULL)
+            return -1;
+        node->watch[i].owner = node;
+        node->watch[i].index = i;
+        node->watch[i].sig = sig;
+        led_decoder_init(&node->leds[i], Rsc2_GetSigAssertionState(sig) == RSC2_SIG_ASSERTED, now, bu.steadyMs);
+        Rsc2_SetObjectClientData((Rsc2_Object *)sig, &node->watch[i]);
+    }
+    Rsc2_AttachBoxListener(node->box, &bu.listener);
+    return 0;
+}
+
+static void log_node(BootNode *node, long long now, const char *what){
+    printf("%7.1f s  %-24s %s\n", (now - bu.startedAt) / 1000000.0, node->description, what);
+}
+
+static DWORD WINAPI power_thread(LPVOID arg){
+    BootNode *node = arg;
+    /* a power button press would switch a running box off */
+    int powered = Rsc2_GetSigAssertionState(Rsc2_GetSignal(node->box, RSC2_ID_LED_PWR));
+
+    if(powered < 0){
+        node->result = RSC2_ERR_COMMAND_FAILED;
+    }else if(powered == RSC2_SIG_ASSERTED){
+        log_node(node, now_us(), "power led already on, waiting without a power press");
+        node->result = RSC2_SUCCESS;
+    }else{
+        node->result = power_on_box(node->box);
+    }
+    InterlockedDecrement(&bu.powering);
+    InterlockedExchange(&node->powering, 0);
+    return 0;
+}
+
+static void start_node(BootNode *node, long long now){
+    HANDLE thread = NULL;
+
+    node->startedAt = now;
+    node->state = NODE_BOOTING;
+    node->powering = 1;
+    InterlockedIncrement(&bu.powering);
+    thread = CreateThread(NULL, 0, power_thread, node, 0, NULL);
+    if(thread == NULL){
+        node->result = RSC2_ERR_UNSPECIFIED;
+        InterlockedDecrement(&bu.powering);
+        node->powering = 0;
+    }else{
+        CloseHandle(thread);
+    }
+    log_node(node, now, "powering on");
+}
+
+/* advances one node, returns 1 while it is not finished */
+static int update_node(BootNode *node, long long now, long long timeoutUs){
+    LedDecoder *green = &node->leds[0];
+    LedDecoder *amber = &node->leds[1];
+    int healthy, failed, resync[2], i;
+    long long greenAt;
+
+    EnterCriticalSection(&node->lock);
+    for(i = 0; i < 2; i++)
+        resync[i] = led_decoder_tick(&node->leds[i], now)
+                 && (node->leds[i].state == LED_STEADY_ON || node->leds[i].state == LED_STEADY_OFF);
+    LeaveCriticalSection(&node->lock);
+    for(i = 0; i < 2; i++){
+        if(resync[i])
+            resync_led(node, i, now);
+    }
+
+    EnterCriticalSection(&node->lock);
+    healthy = green->state == LED_STEADY_ON;
+    failed = amber->level || amber->state == LED_BLINKING || amber->state == LED_PATTERN;
+    greenAt = green->edges[(green->head - 1 + LED_HISTORY) % LED_HISTORY];
+    LeaveCriticalSection(&node->lock);
+
+    switch(node->state){
+    case NODE_WAITING:
+        if(healthy && !failed){
+            node->state = NODE_HEALTHY;
+            node->readyAt = node->startedAt = node->upAt = node->healthyAt = bu.startedAt;
+            log_node(node, now, "already up");
+            return 0;
+        }
+        /* the green led of a box already up needs --steady-ms to read steady */
+        if(now - bu.startedAt < (long long)bu.steadyMs * 1000)
+            return 1;
+        for(i = 0; i < node->numDeps; i++){
+            BootNode *dep = &bu.nodes[node->deps[i]];
+
+            if(dep->state == NODE_FAILED || dep->state == NODE_SKIPPED){
+                node->state = NODE_SKIPPED;
+                log_node(node, now, "skipped, a dependency did not come up");
+                return 0;
+            }
+            if(dep->state != NODE_HEALTHY)
+                return 1;
+            if(node->gate < 0 || dep->healthyAt > bu.nodes[node->gate].healthyAt)
+                node->gate = node->deps[i];
+        }
+        if(node->readyAt == 0)
+            node->readyAt = now;
+        if(bu.powering < bu.maxParallel)
+            start_node(node, now);
+        return 1;
+    case NODE_BOOTING:
+        if(!node->powering && node->result != RSC2_SUCCESS){
+            node->state = NODE_FAILED;
+            log_node(node, now, Rsc2_ResultCodeToString(node->result));
+        }else if(failed){
+            node->state = NODE_FAILED;
+            log_node(node, now, "failed, amber led active");
+        }else if(healthy && !node->powering && greenAt > node->startedAt){
+            char text[64];
+
+            node->state = NODE_HEALTHY;
+            node->upAt = greenAt;
+            node->healthyAt = now;
+            sprintf(text, "healthy, booted in %.1f s", (greenAt - node->startedAt) / 1000000.0);
+            log_node(node, now, text);
+        }else if(now - node->startedAt > timeoutUs){
+            node->state = NODE_FAILED;
+            log_node(node, now, "failed, not healthy in time");
+        }
+        return node->state == NODE_BOOTING;
+    }
+    return 0;
+}
+
+static void report(long long finishedAt){
+    long long *longest = calloc(bu.numNodes + 1, sizeof(long long));
+    int counts[5] = {0, 0, 0, 0, 0};
+    int *path = calloc(bu.numNodes + 1, sizeof(int));
+    int last = -1, length = 0;
+    long long chain = 0;
+    int i, j;
+
+    for(i = 0; i < bu.numNodes; i++){
+        BootNode *node = &bu.nodes[i];
+
+        counts[node->state]++;
+        if(node->state == NODE_HEALTHY && (last < 0 || node->healthyAt > bu.nodes[last].healthyAt))
+            last = i;
+    }
+    printf("\n");
+    for(i = 0; i < 5; i++){
+        if(counts[i])
+            printf("%d %s  ", counts[i], stateNames[i]);
+    }
+    printf("in %.1f s\n", (finishedAt - bu.startedAt) / 1000000.0);
+    if(last < 0)
+        return;
+
+    /* the minimum with the measured boot times: the longest chain of them */
+    for(i = 0; i < bu.numNodes; i++){
+        BootNode *node = &bu.nodes[bu.order[i]];
+        long long before = 0;
+
+        for(j = 0; j < node->numDeps; j++){
+            if(longest[node->deps[j]] > before)
+                before = longest[node->deps[j]];
+        }
+        if(node->state == NODE_HEALTHY)
+            longest[bu.order[i]] = before + (node->healthyAt - node->startedAt);
+        if(longest[bu.order[i]] > chain)
+            chain = longest[bu.order[i]];
+    }
+
+    for(i = last; i >= 0; i = bu.nodes[i].gate)
+        path[length++] = i;
+    printf("critical path (%d boxes):\n", length);
+    for(i = length - 1; i >= 0; i--){
+        BootNode *node = &bu.nodes[path[i]];
+        long long gateAt = node->gate >= 0 ? bu.nodes[node->gate].healthyAt : bu.startedAt;
+
+        printf("  %-24s waited %5.1f s  booted %5.1f s  confirmed %4.1f s\n", node->description,
+               (node->startedAt - gateAt) / 1000000.0, (node->upAt - node->startedAt) / 1000000.0,
+               (node->healthyAt - node->upAt) / 1000000.0);
+    }
+    printf("last box healthy at %.1f s, the longest chain of measured boot times is %.1f s\n",
+           (bu.nodes[last].healthyAt - bu.startedAt) / 1000000.0, chain / 1000000.0);
+    free(longest);
+    free(path);
+}
+
+int bringup_main(int argc, char *argv[]){
+    const char *path = opt_str(argc, argv, "--file", NULL);
+    long long timeoutUs = (long long)opt_int(argc, argv, "--timeout", 300) * 1000000;
+    char description[DESC_LEN];
+    int active, i;
+
+    memset(&bu, 0, sizeof(bu));
+    bu.steadyMs = opt_int(argc, argv, "--steady-ms", 2500);
+    bu.maxParallel = opt_int(argc, argv, "--max-parallel", 32);
+    bu.listener.sigStateChanged = on_sig_state_changed;
+    if(path == NULL){
+        printf("missing --file graph\n");
+        return -1;
+    }
+    if(load_graph(path) != 0 || sort_graph() != 0)
+        return -1;
+    if(fleet_open(&bu.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+
+    for(i = 0; i < bu.fleet.numBoxes; i++){
+        int index;
+
+        Rsc2_GetDescription(bu.fleet.boxes[i].box, description, DESC_LEN);
+        index = find_node(description);
+        if(index >= 0)
+            bu.nodes[index].box = bu.fleet.boxes[i].box;
+    }
+    for(i = 0; i < bu.numNodes; i++){
+        if(bu.nodes[i].box == NULL){
+            printf("%s is not connected to any of the hosts\n", bu.nodes[i].description);
+            return -1;
+        }
+        if(watch_node(&bu.nodes[i]) != 0){
+            print_rsc_error("unable to get led signals");
+            return -1;
+        }
+    }
+#ifdef RSC_STANDIN
+    {
+        int postErrors = opt_int(argc, argv, "--post-errors", 0);
+
+        for(i = 0; i < postErrors && i < bu.numNodes; i++)
+            standin_set_post_error(bu.nodes[bu.order[i * bu.numNodes / postErrors]].box, 2);
+    }
+#endif
+
+    printf("bringing up %d boxes\n", bu.numNodes);
+    bu.startedAt = now_us();
+    do{
+        long long now = now_us();
+
+        active = 0;
+        for(i = 0; i < bu.numNodes; i++)
+            active += update_node(&bu.nodes[bu.order[i]], now, timeoutUs);
+        if(active)
+            Sleep(TICK_MS);
+    }while(active);
+    report(now_us());
+
+    for(i = 0; i < bu.numNodes; i++){
+        while(bu.nodes[i].powering)
+            Sleep(TICK_MS);
+        Rsc2_DetachBoxListener(bu.nodes[i].box, &bu.listener);
+    }
+    for(i = 0; i < bu.numNodes; i++){
+        if(bu.nodes[i].state != NODE_HEALTHY)
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include "common.h"
+#include "commands.h"
+#include "latprofile.h"
+#include <math.h>
+
+/**************************************************
+* rsctool calibrate [--hosts h1,h2] [--match text]
+*                   [--samples n] [--interval-ms ms]
+*                   [--timeout-ms ms] [--profile file]
+*                   [--verbose]
+* measures the actuation latency of every box, which
+* needs its aux a output wired back to its aux a
+* input. the output is toggled --samples (50) times,
+* --interval-ms (20) apart, and each toggle is timed
+* from the return of Rsc2_SetSigAssertionState to the
+* sigStateChanged event of the input. a box whose
+* input does not follow within --timeout-ms (1000) is
+* reported as not wired. the per box profile (median,
+* p99, jitter) is merged into --profile (rsctool.lat),
+* see latprofile.h; fire --profile uses it to start
+* each box's write early.
+* --match picks the boxes whose description contains
+* the text.
+**************************************************/
+
+#define WARMUP          2       /* toggles not counted, the first use of a path is slow */
+
+typedef struct
+{
+    Rsc2_Box *box;
+    char description[LATENCY_DESC_LEN];
+    Rsc2_Signal *output;
+    Rsc2_Signal *input;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE changed;
+    int events;                 /* input changes seen */
+    int level;                  /* input level after the newest one, inferred */
+    long long changedAt;
+    long long *callUs;
+    long long *lineUs;
+    int samples;
+    int lost;
+    const char *error;
+    LatencyEntry entry;
+} Probe;
+
+typedef struct
+{
+    Probe *probes;
+    int numProbes;
+    int samples;
+    int intervalMs;
+    int timeoutMs;
+    Rsc2_BoxListener listener;
+} Calibration;
+
+static Calibration cal;
+
+/* no remote read here: 32 probes share the event thread and a read
+ * would queue the other boxes' events behind it, into their line
+ * times. the level is inferred, probe_box re-reads it after a loss. */
+static void input_changed(Rsc2_Signal *sig){
+    Probe *probe = Rsc2_GetObjectClientData((Rsc2_Object *)sig);
+    long long now = now_us();
+
+    if(probe == NULL || sig != probe->input)
+        return;
+    EnterCriticalSection(&probe->lock);
+    probe->events++;
+    probe->level = !probe->level;
+    probe->changedAt = now;
+    WakeAllConditionVariable(&probe->changed);
+    LeaveCriticalSection(&probe->lock);
+}
+
+/* the time the input changed to "level" (-1 any) after "seen" changes,
+ * -1 on timeout. the late change of a toggle that timed out has the
+ * other level and does not time the next one. */
+static long long wait_change(Probe *probe, int seen, int level, long long timeoutUs){
+    long long deadline = now_us() + timeoutUs, now, at = -1;
+
+    EnterCriticalSection(&probe->lock);
+    while((probe->events <= seen || (level >= 0 && probe->level != level)) && (now = now_us()) < deadline)
+        SleepConditionVariableCS(&probe->changed, &probe->lock, (DWORD)((deadline - now) / 1000 + 1));
+    if(probe->events > seen && (level < 0 || probe->level == level))
+        at = probe->changedAt;
+    LeaveCriticalSection(&probe->lock);
+    return at;
+}
+
+static int compare_ll(const void *a, const void *b){
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(Probe *probe){
+    LatencyEntry *entry = &probe->entry;
+    double mean = 0, variance = 0;
+    int i, n = probe->samples;
+
+    for(i = 0; i < n; i++)
+        mean += probe->lineUs[i];
+    mean /= n;
+    for(i = 0; i < n; i++)
+        variance += (probe->lineUs[i] - mean) * (probe->lineUs[i] - mean);
+    qsort(probe->callUs, n, sizeof(long long), compare_ll);
+    qsort(probe->lineUs, n, sizeof(long long), compare_ll);
+    strcpy(entry->description, probe->description);
+    entry->samples = n;
+    entry->callUs = probe->callUs[n / 2];
+    entry->lineUs = probe->lineUs[n / 2];
+    entry->lineP99Us = probe->lineUs[n * 99 / 100];
+    entry->jitterUs = (long long)sqrt(variance / n);
+}
+
+static void probe_box(int index, void *ctx){
+    Probe *probe = &cal.probes[index];
+    long long timeoutUs = (long long)cal.timeoutMs * 1000;
+    long long start, returned, at;
+    int i, seen, level, input, inverted = 0;
+
+    (void)ctx;
+    level = Rsc2_GetSigAssertionState(probe->output);
+    input = Rsc2_GetSigAssertionState(probe->input);
+    if(level < 0 || input < 0){
+        probe->error = "unable to read aux a";
+        return;
+    }
+    EnterCriticalSection(&probe->lock);
+    probe->level = input;
+    LeaveCriticalSection(&probe->lock);
+    for(i = 0; i < cal.samples + WARMUP; i++){
+        EnterCriticalSection(&probe->lock);
+        seen = probe->events;
+        LeaveCriticalSection(&probe->lock);
+
+        level = level == RSC2_SIG_ASSERTED ? RSC2_SIG_DEASSERTED : RSC2_SIG_ASSERTED;
+        start = now_us();
+        if(Rsc2_SetSigAssertionState(probe->output, (Rsc2_SignalState)level) != RSC2_SUCCESS){
+            probe->error = "unable to set aux a output";
+            return;
+        }
+        returned = now_us();
+        /* the first toggle learns whether the input follows inverted */
+        at = wait_change(probe, seen, i == 0 ? -1 : level ^ inverted, timeoutUs);
+        if(at < 0 && i == 0){
+            probe->error = "aux a input does not follow the output, not wired";
+            return;
+        }
+        if(i == 0){
+            EnterCriticalSection(&probe->lock);
+            inverted = probe->level != level;
+            LeaveCriticalSection(&probe->lock);
+        }
+        if(at < 0){
+            /* let the late change arrive, then re-read the level it left */
+            probe->lost++;
+            wait_change(probe, seen, -1, timeoutUs);
+            input = Rsc2_GetSigAssertionState(probe->input);
+            EnterCriticalSection(&probe->lock);
+            if(input >= 0)
+                probe->level = input;
+            LeaveCriticalSection(&probe->lock);
+        }else if(i >= WARMUP){
+            probe->callUs[probe->samples] = returned - start;
+            probe->lineUs[probe->samples] = at - returned;
+            probe->samples++;
+        }
+        Sleep(cal.intervalMs);
+    }
+    if(level == RSC2_SIG_ASSERTED)
+        Rsc2_SetSigAssertionState(probe->output, RSC2_SIG_DEASSERTED);
+    if(probe->samples == 0)
+        probe->error = "every toggle was lost";
+    else
+        summarize(probe);
+}
+
+int calibrate_main(int argc, char *argv[]){
+    const char *match = opt_str(argc, argv, "--match", NULL);
+    const char *path = opt_str(argc, argv, "--profile", LATENCY_PATH);
+    int verbose = opt_flag(argc, argv, "--verbose");
+    LatencyProfile *profile = NULL;
+    long long *leads = NULL;
+    Fleet fleet;
+    int failed = 0, n = 0;
+    int i;
+
+    memset(&cal, 0, sizeof(cal));
+    cal.samples = opt_int(argc, argv, "--samples", 50);
+    cal.intervalMs = opt_int(argc, argv, "--interval-ms", 20);
+    cal.timeoutMs = opt_int(argc, argv, "--timeout-ms", 1000);
+    cal.listener.sigStateChanged = input_changed;
+    if(cal.samples < 1){
+        printf("--samples must be 1 or more\n");
+        return -1;
+    }
+    profile = latency_profile_load(path);
+    if(profile == NULL)
+        return -1;
+    if(fleet_open(&fleet, opt_str(argc, argv, "--hosts", NULL)) != 0){
+        latency_profile_close(profile);
+        return -1;
+    }
+
+    cal.probes = calloc(fleet.numBoxes + 1, sizeof(Probe));
+    for(i = 0; i < fleet.numBoxes; i++){
+        Probe *probe = &cal.probes[cal.numProbes];
+
+        probe->box = fleet.boxes[i].box;
+        Rsc2_GetDescription(probe->box, probe->description, LATENCY_DESC_LEN);
+        if(match != NULL && strstr(probe->description, match) == NULL)
+            continue;
+        probe->output = Rsc2_GetSignal(probe->box, RSC2_ID_OUT_AUX_A);
+        probe->input = Rsc2_GetSignal(probe->box, RSC2_ID_INP_AUX_A);
+        if(probe->output == NULL || probe->input == NULL){
+            print_rsc_error("unable to get aux a signals");
+            return -1;
+        }
+        InitializeCriticalSection(&probe->lock);
+        InitializeConditionVariable(&probe->changed);
+        probe->callUs = calloc(cal.samples, sizeof(long long));
+        probe->lineUs = calloc(cal.samples, sizeof(long long));
+        Rsc2_SetObjectClientData((Rsc2_Object *)probe->input, probe);
+        Rsc2_AttachBoxListener(probe->box, &cal.listener);
+        cal.numProbes++;
+    }
+    if(cal.numProbes == 0){
+        printf("no box matches\n");
+        return -1;
+    }
+
+    printf("calibrating %d boxes, %d toggles each\n", cal.numProbes, cal.samples);
+    parallel_for(cal.numProbes, 32, probe_box, NULL);
+
+    leads = calloc(cal.numProbes, sizeof(long long));
+    for(i = 0; i < cal.numProbes; i++){
+        Probe *probe = &cal.probes[i];
+        LatencyEntry *entry = &probe->entry;
+
+        Rsc2_DetachBoxListener(probe->box, &cal.listener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)probe->input, NULL);
+        if(probe->error != NULL){
+            printf("%-24s %s\n", probe->description, probe->error);
+            failed++;
+            continue;
+        }
+        if(verbose)
+            printf("%-24s call %6lld us  line %6lld us  p99 %6lld us  jitter %5lld us  lost %d\n",
+                   probe->description, entry->callUs, entry->lineUs, entry->lineP99Us, entry->jitterUs, probe->lost);
+        latency_profile_set(profile, entry);
+        leads[n++] = latency_lead_us(entry);
+    }
+    if(n > 0){
+        qsort(leads, n, sizeof(long long), compare_ll);
+        printf("lead times (call + line) min %lld us  p50 %lld us  max %lld us\n", leads[0], leads[n / 2],
+               leads[n - 1]);
+        if(latency_profile_write(profile, path) == 0)
+            printf("%d boxes calibrated, %d failed, %d boxes in %s\n", n, failed, latency_profile_count(profile),
+                   path);
+    }else{
+        printf("no box calibrated\n");
+    }
+
+    for(i = 0; i < cal.numProbes; i++){
+        free(cal.probes[i].callUs);
+        free(cal.probes[i].lineUs);
+    }
+    free(cal.probes);
+    free(leads);
+    latency_profile_close(profile);
+    fleet_close(&fleet);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,27 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+/**************************************************
+* entry points of the rsctool commands
+* argv[0] is the command name, Rsc2_Init() has
+* already been called. return 0 on success.
+**************************************************/
+
+int soak_main(int argc, char *argv[]);
+int sync_main(int argc, char *argv[]);
+int leds_main(int argc, char *argv[]);
+int watchdog_main(int argc, char *argv[]);
+int gateway_main(int argc, char *argv[]);
+int status_main(int argc, char *argv[]);
+int publish_main(int argc, char *argv[]);
+int fire_main(int argc, char *argv[]);
+int bringup_main(int argc, char *argv[]);
+int discover_main(int argc, char *argv[]);
+int events_main(int argc, char *argv[]);
+int schedule_main(int argc, char *argv[]);
+int converge_main(int argc, char *argv[]);
+int cycle_main(int argc, char *argv[]);
+int calibrate_main(int argc, char *argv[]);
+int supervise_main(int argc, char *argv[]);
+
+#endif /* COMMANDS_H */
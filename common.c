@@ -0,0 +1,216 @@
+#include "common.h"
+
+#define PRESS_MS        200
+
+const char *opt_str(int argc, char *argv[], const char *name, const char *def){
+    int i;
+
+    for(i = 1; i < argc - 1; i++){
+        if(strcmp(argv[i], name) == 0)
+            return argv[i + 1];
+    }
+    return def;
+}
+
+int opt_int(int argc, char *argv[], const char *name, int def){
+    const char *value = opt_str(argc, argv, name, NULL);
+
+    if(value == NULL)
+        return def;
+    return atoi(value);
+}
+
+int opt_flag(int argc, char *argv[], const char *name){
+    int i;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+long long now_us(void){
+    static LARGE_INTEGER frequency;
+    static LARGE_INTEGER start;
+    LARGE_INTEGER counter;
+
+    if(frequency.QuadPart == 0){
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&start);
+    }
+    QueryPerformanceCounter(&counter);
+    return (counter.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+void print_rsc_error(const char *what){
+    char error[ERROR_LEN] = {0};
+
+    Rsc2_GetLastErrorMessage(error, ERROR_LEN);
+    printf("%s: %s\n", what, error);
+}
+
+Rsc2_Result press_button(Rsc2_Box *box, Rsc2_SignalID id, int ms){
+    long long start = trace_begin();
+    Rsc2_Signal *button = Rsc2_GetSignal(box, id);
+    Rsc2_Result result;
+    long long held;
+
+    if(button == NULL)
+        return RSC2_ERR_INVALID_OBJ_REF;
+    result = Rsc2_SetSigAssertionState(button, RSC2_BUTTON_PRESSED);
+    if(result != RSC2_SUCCESS)
+        return result;
+    held = trace_begin();
+    Sleep(ms);
+    trace_end("Sleep", held, button);
+    result = Rsc2_SetSigAssertionState(button, RSC2_BUTTON_RELEASED);
+    trace_end("press_button", start, button);
+    return result;
+}
+
+Rsc2_Result power_on_box(Rsc2_Box *box){
+    long long start = trace_begin();
+    Rsc2_Result result;
+
+    result = Rsc2_SetSigAssertionState(Rsc2_GetSignal(box, RSC2_ID_AC_1), RSC2_AC_ON);
+    if(result == RSC2_SUCCESS)
+        result = Rsc2_SetSigAssertionState(Rsc2_GetSignal(box, RSC2_ID_AC_2), RSC2_AC_ON);
+    if(result == RSC2_SUCCESS)
+        result = press_button(box, RSC2_ID_FPBUT_PWR, PRESS_MS);
+    trace_end("power_on_box", start, box);
+    return result;
+}
+
+#define FLEET_THREADS   32
+
+typedef struct
+{
+    Fleet *fleet;
+    char names[MAX_HOSTS][HOST_NAME_LEN];
+    Rsc2_Host *hosts[MAX_HOSTS];
+    int numBoxes[MAX_HOSTS];
+} FleetOpen;
+
+static void connect_host(int index, void *ctx){
+    FleetOpen *fo = ctx;
+
+    fo->hosts[index] = Rsc2_ConnectToHost(fo->names[index]);
+    if(fo->hosts[index] == NULL){
+        char what[HOST_NAME_LEN + 32];
+        sprintf(what, "unable to connect to host %s", fo->names[index]);
+        print_rsc_error(what);
+        return;
+    }
+    fo->numBoxes[index] = Rsc2_GetNumBoxes(fo->hosts[index]);
+}
+
+static void get_box(int index, void *ctx){
+    Fleet *fleet = ctx;
+    FleetBox *fb = &fleet->boxes[index];
+
+    fb->box = Rsc2_GetBox(fleet->hosts[fb->hostIndex], fb->boxIndex);
+}
+
+int fleet_open(Fleet *fleet, const char *hostList){
+    long long start = trace_begin();
+    FleetOpen *fo = calloc(1, sizeof(FleetOpen));
+    char list[MAX_HOSTS * HOST_NAME_LEN];
+    char *name = NULL;
+    int numNames = 0;
+    int i, j;
+
+    memset(fleet, 0, sizeof(*fleet));
+    if(hostList == NULL || hostList[0] == '\0')
+        hostList = "localhost";
+    strncpy(list, hostList, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+
+    for(name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")){
+        if(numNames == MAX_HOSTS){
+            printf("too many hosts, only %d are supported\n", MAX_HOSTS);
+            break;
+        }
+        strncpy(fo->names[numNames++], name, HOST_NAME_LEN - 1);
+    }
+
+    /* connecting and enumerating are remote calls, do them in parallel */
+    parallel_for(numNames, FLEET_THREADS, connect_host, fo);
+    for(i = 0; i < numNames; i++){
+        if(fo->hosts[i] == NULL)
+            continue;
+        strcpy(fleet->hostNames[fleet->numHosts], fo->names[i]);
+        fleet->hosts[fleet->numHosts] = fo->hosts[i];
+        fleet->numBoxes += fo->numBoxes[i];
+        fo->numBoxes[fleet->numHosts++] = fo->numBoxes[i];
+    }
+
+    fleet->boxes = calloc(fleet->numBoxes + 1, sizeof(FleetBox));
+    fleet->numBoxes = 0;
+    for(i = 0; i < fleet->numHosts; i++){
+        for(j = 0; j < fo->numBoxes[i]; j++){
+            fleet->boxes[fleet->numBoxes].hostIndex = i;
+            fleet->boxes[fleet->numBoxes].boxIndex = j;
+            fleet->numBoxes++;
+        }
+    }
+    parallel_for(fleet->numBoxes, FLEET_THREADS, get_box, fleet);
+    free(fo);
+    trace_end("fleet_open", start, NULL);
+
+    if(fleet->numHosts == 0)
+        return -1;
+    return 0;
+}
+
+void fleet_close(Fleet *fleet){
+    free(fleet->boxes);
+    memset(fleet, 0, sizeof(*fleet));
+}
+
+typedef struct
+{
+    int count;
+    volatile LONG next;
+    void (*fn)(int index, void *ctx);
+    void *ctx;
+} ParallelFor;
+
+static DWORD WINAPI parallel_worker(LPVOID arg){
+    ParallelFor *pf = arg;
+    LONG index;
+
+    while((index = InterlockedIncrement(&pf->next) - 1) < pf->count)
+        pf->fn((int)index, pf->ctx);
+    return 0;
+}
+
+void parallel_for(int count, int threads, void (*fn)(int index, void *ctx), void *ctx){
+    ParallelFor pf;
+    HANDLE *handles = NULL;
+    int i;
+
+    pf.count = count;
+    pf.next = 0;
+    pf.fn = fn;
+    pf.ctx = ctx;
+    if(threads > count)
+        threads = count;
+    if(threads <= 1){
+        parallel_worker(&pf);
+        return;
+    }
+
+    handles = calloc(threads, sizeof(HANDLE));
+    for(i = 0; i < threads; i++)
+        handles[i] = CreateThread(NULL, 0, parallel_worker, &pf, 0, NULL);
+    for(i = 0; i < threads; i++){
+        if(handles[i] == NULL)
+            continue;
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+    }
+    free(handles);
+    /* threads that failed to start leave work behind */
+    parallel_worker(&pf);
+}
@@ -0,0 +1,69 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+
+#include "rsc2/include/Rsc2CApi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+/**************************************************
+* helpers shared by the rsctool commands
+* option parsing, timing, error reporting and
+* connecting to a list of rsc2 hosts ("fleet")
+**************************************************/
+
+#define MAX_HOSTS       64
+#define HOST_NAME_LEN   64
+#define ERROR_LEN       128
+#define NUM_SIGNALS     (RSC2_ID_AC_2 + 1)      /* Rsc2_SignalID values */
+
+typedef struct
+{
+    int hostIndex;              /* index into Fleet.hosts */
+    int boxIndex;               /* index of the box on its host */
+    Rsc2_Box *box;
+} FleetBox;
+
+typedef struct
+{
+    int numHosts;
+    char hostNames[MAX_HOSTS][HOST_NAME_LEN];
+    Rsc2_Host *hosts[MAX_HOSTS];
+    int numBoxes;
+    FleetBox *boxes;
+} Fleet;
+
+/* "--name value" style options, argv[0] is the command name */
+const char *opt_str(int argc, char *argv[], const char *name, const char *def);
+int opt_int(int argc, char *argv[], const char *name, int def);
+int opt_flag(int argc, char *argv[], const char *name);
+
+/* monotonic microseconds since the first call */
+long long now_us(void);
+
+/* prints "<what>: <last rsc2 error>" the same way main does */
+void print_rsc_error(const char *what);
+
+/* asserts a button signal, holds it for "ms" and releases it */
+Rsc2_Result press_button(Rsc2_Box *box, Rsc2_SignalID id, int ms);
+
+/* turns both ac ports on and presses the power button */
+Rsc2_Result power_on_box(Rsc2_Box *box);
+
+/* connects to every host of a comma separated list (default "localhost")
+ * and enumerates their boxes. returns -1 when no host could be reached. */
+int fleet_open(Fleet *fleet, const char *hostList);
+void fleet_close(Fleet *fleet);
+
+/* calls fn(index, ctx) for index 0..count-1 from up to "threads"
+ * threads and returns when all calls are done */
+void parallel_for(int count, int threads, void (*fn)(int index, void *ctx), void *ctx);
+
+#include "trace.h"
+
+#endif /* COMMON_H */
@@ -0,0 +1,352 @@
+#include "common.h"
+#include "commands.h"
+#include "statecache.h"
+
+/**************************************************
+* rsctool converge --file desired [--hosts h1,h2]
+*                  [--threads n] [--dry-run]
+*                  [--watch [--seconds n] [--interval-ms ms]]
+*                  [--drift-ms ms]
+* brings ac ports, jumpers and usb mux of the fleet
+* to a declared state. one setting per line, tab
+* separated, "*" for every box; later lines win:
+*   <box description | *>  RSC2_ID_AC_1         on | off
+*   <box description | *>  RSC2_ID_JMP_MFG_MODE RSC2_JMP_ENABLED ...
+*   <box description | *>  usb_mux              RSC2_MUX_TO_SUT ...
+* ac ports are RSC2_ID_AC_1/2, jumpers the four
+* RSC2_ID_JMP_ ids. current state is read in
+* parallel, boxes already there get no writes, the
+* others only the writes that differ, again in
+* parallel.
+* --watch then keeps the fleet there: state comes
+* from the listener maintained cache (statecache.h),
+* so a pass over a converged fleet reads memory only,
+* and whatever drifts is written back on the next
+* pass, every --interval-ms (200), for --seconds
+* (0, until killed).
+* --drift-ms makes another client flip a random
+* setting that often (Standin only).
+**************************************************/
+
+#define DESC_LEN        64
+#define LINE_LEN        256
+#define MUX_BIT         (1u << NUM_SIGNALS)
+#define MAX_STALENESS   3600000     /* the listeners keep the cache current */
+
+typedef struct
+{
+    int index;                          /* into fleet.boxes */
+    signed char want[NUM_SIGNALS];      /* -1 when not managed */
+    int wantMux;                        /* -1 when not managed */
+    Rsc2_Signal *signals[NUM_SIGNALS];
+    unsigned int drift;                 /* bit per signal and MUX_BIT */
+} ConvergeBox;
+
+typedef struct
+{
+    Fleet fleet;
+    StateCache *cache;                  /* read through this when set */
+    ConvergeBox *boxes;                 /* per fleet box */
+    char (*descriptions)[DESC_LEN];
+    volatile LONG reads;
+    volatile LONG writes;
+    volatile LONG failures;
+} Converge;
+
+static int lookup_symbol(const Rsc2_SymRec *table, const char *name, int *value){
+    int i;
+
+    for(i = 0; table[i].name != NULL; i++){
+        if(strcmp(table[i].name, name) == 0){
+            *value = table[i].value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int managed_signal(Rsc2_SignalID id){
+    return id == RSC2_ID_AC_1 || id == RSC2_ID_AC_2
+        || (id >= RSC2_ID_JMP_MFG_MODE && id <= RSC2_ID_JMP_BIOS_RECOVERY);
+}
+
+/* applies one line to every box it names */
+static int parse_line(Converge *cv, char *line){
+    char *setting = NULL;
+    char *value = NULL;
+    Rsc2_SignalID id = RSC2_ID_AC_1;
+    int isMux, number, matched = 0;
+    int i;
+
+    setting = strchr(line, '\t');
+    if(setting == NULL)
+        return -1;
+    *setting++ = '\0';
+    value = strchr(setting, '\t');
+    if(value == NULL)
+        return -1;
+    *value++ = '\0';
+
+    isMux = strcmp(setting, "usb_mux") == 0;
+    if(isMux){
+        if(lookup_symbol(Rsc2_GetUsbMuxStateTable(), value, &number) != 0)
+            return -1;
+    }else{
+        if(Rsc2_StringToSignalID(setting, &id) != 0 || !managed_signal(id))
+            return -1;
+        if(strcmp(value, "on") == 0)
+            number = 1;
+        else if(strcmp(value, "off") == 0)
+            number = 0;
+        else if(lookup_symbol(Rsc2_GetSigStateTable(), value, &number) != 0)
+            return -1;
+    }
+
+    for(i = 0; i < cv->fleet.numBoxes; i++){
+        if(strcmp(line, "*") != 0 && strcmp(line, cv->descriptions[i]) != 0)
+            continue;
+        if(isMux)
+            cv->boxes[i].wantMux = number;
+        else
+            cv->boxes[i].want[id] = (signed char)number;
+        matched++;
+    }
+    if(matched == 0){
+        printf("box \"%s\" not found\n", line);
+        return -1;
+    }
+    return 0;
+}
+
+static int load_desired(Converge *cv, const char *path){
+    char line[LINE_LEN];
+    int lineNo = 0;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        printf("unable to open %s\n", path);
+        return -1;
+    }
+    while(fgets(line, LINE_LEN, file) != NULL){
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+        if(parse_line(cv, line) != 0){
+            printf("%s:%d: invalid desired state line\n", path, lineNo);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static void read_description(int index, void *ctx){
+    Converge *cv = ctx;
+
+    Rsc2_GetDescription(cv->fleet.boxes[index].box, cv->descriptions[index], DESC_LEN);
+    InterlockedIncrement(&cv->reads);
+}
+
+/* marks the settings of one box that are not where they should be */
+static void diff_box(int index, void *ctx){
+    Converge *cv = ctx;
+    ConvergeBox *cb = &cv->boxes[index];
+    Rsc2_Box *box = cv->fleet.boxes[index].box;
+    int i, state;
+
+    cb->drift = 0;
+    for(i = 0; i < NUM_SIGNALS; i++){
+        if(cb->want[i] < 0)
+            continue;
+        if(cv->cache != NULL){
+            state = state_cache_signal(cv->cache, index, (Rsc2_SignalID)i, MAX_STALENESS);
+        }else{
+            if(cb->signals[i] == NULL){
+                cb->signals[i] = Rsc2_GetSignal(box, (Rsc2_SignalID)i);
+                InterlockedIncrement(&cv->reads);
+            }
+            if(cb->signals[i] == NULL){
+                InterlockedIncrement(&cv->failures);
+                continue;
+            }
+            state = Rsc2_GetSigAssertionState(cb->signals[i]);
+            InterlockedIncrement(&cv->reads);
+        }
+        if(state < 0){
+            InterlockedIncrement(&cv->failures);
+            continue;
+        }
+        if(state != cb->want[i])
+            cb->drift |= 1u << i;
+    }
+    if(cb->wantMux >= 0){
+        if(cv->cache != NULL){
+            state = state_cache_usb_mux(cv->cache, index, MAX_STALENESS);
+        }else{
+            state = Rsc2_GetUsbMuxState(box);
+            InterlockedIncrement(&cv->reads);
+        }
+        if(state != cb->wantMux)
+            cb->drift |= MUX_BIT;
+    }
+}
+
+static void apply_box(int index, void *ctx){
+    long long start = trace_begin();
+    Converge *cv = ctx;
+    ConvergeBox *cb = &cv->boxes[index];
+    Rsc2_Box *box = cv->fleet.boxes[index].box;
+    Rsc2_Result result;
+    int i;
+
+    for(i = 0; i < NUM_SIGNALS; i++){
+        if(!(cb->drift & 1u << i))
+            continue;
+        if(cb->signals[i] == NULL)
+            cb->signals[i] = Rsc2_GetSignal(box, (Rsc2_SignalID)i);
+        result = Rsc2_SetSigAssertionState(cb->signals[i], (Rsc2_SignalState)cb->want[i]);
+        InterlockedIncrement(&cv->writes);
+        if(result != RSC2_SUCCESS)
+            InterlockedIncrement(&cv->failures);
+    }
+    if(cb->drift & MUX_BIT){
+        result = Rsc2_SetUsbMux(box, (Rsc2_UsbMuxState)cb->wantMux);
+        InterlockedIncrement(&cv->writes);
+        if(result != RSC2_SUCCESS)
+            InterlockedIncrement(&cv->failures);
+    }
+    trace_end("apply_box", start, box);
+}
+
+static void print_drift(Converge *cv, const char *what, double at){
+    int i, j;
+
+    for(i = 0; i < cv->fleet.numBoxes; i++){
+        ConvergeBox *cb = &cv->boxes[i];
+
+        for(j = 0; j <= NUM_SIGNALS; j++){
+            if(!(cb->drift & 1u << j))
+                continue;
+            if(at >= 0)
+                printf("%7.1f s  ", at);
+            printf("%s %s: %s\n", cv->descriptions[i],
+                   j < NUM_SIGNALS ? Rsc2_SignalIDToAssignedString((Rsc2_SignalID)j) : "usb_mux", what);
+        }
+    }
+}
+
+/* one pass: find what differs and write it, returns how many boxes differed */
+static int converge_pass(Converge *cv, int threads, int dryRun){
+    int drifted = 0;
+    int i;
+
+    parallel_for(cv->fleet.numBoxes, cv->cache != NULL ? 1 : threads, diff_box, cv);
+    for(i = 0; i < cv->fleet.numBoxes; i++){
+        if(cv->boxes[i].drift)
+            drifted++;
+    }
+    if(drifted > 0 && !dryRun)
+        parallel_for(cv->fleet.numBoxes, threads, apply_box, cv);
+    return drifted;
+}
+
+#ifdef RSC_STANDIN
+/* another client changing a managed setting behind our back */
+static void drift_one(Converge *cv, unsigned int *seed){
+    ConvergeBox *cb = NULL;
+    int i;
+
+    *seed = *seed * 1103515245 + 12345;
+    cb = &cv->boxes[(*seed >> 8) % cv->fleet.numBoxes];
+    for(i = 0; i < NUM_SIGNALS; i++){
+        if(cb->want[(i + (*seed >> 4)) % NUM_SIGNALS] >= 0)
+            break;
+    }
+    if(i < NUM_SIGNALS){
+        i = (i + (*seed >> 4)) % NUM_SIGNALS;
+        Rsc2_SetSigAssertionState(Rsc2_GetSignal(cv->fleet.boxes[cb->index].box, (Rsc2_SignalID)i),
+                                  (Rsc2_SignalState)!cb->want[i]);
+    }else if(cb->wantMux >= 0){
+        Rsc2_SetUsbMux(cv->fleet.boxes[cb->index].box,
+                       cb->wantMux == RSC2_MUX_TO_SUT ? RSC2_MUX_TO_HOST : RSC2_MUX_TO_SUT);
+    }
+}
+#endif
+
+static void watch_fleet(Converge *cv, int threads, int seconds, int intervalMs, int driftMs){
+    long long started = now_us();
+    long long lastDrift = started;
+    long hits = 0, liveReads = 0, hitsAfter = 0, liveAfter = 0;
+    int drifted, passes = 0, repaired = 0;
+    unsigned int seed = 12345;
+
+    cv->cache = state_cache_open(&cv->fleet);
+    if(cv->cache == NULL)
+        return;
+    state_cache_counts(cv->cache, &hits, &liveReads);
+    printf("watching, every %d ms\n", intervalMs);
+    while(seconds == 0 || now_us() - started < (long long)seconds * 1000000){
+#ifdef RSC_STANDIN
+        if(driftMs > 0 && now_us() - lastDrift >= (long long)driftMs * 1000){
+            drift_one(cv, &seed);
+            lastDrift = now_us();
+        }
+#endif
+        Sleep(intervalMs);
+        passes++;
+        drifted = converge_pass(cv, threads, 0);
+        if(drifted > 0){
+            repaired += drifted;
+            print_drift(cv, "drifted, set back", (now_us() - started) / 1000000.0);
+        }
+    }
+    state_cache_counts(cv->cache, &hitsAfter, &liveAfter);
+    printf("%d passes, %d drifts set back, %ld cached reads, %ld live reads\n", passes, repaired,
+           hitsAfter - hits, liveAfter - liveReads);
+    state_cache_close(cv->cache);
+    cv->cache = NULL;
+}
+
+int converge_main(int argc, char *argv[]){
+    const char *path = opt_str(argc, argv, "--file", NULL);
+    int threads = opt_int(argc, argv, "--threads", 32);
+    int dryRun = opt_flag(argc, argv, "--dry-run");
+    long long started = now_us();
+    int drifted;
+    Converge cv;
+    int i;
+
+    if(path == NULL){
+        printf("converge needs --file\n");
+        return -1;
+    }
+    memset(&cv, 0, sizeof(cv));
+    if(fleet_open(&cv.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    cv.descriptions = calloc(cv.fleet.numBoxes + 1, DESC_LEN);
+    cv.boxes = calloc(cv.fleet.numBoxes + 1, sizeof(ConvergeBox));
+    for(i = 0; i < cv.fleet.numBoxes; i++){
+        cv.boxes[i].index = i;
+        memset(cv.boxes[i].want, -1, NUM_SIGNALS);
+        cv.boxes[i].wantMux = -1;
+    }
+    parallel_for(cv.fleet.numBoxes, threads, read_description, &cv);
+    if(load_desired(&cv, path) != 0)
+        return -1;
+
+    drifted = converge_pass(&cv, threads, dryRun);
+    print_drift(&cv, dryRun ? "differs" : "set", -1);
+    printf("converge: %d boxes, %d differed, %ld reads, %ld writes, %ld failed, %.0f ms%s\n",
+           cv.fleet.numBoxes, drifted, cv.reads, cv.writes, cv.failures, (now_us() - started) / 1000.0,
+           dryRun ? " (dry run)" : "");
+    if(opt_flag(argc, argv, "--watch") && !dryRun)
+        watch_fleet(&cv, threads, opt_int(argc, argv, "--seconds", 0), opt_int(argc, argv, "--interval-ms", 200),
+                    opt_int(argc, argv, "--drift-ms", 0));
+
+    free(cv.descriptions);
+    free(cv.boxes);
+    fleet_close(&cv.fleet);
+    return cv.failures ? -1 : 0;
+}
@@ -0,0 +1,202 @@
+#include "common.h"
+#include "commands.h"
+#include "cyclepoller.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool cycle [--hosts h1,h2] [--type ac|dc|ac-dc]
+*               [--cycles n] [--boot-timeout sec]
+*               [--off-ms ms] [--end-off-ms ms] [--off-step-ms ms]
+*               [--ac-dc-delay-ms ms] [--expect-boot-ms ms]
+*               [--min-ms ms] [--max-ms ms]
+*               [--continue error|timeout|never] [--max-continues n]
+*               [--rate n] [--workers n] [--report-s sec]
+*               [--verbose] [--post-errors n] [--hang n]
+* runs a firmware power cycling campaign on every box
+* and follows it with the cycle poller (cyclepoller.h):
+* --cycles (3) cycles of --type (ac-dc), --off-ms
+* (2000) off, growing by --off-step-ms up to
+* --end-off-ms, --boot-timeout (60) for the sut to boot.
+* each box is read between --min-ms (250) and --max-ms
+* (10000) apart, depending on how close its next phase
+* change is expected; --expect-boot-ms (10000) is the
+* first guess of the boot time. phase errors get a
+* continue --continue (timeout) at most
+* --max-continues (2) times. calls are limited to
+* --rate (20) per second and --workers (4) at a time
+* per host. progress is printed every --report-s (5),
+* --verbose prints every change of a box.
+* the report lists the failed boxes and compares the
+* number of reads to reading every box at --min-ms.
+* --post-errors makes n boxes fail post and --hang
+* hangs n suts during the first boot (Standin only).
+**************************************************/
+
+#define DESC_LEN        64
+#define TICK_MS         100
+
+typedef struct
+{
+    Fleet fleet;
+    char (*descriptions)[DESC_LEN];
+    long long start;
+} CycleRun;
+
+static CycleRun cr;
+
+static void get_description(int index, void *ctx){
+    (void)ctx;
+    Rsc2_GetDescription(cr.fleet.boxes[index].box, cr.descriptions[index], DESC_LEN);
+}
+
+static void print_change(int box, const CycleBox *state, void *ctx){
+    (void)ctx;
+    printf("%7.1f s  %s  %s  %d cycles  off %d ms%s\n", (now_us() - cr.start) / 1000000.0,
+           cr.descriptions[box], cycle_state_name(state->state), state->status.numCycles,
+           state->status.offTimeMSecs, state->status.isTimedOutWaitingForContinue ? "  timed out waiting" : "");
+}
+
+static int parse_type(const char *name, Rsc2_PwrCycleType *type){
+    if(strcmp(name, "ac") == 0)
+        *type = RSC2_PWRCYC_AC;
+    else if(strcmp(name, "dc") == 0)
+        *type = RSC2_PWRCYC_DC;
+    else if(strcmp(name, "ac-dc") == 0)
+        *type = RSC2_PWRCYC_AC_DC;
+    else
+        return -1;
+    return 0;
+}
+
+static int parse_continue(const char *name, CycleContinue *continueOn){
+    if(strcmp(name, "error") == 0)
+        *continueOn = CYCLE_CONTINUE_ON_ERROR;
+    else if(strcmp(name, "timeout") == 0)
+        *continueOn = CYCLE_CONTINUE_ON_TIMEOUT;
+    else if(strcmp(name, "never") == 0)
+        *continueOn = CYCLE_CONTINUE_NEVER;
+    else
+        return -1;
+    return 0;
+}
+
+static void print_progress(CycleCounts *counts){
+    printf("%7.1f s  running %d  paused %d  done %d  failed %d  reads %lld  continues %lld\n",
+           (now_us() - cr.start) / 1000000.0, counts->byState[CYCLE_STARTING] + counts->byState[CYCLE_RUNNING],
+           counts->byState[CYCLE_PAUSED], counts->byState[CYCLE_DONE], counts->byState[CYCLE_FAILED],
+           counts->polls, counts->continues);
+}
+
+int cycle_main(int argc, char *argv[]){
+    int reportMs = opt_int(argc, argv, "--report-s", 5) * 1000;
+    int verbose = opt_flag(argc, argv, "--verbose");
+    CyclePolicy policy;
+    CycleCampaign campaign;
+    CycleCounts counts;
+    CycleBox state;
+    Scheduler *sched = NULL;
+    CyclePoller *poller = NULL;
+    long long lastReport;
+    double seconds;
+    int i;
+#ifdef RSC_STANDIN
+    int hang = opt_int(argc, argv, "--hang", 0);
+    int postErrors = opt_int(argc, argv, "--post-errors", 0);
+#endif
+
+    memset(&cr, 0, sizeof(cr));
+    memset(&policy, 0, sizeof(policy));
+    memset(&campaign, 0, sizeof(campaign));
+    if(parse_type(opt_str(argc, argv, "--type", "ac-dc"), &campaign.type) != 0){
+        printf("--type takes ac, dc or ac-dc\n");
+        return -1;
+    }
+    if(parse_continue(opt_str(argc, argv, "--continue", "timeout"), &policy.continueOn) != 0){
+        printf("--continue takes error, timeout or never\n");
+        return -1;
+    }
+    campaign.cycles = opt_int(argc, argv, "--cycles", 3);
+    campaign.bootTimeoutS = opt_int(argc, argv, "--boot-timeout", 60);
+    campaign.startOffMs = opt_int(argc, argv, "--off-ms", 2000);
+    campaign.endOffMs = opt_int(argc, argv, "--end-off-ms", campaign.startOffMs);
+    campaign.offStepMs = opt_int(argc, argv, "--off-step-ms", 0);
+    campaign.acDcDelayMs = opt_int(argc, argv, "--ac-dc-delay-ms", 0);
+    campaign.expectBootMs = opt_int(argc, argv, "--expect-boot-ms", 10000);
+    policy.minIntervalMs = opt_int(argc, argv, "--min-ms", 250);
+    policy.maxIntervalMs = opt_int(argc, argv, "--max-ms", 10000);
+    policy.maxContinues = opt_int(argc, argv, "--max-continues", 2);
+
+    if(fleet_open(&cr.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    if(cr.fleet.numBoxes == 0){
+        printf("no boxes\n");
+        fleet_close(&cr.fleet);
+        return -1;
+    }
+    cr.descriptions = calloc(cr.fleet.numBoxes, DESC_LEN);
+    parallel_for(cr.fleet.numBoxes, 32, get_description, NULL);
+#ifdef RSC_STANDIN
+    for(i = 0; i < postErrors && i < cr.fleet.numBoxes; i++)
+        standin_set_post_error(cr.fleet.boxes[cr.fleet.numBoxes - 1 - i].box, 2);
+#endif
+
+    sched = scheduler_open(&cr.fleet, opt_int(argc, argv, "--rate", 20), 5, opt_int(argc, argv, "--workers", 4));
+    if(sched == NULL){
+        fleet_close(&cr.fleet);
+        return -1;
+    }
+    poller = cycle_poller_open(&cr.fleet, sched, &policy, verbose ? print_change : NULL, NULL);
+    if(poller == NULL){
+        scheduler_close(sched);
+        fleet_close(&cr.fleet);
+        return -1;
+    }
+
+    printf("power cycling %d boxes, %d cycles each\n", cr.fleet.numBoxes, campaign.cycles);
+    cr.start = now_us();
+    lastReport = cr.start;
+    for(i = 0; i < cr.fleet.numBoxes; i++)
+        cycle_poller_start(poller, i, &campaign);
+    do{
+        Sleep(TICK_MS);
+#ifdef RSC_STANDIN
+        /* halfway through the first post */
+        if(hang > 0 && now_us() - cr.start >= (campaign.startOffMs + campaign.acDcDelayMs + 1000) * 1000LL){
+            for(i = 0; i < hang && i < cr.fleet.numBoxes; i++)
+                standin_hang_sut(cr.fleet.boxes[i].box, 2);
+            hang = 0;
+        }
+#endif
+        cycle_poller_counts(poller, &counts);
+        if(now_us() - lastReport >= reportMs * 1000LL){
+            print_progress(&counts);
+            lastReport = now_us();
+        }
+    }while(counts.byState[CYCLE_DONE] + counts.byState[CYCLE_FAILED] < counts.tracked);
+    seconds = (now_us() - cr.start) / 1000000.0;
+
+    print_progress(&counts);
+    for(i = 0; i < cr.fleet.numBoxes; i++){
+        cycle_poller_box(poller, i, &state);
+        if(state.state == CYCLE_FAILED){
+            printf("  failed: %s after %d cycles, %d continues, %s%s\n", cr.descriptions[i],
+                   state.status.numCycles, state.continues,
+                   state.result != RSC2_SUCCESS ? Rsc2_ResultCodeToString(state.result) : "phase error",
+                   state.status.isTimedOutWaitingForContinue ? ", timed out waiting for continue" : "");
+        }
+    }
+    printf("%d of %d boxes done in %.1f s\n", counts.byState[CYCLE_DONE], counts.tracked, seconds);
+    printf("%lld status reads, %.1f per box per minute; reading every %d ms would have taken %.0f\n",
+           counts.polls, counts.polls * 60.0 / seconds / counts.tracked, policy.minIntervalMs,
+           seconds * 1000.0 / policy.minIntervalMs * counts.tracked);
+    printf("%lld continues, %lld failed calls, changes showed up within %.2f s\n", counts.continues,
+           counts.callErrors, counts.detectGapMaxUs / 1000000.0);
+
+    cycle_poller_close(poller);
+    scheduler_close(sched);
+    free(cr.descriptions);
+    fleet_close(&cr.fleet);
+    return counts.byState[CYCLE_FAILED] == 0 ? 0 : -1;
+}
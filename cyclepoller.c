@@ -0,0 +1,361 @@
+#include "cyclepoller.h"
+
+#define MAX_CALL_ERRORS     5   /* in a row, then the box is failed */
+
+enum
+{
+    CALL_START,
+    CALL_POLL,
+    CALL_CONTINUE
+};
+
+typedef struct
+{
+    SchedCommand cmd;
+    CyclePoller *poller;
+    int index;
+    int tracked;
+    int call;                   /* what the next call does */
+    CycleCampaign campaign;
+    CycleBox state;
+    Rsc2_PwrCycleStatus read;   /* written by the call on the worker */
+    int readTotalS;
+    int errorsInRow;
+    long long lastPollAt;
+    long long lastChangeAt;     /* estimated time of the last phase change */
+    long long errorSeenAt;
+} CycleTrack;
+
+typedef struct
+{
+    long long due;
+    int box;
+} CycleTimer;
+
+struct CyclePoller
+{
+    Fleet *fleet;
+    Scheduler *sched;
+    CyclePolicy policy;
+    CycleChanged changed;
+    void *ctx;
+    int tenant;
+    CycleTrack *tracks;
+    CycleTimer *timers;         /* binary min-heap on due, a box at most once */
+    int numTimers;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    CONDITION_VARIABLE idle;
+    int inFlight;
+    int stopping;
+    HANDLE thread;
+};
+
+static const char *stateNames[] = { "starting", "running", "paused", "done", "failed" };
+
+const char *cycle_state_name(CycleState state){
+    return state >= CYCLE_STARTING && state <= CYCLE_FAILED ? stateNames[state] : "?";
+}
+
+static long long clamp_interval(CyclePoller *poller, long long us){
+    long long min = (long long)poller->policy.minIntervalMs * 1000;
+    long long max = (long long)poller->policy.maxIntervalMs * 1000;
+
+    return us < min ? min : us > max ? max : us;
+}
+
+/* below, the caller holds poller->lock */
+
+static void schedule_call(CyclePoller *poller, CycleTrack *track, int call, long long due){
+    int i;
+
+    track->call = call;
+    for(i = poller->numTimers++; i > 0 && poller->timers[(i - 1) / 2].due > due; i = (i - 1) / 2)
+        poller->timers[i] = poller->timers[(i - 1) / 2];
+    poller->timers[i].due = due;
+    poller->timers[i].box = track->index;
+    WakeConditionVariable(&poller->wake);
+}
+
+static int pop_timer(CyclePoller *poller){
+    int box = poller->timers[0].box;
+    CycleTimer last = poller->timers[--poller->numTimers];
+    int i = 0, child;
+
+    while((child = 2 * i + 1) < poller->numTimers){
+        if(child + 1 < poller->numTimers && poller->timers[child + 1].due < poller->timers[child].due)
+            child++;
+        if(poller->timers[child].due >= last.due)
+            break;
+        poller->timers[i] = poller->timers[child];
+        i = child;
+    }
+    if(poller->numTimers > 0)
+        poller->timers[i] = last;
+    return box;
+}
+
+static long long off_us(CycleTrack *track){
+    CycleCampaign *c = &track->campaign;
+    long long offMs = track->state.status.offTimeMSecs ? track->state.status.offTimeMSecs : c->startOffMs;
+
+    return (offMs + (c->type == RSC2_PWRCYC_AC_DC ? c->acDcDelayMs : 0)) * 1000;
+}
+
+/* half the time to the next expected phase change: the next
+ * cycle done, or failing that the boot timeout running out */
+static long long next_poll(CyclePoller *poller, CycleTrack *track, long long now){
+    long long expected = track->lastChangeAt + track->state.cycleUs;
+    long long deadline = track->lastChangeAt + off_us(track) + (long long)track->campaign.bootTimeoutS * 1000000;
+    long long until;
+
+    if(now < expected)
+        until = expected - now;
+    else if(now < expected + track->state.cycleUs / 4)
+        until = 0;
+    else if(now < deadline)
+        until = deadline - now;
+    else
+        until = 2LL * poller->policy.maxIntervalMs * 1000;
+    return now + clamp_interval(poller, until / 2);
+}
+
+static void poll_done(CyclePoller *poller, CycleTrack *track, long long now){
+    Rsc2_PwrCycleStatus *read = &track->read;
+    CycleBox *state = &track->state;
+    long long gap = now - track->lastPollAt;
+    int advanced = read->numCycles - state->status.numCycles;
+    CycleState before = state->state;
+    long long remaining;
+
+    track->lastPollAt = now;
+    state->polls++;
+    if(advanced > 0){
+        /* the change happened somewhere in the gap */
+        long long changeAt = now - gap / 2;
+
+        state->cycleUs = (3 * state->cycleUs + (changeAt - track->lastChangeAt) / advanced) / 4;
+        track->lastChangeAt = changeAt;
+    }
+    state->status = *read;
+
+    if(!read->isCyclingInProgress){
+        state->state = CYCLE_DONE;
+        state->totalTimeS = track->readTotalS;
+    }else if(read->isPhaseErrorDetected){
+        if(state->state != CYCLE_PAUSED){
+            state->state = CYCLE_PAUSED;
+            track->errorSeenAt = now;
+        }
+        if(poller->policy.continueOn == CYCLE_CONTINUE_NEVER || state->continues >= poller->policy.maxContinues){
+            state->state = CYCLE_FAILED;
+        }else if(poller->policy.continueOn == CYCLE_CONTINUE_ON_ERROR || read->isTimedOutWaitingForContinue){
+            schedule_call(poller, track, CALL_CONTINUE, now);
+        }else{
+            /* fast as the firmware's wait for a continue runs out */
+            remaining = track->errorSeenAt + (long long)read->continueWaitTimeSecs * 1000000 - now;
+            schedule_call(poller, track, CALL_POLL, now + clamp_interval(poller, remaining / 2));
+        }
+    }else{
+        schedule_call(poller, track, CALL_POLL, next_poll(poller, track, now));
+    }
+    if((advanced > 0 || state->state != before) && gap > state->detectGapMaxUs)
+        state->detectGapMaxUs = gap;
+}
+
+static Rsc2_Result run_call(SchedCommand *cmd){
+    CycleTrack *track = (CycleTrack *)cmd;
+    CycleCampaign *c = &track->campaign;
+    Rsc2_Box *box = track->poller->fleet->boxes[track->index].box;
+    Rsc2_Result result;
+
+    switch(track->call){
+    case CALL_START:
+        return Rsc2_PwrCycleStart(box, c->type, c->cycles, c->bootTimeoutS, c->startOffMs, c->endOffMs,
+                                  c->offStepMs, c->acDcDelayMs);
+    case CALL_CONTINUE:
+        return Rsc2_PwrCycleContinue(box);
+    default:
+        result = Rsc2_PwrCycleGetStatus(box, &track->read);
+        if(result == RSC2_SUCCESS && !track->read.isCyclingInProgress)
+            result = Rsc2_PwrCycleGetTotalTime(box, &track->readTotalS);
+        return result;
+    }
+}
+
+static void call_done(SchedCommand *cmd, Rsc2_Result result){
+    CycleTrack *track = (CycleTrack *)cmd;
+    CyclePoller *poller = track->poller;
+    CycleBox before, after;
+    long long now = now_us();
+
+    EnterCriticalSection(&poller->lock);
+    before = track->state;
+    track->state.result = result;
+    if(result != RSC2_SUCCESS){
+        track->state.callErrors++;
+        if(track->call == CALL_START || ++track->errorsInRow >= MAX_CALL_ERRORS)
+            track->state.state = CYCLE_FAILED;
+        else
+            schedule_call(poller, track, track->call,
+                          now + clamp_interval(poller, (long long)poller->policy.minIntervalMs * 1000 << track->errorsInRow));
+    }else{
+        track->errorsInRow = 0;
+        if(track->call == CALL_POLL){
+            poll_done(poller, track, now);
+        }else{
+            /* a start or a continue begins a cycle */
+            if(track->call == CALL_CONTINUE){
+                track->state.continues++;
+                track->state.status.isPhaseErrorDetected = 0;
+                track->state.status.isTimedOutWaitingForContinue = 0;
+            }
+            track->state.state = CYCLE_RUNNING;
+            track->lastChangeAt = now;
+            track->lastPollAt = now;
+            schedule_call(poller, track, CALL_POLL, next_poll(poller, track, now));
+        }
+    }
+    after = track->state;
+    LeaveCriticalSection(&poller->lock);
+
+    if(poller->changed != NULL
+    && (after.state != before.state || after.status.numCycles != before.status.numCycles))
+        poller->changed(track->index, &after, poller->ctx);
+
+    EnterCriticalSection(&poller->lock);
+    if(--poller->inFlight == 0)
+        WakeAllConditionVariable(&poller->idle);
+    LeaveCriticalSection(&poller->lock);
+}
+
+static DWORD WINAPI timer_thread(LPVOID arg){
+    CyclePoller *poller = arg;
+    CycleTrack *track = NULL;
+    long long wait;
+
+    EnterCriticalSection(&poller->lock);
+    while(!poller->stopping){
+        if(poller->numTimers == 0){
+            SleepConditionVariableCS(&poller->wake, &poller->lock, INFINITE);
+            continue;
+        }
+        wait = poller->timers[0].due - now_us();
+        if(wait > 0){
+            SleepConditionVariableCS(&poller->wake, &poller->lock, (DWORD)((wait + 999) / 1000));
+            continue;
+        }
+        track = &poller->tracks[pop_timer(poller)];
+        /* a continue is what a paused box waits for, it goes ahead of the polls */
+        track->cmd.priority = track->call == CALL_CONTINUE ? SCHED_INTERACTIVE : SCHED_BATCH;
+        track->cmd.tenant = poller->tenant;
+        poller->inFlight++;
+        scheduler_submit(poller->sched, &track->cmd);
+    }
+    LeaveCriticalSection(&poller->lock);
+    return 0;
+}
+
+CyclePoller *cycle_poller_open(Fleet *fleet, Scheduler *sched, const CyclePolicy *policy,
+                               CycleChanged changed, void *ctx){
+    CyclePoller *poller = calloc(1, sizeof(CyclePoller));
+    int i;
+
+    poller->fleet = fleet;
+    poller->sched = sched;
+    poller->policy = *policy;
+    if(poller->policy.minIntervalMs < 1)
+        poller->policy.minIntervalMs = 1;
+    if(poller->policy.maxIntervalMs < poller->policy.minIntervalMs)
+        poller->policy.maxIntervalMs = poller->policy.minIntervalMs;
+    poller->changed = changed;
+    poller->ctx = ctx;
+    poller->tenant = scheduler_tenant(sched, 1);
+    if(poller->tenant < 0){
+        free(poller);
+        return NULL;
+    }
+    poller->tracks = calloc(fleet->numBoxes + 1, sizeof(CycleTrack));
+    poller->timers = calloc(fleet->numBoxes + 1, sizeof(CycleTimer));
+    for(i = 0; i < fleet->numBoxes; i++){
+        poller->tracks[i].poller = poller;
+        poller->tracks[i].index = i;
+        poller->tracks[i].cmd.host = fleet->boxes[i].hostIndex;
+        poller->tracks[i].cmd.run = run_call;
+        poller->tracks[i].cmd.done = call_done;
+    }
+    InitializeCriticalSection(&poller->lock);
+    InitializeConditionVariable(&poller->wake);
+    InitializeConditionVariable(&poller->idle);
+    poller->thread = CreateThread(NULL, 0, timer_thread, poller, 0, NULL);
+    if(poller->thread == NULL){
+        printf("unable to start the poller thread\n");
+        free(poller->tracks);
+        free(poller->timers);
+        free(poller);
+        return NULL;
+    }
+    return poller;
+}
+
+void cycle_poller_close(CyclePoller *poller){
+    EnterCriticalSection(&poller->lock);
+    poller->stopping = 1;
+    WakeConditionVariable(&poller->wake);
+    LeaveCriticalSection(&poller->lock);
+    WaitForSingleObject(poller->thread, INFINITE);
+    CloseHandle(poller->thread);
+
+    EnterCriticalSection(&poller->lock);
+    while(poller->inFlight > 0)
+        SleepConditionVariableCS(&poller->idle, &poller->lock, INFINITE);
+    LeaveCriticalSection(&poller->lock);
+    free(poller->tracks);
+    free(poller->timers);
+    free(poller);
+}
+
+void cycle_poller_start(CyclePoller *poller, int box, const CycleCampaign *campaign){
+    CycleTrack *track = &poller->tracks[box];
+
+    EnterCriticalSection(&poller->lock);
+    if(track->tracked){
+        LeaveCriticalSection(&poller->lock);
+        printf("box %d is tracked already\n", box);
+        return;
+    }
+    track->tracked = 1;
+    track->campaign = *campaign;
+    memset(&track->state, 0, sizeof(track->state));
+    track->state.state = CYCLE_STARTING;
+    track->state.cycleUs = off_us(track) + (long long)campaign->expectBootMs * 1000;
+    schedule_call(poller, track, CALL_START, now_us());
+    LeaveCriticalSection(&poller->lock);
+}
+
+void cycle_poller_box(CyclePoller *poller, int box, CycleBox *state){
+    EnterCriticalSection(&poller->lock);
+    *state = poller->tracks[box].state;
+    LeaveCriticalSection(&poller->lock);
+}
+
+void cycle_poller_counts(CyclePoller *poller, CycleCounts *counts){
+    int i;
+
+    memset(counts, 0, sizeof(*counts));
+    EnterCriticalSection(&poller->lock);
+    for(i = 0; i < poller->fleet->numBoxes; i++){
+        CycleBox *state = &poller->tracks[i].state;
+
+        if(!poller->tracks[i].tracked)
+            continue;
+        counts->tracked++;
+        counts->byState[state->state]++;
+        counts->polls += state->polls;
+        counts->continues += state->continues;
+        counts->callErrors += state->callErrors;
+        if(state->detectGapMaxUs > counts->detectGapMaxUs)
+            counts->detectGapMaxUs = state->detectGapMaxUs;
+    }
+    LeaveCriticalSection(&poller->lock);
+}
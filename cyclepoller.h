@@ -0,0 +1,110 @@
+#ifndef CYCLEPOLLER_H
+#define CYCLEPOLLER_H
+
+#include "common.h"
+#include "scheduler.h"
+
+/**************************************************
+* firmware power cycling status poller
+* firmware power cycling has no listener callback,
+* its progress only shows in Rsc2_PwrCycleGetStatus.
+* the poller starts the cycling of any number of boxes
+* and keeps one timer thread that decides when each
+* box is read next; the calls themselves go through
+* the command scheduler (scheduler.h), so the rsc2
+* servers see its rate limit.
+* the interval adapts per box: half the time to the
+* next expected phase change (the next cycle done, as
+* learnt from the previous ones, or the boot timeout
+* running out), between minIntervalMs and
+* maxIntervalMs, and the minimum around and right
+* after the expected change.
+* on a phase error the poller sends
+* Rsc2_PwrCycleContinue, up to maxContinues times per
+* box: at once (CYCLE_CONTINUE_ON_ERROR), or when the
+* firmware timed out waiting for it
+* (CYCLE_CONTINUE_ON_TIMEOUT, the poller reads fast
+* as the timeout comes close). a box with no continue
+* left is failed and stays paused for inspection.
+**************************************************/
+
+typedef enum
+{
+    CYCLE_CONTINUE_NEVER,
+    CYCLE_CONTINUE_ON_ERROR,
+    CYCLE_CONTINUE_ON_TIMEOUT
+} CycleContinue;
+
+typedef enum
+{
+    CYCLE_STARTING,
+    CYCLE_RUNNING,
+    CYCLE_PAUSED,           /* phase error, a continue may follow */
+    CYCLE_DONE,
+    CYCLE_FAILED
+} CycleState;
+
+typedef struct
+{
+    int minIntervalMs;
+    int maxIntervalMs;
+    CycleContinue continueOn;
+    int maxContinues;
+} CyclePolicy;
+
+/* the arguments of Rsc2_PwrCycleStart */
+typedef struct
+{
+    Rsc2_PwrCycleType type;
+    int cycles;
+    int bootTimeoutS;
+    int startOffMs;
+    int endOffMs;
+    int offStepMs;
+    int acDcDelayMs;
+    int expectBootMs;       /* first guess of the boot time, the poller learns it */
+} CycleCampaign;
+
+typedef struct
+{
+    CycleState state;
+    Rsc2_PwrCycleStatus status;     /* as last read */
+    Rsc2_Result result;             /* of the last call */
+    int totalTimeS;                 /* read when the cycling ended */
+    int polls;
+    int continues;
+    int callErrors;
+    long long cycleUs;              /* expected duration of a cycle */
+    long long detectGapMaxUs;       /* longest poll gap a change showed up in */
+} CycleBox;
+
+typedef struct
+{
+    int tracked;
+    int byState[CYCLE_FAILED + 1];
+    long long polls;
+    long long continues;
+    long long callErrors;
+    long long detectGapMaxUs;
+} CycleCounts;
+
+typedef struct CyclePoller CyclePoller;
+
+/* called from a scheduler worker whenever the state or cycle count of a box changes */
+typedef void (*CycleChanged)(int box, const CycleBox *state, void *ctx);
+
+CyclePoller *cycle_poller_open(Fleet *fleet, Scheduler *sched, const CyclePolicy *policy,
+                               CycleChanged changed, void *ctx);
+
+/* waits for the calls in flight, the boxes keep cycling */
+void cycle_poller_close(CyclePoller *poller);
+
+/* starts the cycling of fleet->boxes[box] and tracks it */
+void cycle_poller_start(CyclePoller *poller, int box, const CycleCampaign *campaign);
+
+void cycle_poller_box(CyclePoller *poller, int box, CycleBox *state);
+void cycle_poller_counts(CyclePoller *poller, CycleCounts *counts);
+
+const char *cycle_state_name(CycleState state);
+
+#endif /* CYCLEPOLLER_H */
@@ -0,0 +1,239 @@
+#include "common.h"
+#include "commands.h"
+#include "topology.h"
+
+/**************************************************
+* rsctool discover [--hosts h1,h2] [--range a.b.c.d/n,...]
+*                  [--in-flight n] [--probe-timeout ms]
+*                  [--index file] [--lookup label]
+* finds the rsc2 hosts among a host list and/or
+* address ranges (cidr, /16 to /32) and writes every
+* box they have to the topology index --index
+* (rsctool.idx, see topology.h). up to --in-flight
+* (64) hosts are probed at a time; a probe that has
+* not answered in --probe-timeout (3000) ms counts as
+* no host, its connect attempt is left to finish in
+* the background and holds its in-flight slot until
+* it does.
+* --lookup opens a box by label through an existing
+* index instead, the way "rsctool on --label" does.
+**************************************************/
+
+#define STACK_SIZE      65536
+#define TICK_MS         5
+#define MIN_PREFIX      16
+
+enum
+{
+    PROBE_RUNNING,
+    PROBE_DONE,
+    PROBE_TIMED_OUT
+};
+
+typedef struct
+{
+    char name[HOST_NAME_LEN];
+    volatile LONG state;
+    long long startedAt;
+    int collected;
+    int numBoxes;               /* -1 when nothing answered */
+    TopologyEntry *entries;
+} Probe;
+
+/* threads of timed out probes still connecting */
+static volatile LONG abandoned;
+
+typedef struct
+{
+    Probe *probes;
+    int numProbes;
+    int capacity;
+} Targets;
+
+static void add_target(Targets *targets, const char *name){
+    Probe *probe = NULL;
+
+    if(targets->numProbes == targets->capacity){
+        targets->capacity = targets->capacity ? targets->capacity * 2 : 256;
+        targets->probes = realloc(targets->probes, targets->capacity * sizeof(Probe));
+    }
+    probe = &targets->probes[targets->numProbes++];
+    memset(probe, 0, sizeof(*probe));
+    strncpy(probe->name, name, HOST_NAME_LEN - 1);
+    probe->numBoxes = -1;
+}
+
+/* "10.1.2.0/24" -> 10.1.2.1 .. 10.1.2.254 */
+static int add_range(Targets *targets, const char *cidr){
+    unsigned int a, b, c, d, prefix;
+    unsigned int first, last, address;
+    char name[HOST_NAME_LEN];
+
+    if(sscanf(cidr, "%u.%u.%u.%u/%u", &a, &b, &c, &d, &prefix) != 5
+    || a > 255 || b > 255 || c > 255 || d > 255 || prefix < MIN_PREFIX || prefix > 32){
+        printf("invalid range %s, expected a.b.c.d/n with n from %d to 32\n", cidr, MIN_PREFIX);
+        return -1;
+    }
+    first = (a << 24 | b << 16 | c << 8 | d) & (prefix ? 0xffffffffu << (32 - prefix) : 0);
+    last = first | (prefix < 32 ? 0xffffffffu >> prefix : 0);
+    if(prefix < 31){
+        /* network and broadcast address */
+        first++;
+        last--;
+    }
+    for(address = first; ; address++){
+        sprintf(name, "%u.%u.%u.%u", address >> 24, address >> 16 & 255, address >> 8 & 255, address & 255);
+        add_target(targets, name);
+        if(address == last)
+            break;
+    }
+    return 0;
+}
+
+static DWORD WINAPI probe_thread(LPVOID arg){
+    Probe *probe = arg;
+    TopologyEntry *entries = NULL;
+    Rsc2_Host *host = Rsc2_ConnectToHost(probe->name);
+    int num = -1;
+
+    if(host != NULL)
+        num = topology_scan_host(host, probe->name, &entries);
+    probe->entries = entries;
+    probe->numBoxes = num;
+    /* a probe that timed out keeps its result to itself */
+    if(InterlockedCompareExchange(&probe->state, PROBE_DONE, PROBE_RUNNING) != PROBE_RUNNING){
+        probe->entries = NULL;
+        free(entries);
+        InterlockedDecrement(&abandoned);
+    }
+    return 0;
+}
+
+static int lookup(const char *path, const char *label){
+    Topology *topo = topology_load(path);
+    long long start = now_us();
+    char description[TOPOLOGY_TEXT_LEN];
+    Rsc2_Box *box = NULL;
+
+    if(topo == NULL)
+        return -1;
+    box = topology_box(topo, label);
+    if(box != NULL){
+        Rsc2_GetDescription(box, description, TOPOLOGY_TEXT_LEN);
+        printf("%s: %s, power led %s (%lld us)\n", label, description,
+               Rsc2_GetSigAssertionState(Rsc2_GetSignal(box, RSC2_ID_LED_PWR)) == RSC2_SIG_ASSERTED ? "on" : "off",
+               now_us() - start);
+    }
+    topology_close(topo);
+    return box != NULL ? 0 : -1;
+}
+
+int discover_main(int argc, char *argv[]){
+    const char *hostList = opt_str(argc, argv, "--hosts", NULL);
+    const char *rangeList = opt_str(argc, argv, "--range", NULL);
+    const char *path = opt_str(argc, argv, "--index", TOPOLOGY_PATH);
+    const char *label = opt_str(argc, argv, "--lookup", NULL);
+    int maxInFlight = opt_int(argc, argv, "--in-flight", 64);
+    long long timeoutUs = (long long)opt_int(argc, argv, "--probe-timeout", 3000) * 1000;
+    int numHosts = 0, numBoxes = 0, timedOut = 0, finished = 0;
+    int inFlight = 0, next = 0, oldest = 0;
+    TopologyEntry *entries = NULL;
+    Targets targets;
+    char list[MAX_HOSTS * HOST_NAME_LEN];
+    char *name = NULL;
+    long long start;
+    int i;
+
+    if(label != NULL)
+        return lookup(path, label);
+
+    memset(&targets, 0, sizeof(targets));
+    if(hostList != NULL){
+        strncpy(list, hostList, sizeof(list) - 1);
+        list[sizeof(list) - 1] = '\0';
+        for(name = strtok(list, ","); name != NULL; name = strtok(NULL, ","))
+            add_target(&targets, name);
+    }
+    if(rangeList != NULL){
+        strncpy(list, rangeList, sizeof(list) - 1);
+        list[sizeof(list) - 1] = '\0';
+        for(name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")){
+            if(add_range(&targets, name) != 0)
+                return -1;
+        }
+    }
+    if(targets.numProbes == 0){
+        printf("nothing to probe, give --hosts and/or --range\n");
+        return -1;
+    }
+
+    printf("probing %d addresses, %d at a time\n", targets.numProbes, maxInFlight);
+    start = now_us();
+    while(finished < targets.numProbes){
+        long long now;
+
+        while(inFlight + abandoned < maxInFlight && next < targets.numProbes){
+            Probe *probe = &targets.probes[next++];
+            HANDLE thread = NULL;
+
+            probe->startedAt = now_us();
+            probe->state = PROBE_RUNNING;
+            thread = CreateThread(NULL, STACK_SIZE, probe_thread, probe, 0, NULL);
+            if(thread == NULL){
+                probe->state = PROBE_DONE;
+            }else{
+                CloseHandle(thread);
+            }
+            inFlight++;
+        }
+        Sleep(TICK_MS);
+
+        now = now_us();
+        while(oldest < next && targets.probes[oldest].collected)
+            oldest++;
+        for(i = oldest; i < next; i++){
+            Probe *probe = &targets.probes[i];
+
+            if(probe->collected)
+                continue;
+            if(probe->state == PROBE_RUNNING && now - probe->startedAt > timeoutUs
+            && InterlockedCompareExchange(&probe->state, PROBE_TIMED_OUT, PROBE_RUNNING) == PROBE_RUNNING){
+                InterlockedIncrement(&abandoned);
+                timedOut++;
+            }
+            if(probe->state == PROBE_RUNNING)
+                continue;
+            probe->collected = 1;
+            finished++;
+            inFlight--;
+            if(probe->state == PROBE_DONE && probe->numBoxes >= 0){
+                printf("  %-24s %d boxes\n", probe->name, probe->numBoxes);
+                numHosts++;
+                numBoxes += probe->numBoxes;
+            }
+        }
+    }
+
+    entries = calloc(numBoxes + 1, sizeof(TopologyEntry));
+    numBoxes = 0;
+    for(i = 0; i < targets.numProbes; i++){
+        Probe *probe = &targets.probes[i];
+
+        if(probe->state != PROBE_DONE || probe->numBoxes <= 0)
+            continue;
+        memcpy(&entries[numBoxes], probe->entries, probe->numBoxes * sizeof(TopologyEntry));
+        numBoxes += probe->numBoxes;
+    }
+    printf("%d hosts with %d boxes among %d addresses (%d timed out) in %.1f s\n", numHosts, numBoxes,
+           targets.numProbes, timedOut, (now_us() - start) / 1000000.0);
+    if(topology_write(path, entries, numBoxes) != 0)
+        return -1;
+    for(i = 1; i < numBoxes; i++){
+        if(strcmp(entries[i - 1].key, entries[i].key) == 0)
+            printf("label %s is used by more than one box, lookups get the one on %s\n", entries[i].key,
+                   entries[i - 1].host);
+    }
+    printf("wrote %s\n", path);
+    free(entries);
+    return 0;
+}
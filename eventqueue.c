@@ -0,0 +1,394 @@
+#include "eventqueue.h"
+
+#define MAX_SHARDS      64
+#define IDLE_MS         100
+#define LATENCY_BUCKETS 32
+#define CACHE_LINE      64
+#define OPEN_THREADS    32
+
+/* ring positions wrap, compare them as differences */
+#define POS_ADD(pos, n)     ((LONG)((unsigned long)(pos) + (unsigned long)(n)))
+#define POS_DIFF(a, b)      ((LONG)((unsigned long)(a) - (unsigned long)(b)))
+
+typedef struct EventBox EventBox;
+
+/* a slot is free for the producer claiming position p when its
+ * sequence is p, and holds the event of p when it is p + 1 */
+typedef struct
+{
+    volatile LONG sequence;
+    Event event;
+} EventSlot;
+
+typedef struct
+{
+    EventQueue *queue;
+    EventSlot *slots;
+    LONG mask;
+    char pad0[CACHE_LINE];
+    volatile LONG enqueuePos;           /* producers */
+    volatile LONG dropped;
+    char pad1[CACHE_LINE];
+    volatile LONG dequeuePos;           /* the consumer */
+    volatile LONG idle;
+    volatile LONGLONG processed;
+    volatile LONG latency[LATENCY_BUCKETS];
+    volatile LONGLONG latencyMax;
+    volatile LONG maxDepth;
+    volatile LONG stopping;
+    CRITICAL_SECTION lock;              /* only to sleep and wake the consumer */
+    CONDITION_VARIABLE wake;
+    HANDLE thread;
+} EventShard;
+
+typedef struct
+{
+    EventBox *owner;
+    Rsc2_SignalID id;
+} EventSignal;
+
+struct EventBox
+{
+    EventQueue *queue;
+    int index;
+    int host;
+    EventShard *shard;
+    Rsc2_Signal *signals[NUM_SIGNALS];
+    EventSignal sig[NUM_SIGNALS];
+};
+
+typedef struct
+{
+    EventQueue *queue;
+    int index;
+} EventHost;
+
+struct EventQueue
+{
+    Fleet *fleet;
+    EventHandler handler;
+    void *ctx;
+    int numShards;
+    EventShard *shards;
+    EventBox *boxes;
+    EventHost hosts[MAX_HOSTS];
+    Rsc2_BoxListener boxListener;
+    Rsc2_HostListener hostListener;
+};
+
+static const char *typeNames[EVENT_TYPES] = {
+    "sigStateChanged", "sigLabelChanged", "boxStatusChanged", "lockHolderChanged",
+    "userLabelChanged", "kvmAddressChanged", "usbMuxChanged", "boxAdded", "boxRemoved",
+    "hostOffline", "hostOnline"
+};
+
+const char *event_type_name(EventType type){
+    return type >= 0 && type < EVENT_TYPES ? typeNames[type] : "unknown";
+}
+
+static int push(EventShard *shard, const Event *event){
+    EventSlot *slot = NULL;
+    LONG pos = shard->enqueuePos;
+
+    for(;;){
+        LONG diff;
+
+        slot = &shard->slots[pos & shard->mask];
+        diff = POS_DIFF(slot->sequence, pos);
+        if(diff == 0){
+            LONG seen = InterlockedCompareExchange(&shard->enqueuePos, POS_ADD(pos, 1), pos);
+
+            if(seen == pos)
+                break;
+            pos = seen;
+        }else if(diff < 0){
+            /* the consumer is a whole ring behind */
+            InterlockedIncrement(&shard->dropped);
+            return -1;
+        }else{
+            pos = shard->enqueuePos;
+        }
+    }
+    slot->event = *event;
+    InterlockedExchange(&slot->sequence, POS_ADD(pos, 1));
+    if(shard->idle){
+        EnterCriticalSection(&shard->lock);
+        WakeConditionVariable(&shard->wake);
+        LeaveCriticalSection(&shard->lock);
+    }
+    return 0;
+}
+
+static void record_latency(EventShard *shard, long long us){
+    int bucket = 0;
+
+    while(bucket < LATENCY_BUCKETS - 1 && us >= 1LL << bucket)
+        bucket++;
+    shard->latency[bucket]++;
+    if(us > shard->latencyMax)
+        InterlockedExchange64(&shard->latencyMax, us);
+}
+
+static DWORD WINAPI consumer_thread(LPVOID arg){
+    EventShard *shard = arg;
+    EventQueue *queue = shard->queue;
+
+    for(;;){
+        LONG pos = shard->dequeuePos;
+        EventSlot *slot = &shard->slots[pos & shard->mask];
+        LONG depth;
+        Event event;
+
+        if(POS_DIFF(slot->sequence, POS_ADD(pos, 1)) == 0){
+            depth = POS_DIFF(shard->enqueuePos, pos);
+            if(depth > shard->maxDepth)
+                shard->maxDepth = depth;
+            event = slot->event;
+            /* hand the slot back for the position one ring ahead */
+            InterlockedExchange(&slot->sequence, POS_ADD(pos, shard->mask + 1));
+            InterlockedExchange(&shard->dequeuePos, POS_ADD(pos, 1));
+            record_latency(shard, now_us() - event.receivedAt);
+            queue->handler(&event, queue->ctx);
+            InterlockedExchangeAdd64(&shard->processed, 1);
+            continue;
+        }
+        if(shard->stopping)
+            break;
+        EnterCriticalSection(&shard->lock);
+        InterlockedExchange(&shard->idle, 1);
+        if(POS_DIFF(slot->sequence, POS_ADD(pos, 1)) != 0 && !shard->stopping)
+            SleepConditionVariableCS(&shard->wake, &shard->lock, IDLE_MS);
+        shard->idle = 0;
+        LeaveCriticalSection(&shard->lock);
+    }
+    return 0;
+}
+
+/* the callbacks below run on the library's threads and only copy */
+
+static void post_signal(Rsc2_Signal *sig, EventType type){
+    EventSignal *es = Rsc2_GetObjectClientData((Rsc2_Object *)sig);
+    Event event;
+
+    if(es == NULL)
+        return;
+    event.type = type;
+    event.host = es->owner->host;
+    event.box = es->owner->index;
+    event.signal = es->id;
+    event.object = (Rsc2_Object *)sig;
+    event.receivedAt = now_us();
+    push(es->owner->shard, &event);
+}
+
+static void post_box(Rsc2_Box *box, EventType type){
+    EventBox *eb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+    Event event;
+
+    if(eb == NULL)
+        return;
+    event.type = type;
+    event.host = eb->host;
+    event.box = eb->index;
+    event.signal = (Rsc2_SignalID)0;
+    event.object = (Rsc2_Object *)box;
+    event.receivedAt = now_us();
+    push(eb->shard, &event);
+}
+
+/* host events go to the shard of the host index, a box added
+ * or removed is not always one of ours */
+static void post_host(Rsc2_Host *host, Rsc2_Box *box, EventType type){
+    EventHost *eh = Rsc2_GetObjectClientData((Rsc2_Object *)host);
+    EventBox *eb = box ? Rsc2_GetObjectClientData((Rsc2_Object *)box) : NULL;
+    Event event;
+
+    if(eh == NULL)
+        return;
+    event.type = type;
+    event.host = eh->index;
+    event.box = eb && eb->queue == eh->queue ? eb->index : -1;
+    event.signal = (Rsc2_SignalID)0;
+    event.object = box ? (Rsc2_Object *)box : (Rsc2_Object *)host;
+    event.receivedAt = now_us();
+    push(&eh->queue->shards[eh->index % eh->queue->numShards], &event);
+}
+
+static void on_sig_state_changed(Rsc2_Signal *sig){ post_signal(sig, EVENT_SIG_STATE); }
+static void on_sig_label_changed(Rsc2_Signal *sig){ post_signal(sig, EVENT_SIG_LABEL); }
+static void on_box_status_changed(Rsc2_Box *box){ post_box(box, EVENT_BOX_STATUS); }
+static void on_lock_holder_changed(Rsc2_Box *box){ post_box(box, EVENT_LOCK_HOLDER); }
+static void on_user_label_changed(Rsc2_Box *box){ post_box(box, EVENT_USER_LABEL); }
+static void on_kvm_address_changed(Rsc2_Box *box){ post_box(box, EVENT_KVM_ADDRESS); }
+static void on_usb_mux_changed(Rsc2_Box *box){ post_box(box, EVENT_USB_MUX); }
+static void on_box_added(Rsc2_Host *host, Rsc2_Box *box){ post_host(host, box, EVENT_BOX_ADDED); }
+static void on_box_removed(Rsc2_Host *host, Rsc2_Box *box){ post_host(host, box, EVENT_BOX_REMOVED); }
+static void on_host_offline(Rsc2_Host *host){ post_host(host, NULL, EVENT_HOST_OFFLINE); }
+static void on_host_online(Rsc2_Host *host){ post_host(host, NULL, EVENT_HOST_ONLINE); }
+
+static void open_box(int index, void *ctx){
+    EventQueue *queue = ctx;
+    EventBox *eb = &queue->boxes[index];
+    FleetBox *fb = &queue->fleet->boxes[index];
+    int i;
+
+    eb->queue = queue;
+    eb->index = index;
+    eb->host = fb->hostIndex;
+    eb->shard = &queue->shards[index % queue->numShards];
+    for(i = 0; i < NUM_SIGNALS; i++){
+        eb->signals[i] = Rsc2_GetSignal(fb->box, (Rsc2_SignalID)i);
+        if(eb->signals[i] == NULL)
+            return;
+        eb->sig[i].owner = eb;
+        eb->sig[i].id = (Rsc2_SignalID)i;
+        Rsc2_SetObjectClientData((Rsc2_Object *)eb->signals[i], &eb->sig[i]);
+    }
+    Rsc2_SetObjectClientData((Rsc2_Object *)fb->box, eb);
+    Rsc2_AttachBoxListener(fb->box, &queue->boxListener);
+}
+
+EventQueue *event_queue_open(Fleet *fleet, int numShards, int slots, EventHandler handler, void *ctx){
+    EventQueue *queue = calloc(1, sizeof(EventQueue));
+    int size = 2;
+    int i, j;
+
+    if(numShards < 1)
+        numShards = 1;
+    if(numShards > MAX_SHARDS)
+        numShards = MAX_SHARDS;
+    while(size < slots)
+        size *= 2;
+    queue->fleet = fleet;
+    queue->handler = handler;
+    queue->ctx = ctx;
+    queue->numShards = numShards;
+    queue->shards = calloc(numShards, sizeof(EventShard));
+    for(i = 0; i < numShards; i++){
+        EventShard *shard = &queue->shards[i];
+
+        shard->queue = queue;
+        shard->slots = calloc(size, sizeof(EventSlot));
+        shard->mask = size - 1;
+        for(j = 0; j < size; j++)
+            shard->slots[j].sequence = j;
+        InitializeCriticalSection(&shard->lock);
+        InitializeConditionVariable(&shard->wake);
+        shard->thread = CreateThread(NULL, 0, consumer_thread, shard, 0, NULL);
+        if(shard->thread == NULL){
+            printf("unable to start the consumer of shard %d\n", i);
+            queue->numShards = i;
+            event_queue_close(queue);
+            return NULL;
+        }
+    }
+
+    queue->boxListener.sigStateChanged = on_sig_state_changed;
+    queue->boxListener.sigLabelChanged = on_sig_label_changed;
+    queue->boxListener.boxStatusChanged = on_box_status_changed;
+    queue->boxListener.lockHolderChanged = on_lock_holder_changed;
+    queue->boxListener.userLabelChanged = on_user_label_changed;
+    queue->boxListener.kvmAddressChanged = on_kvm_address_changed;
+    queue->boxListener.usbMuxChanged = on_usb_mux_changed;
+    queue->hostListener.boxAdded = on_box_added;
+    queue->hostListener.boxRemoved = on_box_removed;
+    queue->hostListener.hostOffline = on_host_offline;
+    queue->hostListener.hostOnline = on_host_online;
+    queue->boxes = calloc(fleet->numBoxes + 1, sizeof(EventBox));
+    for(i = 0; i < fleet->numHosts; i++){
+        queue->hosts[i].queue = queue;
+        queue->hosts[i].index = i;
+        Rsc2_SetObjectClientData((Rsc2_Object *)fleet->hosts[i], &queue->hosts[i]);
+        Rsc2_AttachHostListener(fleet->hosts[i], &queue->hostListener);
+    }
+    parallel_for(fleet->numBoxes, OPEN_THREADS, open_box, queue);
+    for(i = 0; i < fleet->numBoxes; i++){
+        if(queue->boxes[i].signals[NUM_SIGNALS - 1] == NULL){
+            print_rsc_error("unable to get the box signals");
+            event_queue_close(queue);
+            return NULL;
+        }
+    }
+    return queue;
+}
+
+void event_queue_close(EventQueue *queue){
+    Fleet *fleet = queue->fleet;
+    int i, j;
+
+    for(i = 0; queue->boxes != NULL && i < fleet->numHosts; i++){
+        Rsc2_DetachHostListener(fleet->hosts[i], &queue->hostListener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)fleet->hosts[i], NULL);
+    }
+    for(i = 0; queue->boxes != NULL && i < fleet->numBoxes; i++){
+        Rsc2_DetachBoxListener(fleet->boxes[i].box, &queue->boxListener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)fleet->boxes[i].box, NULL);
+        for(j = 0; j < NUM_SIGNALS; j++){
+            if(queue->boxes[i].signals[j] != NULL)
+                Rsc2_SetObjectClientData((Rsc2_Object *)queue->boxes[i].signals[j], NULL);
+        }
+    }
+    for(i = 0; i < queue->numShards; i++){
+        EventShard *shard = &queue->shards[i];
+
+        EnterCriticalSection(&shard->lock);
+        shard->stopping = 1;
+        WakeConditionVariable(&shard->wake);
+        LeaveCriticalSection(&shard->lock);
+        WaitForSingleObject(shard->thread, INFINITE);
+        CloseHandle(shard->thread);
+        free(shard->slots);
+    }
+    free(queue->shards);
+    free(queue->boxes);
+    free(queue);
+}
+
+int event_queue_post(EventQueue *queue, const Event *event){
+    int shard = event->box >= 0 ? event->box : event->host;
+
+    return push(&queue->shards[shard % queue->numShards], event);
+}
+
+static long long percentile(const long long *buckets, long long total, int permille){
+    long long seen = 0;
+    int i;
+
+    for(i = 0; i < LATENCY_BUCKETS; i++){
+        seen += buckets[i];
+        if(seen * 1000 >= total * permille)
+            return 1LL << i;
+    }
+    return 1LL << (LATENCY_BUCKETS - 1);
+}
+
+void event_queue_counts(EventQueue *queue, EventCounts *counts){
+    long long buckets[LATENCY_BUCKETS];
+    long long total = 0;
+    int i, j;
+
+    memset(counts, 0, sizeof(*counts));
+    memset(buckets, 0, sizeof(buckets));
+    for(i = 0; i < queue->numShards; i++){
+        EventShard *shard = &queue->shards[i];
+        long long max = InterlockedCompareExchange64(&shard->latencyMax, 0, 0);
+        LONG depth = POS_DIFF(shard->enqueuePos, shard->dequeuePos);
+
+        counts->processed += InterlockedCompareExchange64(&shard->processed, 0, 0);
+        counts->dropped += shard->dropped;
+        counts->depth += depth;
+        if(shard->maxDepth > counts->maxDepth)
+            counts->maxDepth = shard->maxDepth;
+        if(max > counts->latencyMaxUs)
+            counts->latencyMaxUs = max;
+        for(j = 0; j < LATENCY_BUCKETS; j++){
+            buckets[j] += shard->latency[j];
+            total += shard->latency[j];
+        }
+    }
+    counts->received = counts->processed + counts->depth + counts->dropped;
+    if(total > 0){
+        counts->latencyP50Us = percentile(buckets, total, 500);
+        counts->latencyP99Us = percentile(buckets, total, 990);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include "common.h"
+
+/**************************************************
+* sharded event fan-in
+* attaches box and host listeners to a fleet whose
+* callbacks only copy the event into a preallocated
+* slot of a bounded lock-free ring and return, so the
+* library threads delivering them never wait for our
+* handlers. there is one ring per shard; a box always
+* maps to the same shard, so its events stay in order.
+* one consumer thread per shard calls the handler.
+* a full ring drops the event and counts it.
+* the queue owns the listeners and the client data of
+* the hosts, boxes and signals of the fleet.
+**************************************************/
+
+typedef enum
+{
+    EVENT_SIG_STATE,
+    EVENT_SIG_LABEL,
+    EVENT_BOX_STATUS,
+    EVENT_LOCK_HOLDER,
+    EVENT_USER_LABEL,
+    EVENT_KVM_ADDRESS,
+    EVENT_USB_MUX,
+    EVENT_BOX_ADDED,
+    EVENT_BOX_REMOVED,
+    EVENT_HOST_OFFLINE,
+    EVENT_HOST_ONLINE,
+    EVENT_TYPES
+} EventType;
+
+typedef struct
+{
+    EventType type;
+    int host;                   /* index into fleet->hosts */
+    int box;                    /* index into fleet->boxes, -1 for host events */
+    Rsc2_SignalID signal;       /* for the signal events */
+    Rsc2_Object *object;        /* the signal, box or host of the callback */
+    long long receivedAt;       /* now_us() in the callback */
+} Event;
+
+typedef void (*EventHandler)(const Event *event, void *ctx);
+typedef struct EventQueue EventQueue;
+
+typedef struct
+{
+    long long received;
+    long long dropped;
+    long long processed;
+    int depth;                  /* queued right now, all shards */
+    int maxDepth;               /* deepest any shard got */
+    long long latencyP50Us;     /* callback to handler, upper bounds */
+    long long latencyP99Us;
+    long long latencyMaxUs;
+} EventCounts;
+
+/* "slots" per shard is rounded up to a power of two. NULL on failure */
+EventQueue *event_queue_open(Fleet *fleet, int numShards, int slots, EventHandler handler, void *ctx);
+
+/* stops the listeners, lets the consumers drain and stops them */
+void event_queue_close(EventQueue *queue);
+
+/* queues an event as if a callback had delivered it */
+int event_queue_post(EventQueue *queue, const Event *event);
+
+void event_queue_counts(EventQueue *queue, EventCounts *counts);
+
+const char *event_type_name(EventType type);
+
+#endif /* EVENTQUEUE_H */
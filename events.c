@@ -0,0 +1,190 @@
+#include "common.h"
+#include "commands.h"
+#include "eventqueue.h"
+
+/**************************************************
+* rsctool events [--hosts h1,h2] [--shards n] [--slots n]
+*                [--seconds n] [--work-us us] [--verbose]
+*                [--bench n [--producers n] [--rate n]]
+* takes the box and host events of the fleet through
+* the sharded fan-in (eventqueue.h) for --seconds (10)
+* and prints the queue counters every second,
+* --verbose every event as well. --work-us makes the
+* handler busy for that long per event, as a handler
+* doing real work would be.
+* --bench posts n synthetic signal events from
+* --producers (8) threads as fast as they go, in
+* place of the library's callback threads, paced to
+* --rate events per second in total when given, and
+* reports the rate processed and the share dropped;
+* only a run without drops measured a sustained
+* rate, lower --rate until there are none.
+**************************************************/
+
+#define REPORT_MS       1000
+
+typedef struct
+{
+    Fleet *fleet;
+    int verbose;
+    long long workUs;
+    volatile LONGLONG benchHandled;     /* the bench's own events, they have no object */
+} EventsRun;
+
+typedef struct
+{
+    EventQueue *queue;
+    int numBoxes;
+    int count;
+    int first;                  /* first event index of this producer */
+    double intervalUs;          /* between two events of this producer, 0 unpaced */
+    long long start;
+    long long posted;
+} EventsProducer;
+
+static void handle_event(const Event *event, void *ctx){
+    EventsRun *run = ctx;
+    long long until;
+
+    if(event->object == NULL)
+        InterlockedIncrement64(&run->benchHandled);
+    if(run->verbose){
+        if(event->box >= 0)
+            printf("%s box %d %s\n", event_type_name(event->type), event->box,
+                   event->type <= EVENT_SIG_LABEL ? Rsc2_SignalIDToAssignedString(event->signal) : "");
+        else
+            printf("%s host %s\n", event_type_name(event->type), run->fleet->hostNames[event->host]);
+    }
+    if(run->workUs > 0){
+        until = now_us() + run->workUs;
+        while(now_us() < until)
+            YieldProcessor();
+    }
+}
+
+static void print_counts(EventQueue *queue, double seconds){
+    EventCounts counts;
+
+    event_queue_counts(queue, &counts);
+    printf("%6.1f s  received %lld  processed %lld  dropped %lld  depth %d (max %d)  "
+           "latency p50 <%lld us  p99 <%lld us  max %lld us\n", seconds, counts.received,
+           counts.processed, counts.dropped, counts.depth, counts.maxDepth, counts.latencyP50Us,
+           counts.latencyP99Us, counts.latencyMaxUs);
+}
+
+static DWORD WINAPI producer_thread(LPVOID arg){
+    EventsProducer *producer = arg;
+    Event event;
+    int i;
+
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_SIG_STATE;
+    for(i = 0; i < producer->count; i++){
+        if(producer->intervalUs > 0){
+            long long due = producer->start + (long long)(i * producer->intervalUs);
+
+            while(now_us() < due)
+                Sleep(1);
+        }
+        event.box = (producer->first + i) % producer->numBoxes;
+        event.signal = RSC2_ID_LED_STATUS_GREEN;
+        event.receivedAt = now_us();
+        if(event_queue_post(producer->queue, &event) == 0)
+            producer->posted++;
+    }
+    return 0;
+}
+
+/* counts only the bench's events, live ones from the fleet may arrive meanwhile */
+static int bench(EventQueue *queue, EventsRun *run, int numBoxes, int count, int numProducers, int rate){
+    EventsProducer *producers = NULL;
+    HANDLE *threads = NULL;
+    long long start, posted = 0, received = 0, processed, dropped;
+    double seconds;
+    int i;
+
+    if(numProducers < 1){
+        printf("--producers must be 1 or more\n");
+        return -1;
+    }
+    producers = calloc(numProducers, sizeof(EventsProducer));
+    threads = calloc(numProducers, sizeof(HANDLE));
+    InterlockedExchange64(&run->benchHandled, 0);
+    start = now_us();
+    for(i = 0; i < numProducers; i++){
+        producers[i].queue = queue;
+        producers[i].numBoxes = numBoxes;
+        producers[i].count = count / numProducers;
+        producers[i].first = i * producers[i].count;
+        producers[i].intervalUs = rate > 0 ? 1000000.0 * numProducers / rate : 0;
+        producers[i].start = start;
+        threads[i] = CreateThread(NULL, 0, producer_thread, &producers[i], 0, NULL);
+    }
+    for(i = 0; i < numProducers; i++){
+        if(threads[i] == NULL)
+            continue;
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+        received += producers[i].count;
+        posted += producers[i].posted;
+    }
+    /* until the shards have handled every event posted */
+    while(run->benchHandled < posted)
+        Sleep(1);
+    seconds = (now_us() - start) / 1000000.0;
+    print_counts(queue, seconds);
+    processed = run->benchHandled;
+    dropped = received - posted;
+    printf("processed %lld of %lld events in %.3f s, %.0f events/s, %.2f%% dropped\n", processed, received,
+           seconds, processed / seconds, received ? 100.0 * dropped / received : 0.0);
+    if(dropped == 0)
+        printf("sustained %.0f events/s without drops\n", processed / seconds);
+    else if(rate > 0)
+        printf("the shards do not sustain %d events/s, lower --rate\n", rate);
+    else
+        printf("not a sustained rate, the shards fell behind; pace with --rate to find one\n");
+    free(producers);
+    free(threads);
+    return 0;
+}
+
+int events_main(int argc, char *argv[]){
+    int numShards = opt_int(argc, argv, "--shards", 4);
+    int slots = opt_int(argc, argv, "--slots", 4096);
+    int seconds = opt_int(argc, argv, "--seconds", 10);
+    int benchCount = opt_int(argc, argv, "--bench", 0);
+    EventQueue *queue = NULL;
+    EventsRun run;
+    Fleet fleet;
+    long long start;
+    int result = 0;
+
+    memset(&run, 0, sizeof(run));
+    run.fleet = &fleet;
+    run.verbose = opt_flag(argc, argv, "--verbose");
+    run.workUs = opt_int(argc, argv, "--work-us", 0);
+    if(fleet_open(&fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    queue = event_queue_open(&fleet, numShards, slots, handle_event, &run);
+    if(queue == NULL){
+        fleet_close(&fleet);
+        return -1;
+    }
+
+    if(benchCount > 0 && fleet.numBoxes == 0){
+        printf("no boxes to post events for\n");
+        result = -1;
+    }else if(benchCount > 0){
+        result = bench(queue, &run, fleet.numBoxes, benchCount, opt_int(argc, argv, "--producers", 8),
+                       opt_int(argc, argv, "--rate", 0));
+    }else{
+        start = now_us();
+        while(now_us() - start < (long long)seconds * 1000000){
+            Sleep(REPORT_MS);
+            print_counts(queue, (now_us() - start) / 1000000.0);
+        }
+    }
+    event_queue_close(queue);
+    fleet_close(&fleet);
+    return result;
+}
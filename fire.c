@@ -0,0 +1,260 @@
+#include "common.h"
+#include "commands.h"
+#include "latprofile.h"
+
+/**************************************************
+* rsctool fire --action ac-on|ac-off|power|reset
+*              [--hosts h1,h2] [--match text]
+*              [--lead-ms ms] [--spin-ms ms] [--hold-ms ms]
+*              [--profile file] [--verbose]
+* does one action on many boxes at the same moment,
+* e.g. ac on for a cluster cold boot. every box gets
+* its own thread; signal handles are resolved and the
+* connections used once before. the threads meet at a
+* barrier, get a common deadline --lead-ms (500) ahead,
+* sleep until --spin-ms (20) before it, spin to it and
+* fire. the report shows how far each box's first
+* write was from the deadline (skew) and when the
+* action completed. --match picks the boxes whose
+* description contains the text.
+* --profile takes the latency profile written by
+* rsctool calibrate (latprofile.h): each box starts
+* its write its lead time early (--lead-ms must be
+* longer than the largest), so the lines rather
+* than the calls meet the deadline, and the skew is
+* that of the expected line change. the lead is that
+* of one aux a write; ac-on and ac-off write both ac
+* ports in sequence, so the lead aligns the first
+* port and the second one follows a call later.
+**************************************************/
+
+#define DESC_LEN        64
+#define STACK_SIZE      65536
+#define SPIN_YIELD      64          /* spins between yields, threads may outnumber cores */
+
+enum
+{
+    ACTION_AC_ON,
+    ACTION_AC_OFF,
+    ACTION_POWER,
+    ACTION_RESET
+};
+
+typedef struct
+{
+    Rsc2_Box *box;
+    char description[DESC_LEN];
+    Rsc2_Signal *signals[2];        /* written at the deadline, in order */
+    int numSignals;
+    long long leadUs;               /* from the profile, 0 without one */
+    long long issuedAt;             /* first write started */
+    long long doneAt;               /* action completed */
+    Rsc2_Result result;
+} FireBox;
+
+typedef struct
+{
+    int action;
+    int holdMs;
+    long long spinUs;
+    FireBox *boxes;
+    int numBoxes;
+    volatile LONG ready;
+    volatile LONGLONG deadline;     /* 0 until every thread is ready */
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE go;
+} Fire;
+
+static Fire fire;
+
+/* sleeps most of the way, spins the rest */
+static void wait_until(long long deadline){
+    long long now;
+    int spins = 0;
+
+    while((now = now_us()) < deadline - fire.spinUs)
+        Sleep((DWORD)((deadline - fire.spinUs - now) / 2000 + 1));
+    while(now_us() < deadline){
+        YieldProcessor();
+        if(++spins % SPIN_YIELD == 0)
+            SwitchToThread();
+    }
+}
+
+static DWORD WINAPI fire_thread(LPVOID arg){
+    FireBox *fb = arg;
+    Rsc2_SignalState state;
+    int i;
+
+    EnterCriticalSection(&fire.lock);
+    InterlockedIncrement(&fire.ready);
+    while(fire.deadline == 0)
+        SleepConditionVariableCS(&fire.go, &fire.lock, INFINITE);
+    LeaveCriticalSection(&fire.lock);
+
+    wait_until(fire.deadline - fb->leadUs);
+    fb->issuedAt = now_us();
+    state = fire.action == ACTION_AC_OFF ? RSC2_AC_OFF : RSC2_SIG_ASSERTED;
+    for(i = 0; i < fb->numSignals && fb->result == RSC2_SUCCESS; i++)
+        fb->result = Rsc2_SetSigAssertionState(fb->signals[i], state);
+    if(fb->result == RSC2_SUCCESS && (fire.action == ACTION_POWER || fire.action == ACTION_RESET)){
+        Sleep(fire.holdMs);
+        fb->result = Rsc2_SetSigAssertionState(fb->signals[0], RSC2_BUTTON_RELEASED);
+    }
+    fb->doneAt = now_us();
+    return 0;
+}
+
+/* resolves the handles and touches the box once so the deadline
+ * does not pay for the first use of a connection */
+static void prepare_box(int index, void *ctx){
+    FireBox *fb = &fire.boxes[index];
+
+    (void)ctx;
+    if(fire.action == ACTION_AC_ON || fire.action == ACTION_AC_OFF){
+        fb->signals[0] = Rsc2_GetSignal(fb->box, RSC2_ID_AC_1);
+        fb->signals[1] = Rsc2_GetSignal(fb->box, RSC2_ID_AC_2);
+        fb->numSignals = 2;
+    }else{
+        fb->signals[0] = Rsc2_GetSignal(fb->box, fire.action == ACTION_POWER ? RSC2_ID_FPBUT_PWR : RSC2_ID_FPBUT_RESET);
+        fb->numSignals = 1;
+    }
+    if(fb->signals[0] == NULL || fb->signals[fb->numSignals - 1] == NULL){
+        fb->result = RSC2_ERR_INVALID_OBJ_REF;
+        return;
+    }
+    Rsc2_GetSigAssertionState(fb->signals[0]);
+}
+
+static int compare_ll(const void *a, const void *b){
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void print_distribution(const char *what, long long *values, int count){
+    qsort(values, count, sizeof(long long), compare_ll);
+    printf("%-22s min %lld  p50 %lld  p90 %lld  p99 %lld  max %lld  (spread %lld)\n", what,
+           values[0], values[count / 2], values[count * 9 / 10], values[count * 99 / 100],
+           values[count - 1], values[count - 1] - values[0]);
+}
+
+int fire_main(int argc, char *argv[]){
+    const char *action = opt_str(argc, argv, "--action", NULL);
+    const char *match = opt_str(argc, argv, "--match", NULL);
+    int leadMs = opt_int(argc, argv, "--lead-ms", 500);
+    const char *profilePath = opt_str(argc, argv, "--profile", NULL);
+    LatencyProfile *profile = NULL;
+    const LatencyEntry *entry = NULL;
+    int verbose = opt_flag(argc, argv, "--verbose");
+    long long *issued = NULL, *done = NULL;
+    HANDLE *threads = NULL;
+    Fleet fleet;
+    long long maxLeadUs = 0;
+    int failed = 0, n = 0, profiled = 0;
+    int i;
+
+    memset(&fire, 0, sizeof(fire));
+    if(action != NULL && strcmp(action, "ac-on") == 0){
+        fire.action = ACTION_AC_ON;
+    }else if(action != NULL && strcmp(action, "ac-off") == 0){
+        fire.action = ACTION_AC_OFF;
+    }else if(action != NULL && strcmp(action, "power") == 0){
+        fire.action = ACTION_POWER;
+    }else if(action != NULL && strcmp(action, "reset") == 0){
+        fire.action = ACTION_RESET;
+    }else{
+        printf("--action must be ac-on, ac-off, power or reset\n");
+        return -1;
+    }
+    fire.holdMs = opt_int(argc, argv, "--hold-ms", 200);
+    fire.spinUs = (long long)opt_int(argc, argv, "--spin-ms", 20) * 1000;
+    InitializeCriticalSection(&fire.lock);
+    InitializeConditionVariable(&fire.go);
+
+    if(profilePath != NULL && (profile = latency_profile_load(profilePath)) == NULL)
+        return -1;
+    if(fleet_open(&fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    fire.boxes = calloc(fleet.numBoxes + 1, sizeof(FireBox));
+    for(i = 0; i < fleet.numBoxes; i++){
+        FireBox *fb = &fire.boxes[fire.numBoxes];
+
+        fb->box = fleet.boxes[i].box;
+        Rsc2_GetDescription(fb->box, fb->description, DESC_LEN);
+        if(match != NULL && strstr(fb->description, match) == NULL)
+            continue;
+        if(profile != NULL && (entry = latency_profile_find(profile, fb->description)) != NULL){
+            fb->leadUs = latency_lead_us(entry);
+            if(fb->leadUs > maxLeadUs)
+                maxLeadUs = fb->leadUs;
+            profiled++;
+        }
+        fire.numBoxes++;
+    }
+    if(profile != NULL){
+        printf("%d of %d boxes have a latency profile\n", profiled, fire.numBoxes);
+        latency_profile_close(profile);
+    }
+    /* a box would have to start before the deadline is even set */
+    if(maxLeadUs >= (long long)leadMs * 1000){
+        printf("a box needs a lead of %lld us, --lead-ms must be at least %lld\n", maxLeadUs, maxLeadUs / 1000 + 1);
+        return -1;
+    }
+    if(fire.numBoxes == 0){
+        printf("no box matches\n");
+        return -1;
+    }
+    parallel_for(fire.numBoxes, 32, prepare_box, NULL);
+
+    threads = calloc(fire.numBoxes, sizeof(HANDLE));
+    for(i = 0; i < fire.numBoxes; i++){
+        if(fire.boxes[i].result != RSC2_SUCCESS)
+            continue;
+        threads[i] = CreateThread(NULL, STACK_SIZE, fire_thread, &fire.boxes[i], 0, NULL);
+        if(threads[i] == NULL){
+            printf("unable to start thread %d, fire on fewer boxes with --match\n", i);
+            return -1;
+        }
+        n++;
+    }
+    while(fire.ready < n)
+        Sleep(1);
+    EnterCriticalSection(&fire.lock);
+    fire.deadline = now_us() + (long long)leadMs * 1000;
+    WakeAllConditionVariable(&fire.go);
+    LeaveCriticalSection(&fire.lock);
+    printf("%d boxes ready, firing %s in %d ms\n", n, action, leadMs);
+    for(i = 0; i < fire.numBoxes; i++){
+        if(threads[i] != NULL){
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+
+    issued = calloc(fire.numBoxes, sizeof(long long));
+    done = calloc(fire.numBoxes, sizeof(long long));
+    n = 0;
+    for(i = 0; i < fire.numBoxes; i++){
+        FireBox *fb = &fire.boxes[i];
+
+        if(verbose)
+            printf("%-24s skew %6lld us  done %8lld us  %s\n", fb->description,
+                   fb->issuedAt + fb->leadUs - fire.deadline, fb->doneAt - fire.deadline,
+                   Rsc2_ResultCodeToString(fb->result));
+        if(fb->result != RSC2_SUCCESS){
+            failed++;
+            continue;
+        }
+        issued[n] = fb->issuedAt + fb->leadUs - fire.deadline;
+        done[n] = fb->doneAt - fire.deadline;
+        n++;
+    }
+    if(n > 0){
+        print_distribution("skew (us)", issued, n);
+        print_distribution("completed after (us)", done, n);
+    }
+    printf("%d boxes fired, %d failed\n", n, failed);
+    fleet_close(&fleet);
+    return failed ? -1 : 0;
+}
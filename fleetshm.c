@@ -0,0 +1,107 @@
+#include "fleetshm.h"
+
+/* the state has to fit behind the sequence number */
+typedef char fleet_shm_box_fits[sizeof(FleetShmBox) + 8 <= FLEET_SHM_RECORD_SIZE ? 1 : -1];
+typedef char fleet_shm_header_fits[sizeof(FleetShmHeader) <= FLEET_SHM_CACHE_LINE ? 1 : -1];
+
+/* a write copies a few hundred bytes, a record that stays odd or keeps
+ * changing for this many tries belongs to a writer that died or hangs */
+#define READ_TRIES      100000
+
+static int map(FleetShm *shm, DWORD access){
+    shm->view = MapViewOfFile(shm->mapping, access, 0, 0, 0);
+    if(shm->view == NULL){
+        CloseHandle(shm->mapping);
+        shm->mapping = NULL;
+        return -1;
+    }
+    shm->header = (FleetShmHeader *)shm->view;
+    shm->records = (FleetShmRecord *)(shm->view + FLEET_SHM_CACHE_LINE);
+    return 0;
+}
+
+int fleet_shm_create(FleetShm *shm, const char *name, int maxBoxes){
+    DWORD size = FLEET_SHM_CACHE_LINE + (DWORD)maxBoxes * FLEET_SHM_RECORD_SIZE;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+    if(shm->mapping == NULL){
+        printf("unable to create shared memory %s (%lu)\n", name, (unsigned long)GetLastError());
+        return -1;
+    }
+    /* a second publisher would write the same records without the seqlock */
+    if(GetLastError() == ERROR_ALREADY_EXISTS){
+        printf("shared memory %s is in use by another publisher\n", name);
+        CloseHandle(shm->mapping);
+        shm->mapping = NULL;
+        return -1;
+    }
+    if(map(shm, FILE_MAP_ALL_ACCESS) != 0){
+        printf("unable to map shared memory %s\n", name);
+        return -1;
+    }
+    memset(shm->view, 0, size);
+    shm->header->version = FLEET_SHM_VERSION;
+    shm->header->recordSize = FLEET_SHM_RECORD_SIZE;
+    shm->header->maxBoxes = maxBoxes;
+    shm->header->publisherPid = (LONG)GetCurrentProcessId();
+    /* readers check the magic last */
+    MemoryBarrier();
+    shm->header->magic = FLEET_SHM_MAGIC;
+    return 0;
+}
+
+void fleet_shm_write(FleetShm *shm, int index, const FleetShmBox *box){
+    FleetShmRecord *record = &shm->records[index];
+
+    record->r.seq++;
+    MemoryBarrier();
+    record->r.box = *box;
+    record->r.updates++;
+    MemoryBarrier();
+    record->r.seq++;
+}
+
+int fleet_shm_open(FleetShm *shm, const char *name){
+    memset(shm, 0, sizeof(*shm));
+    shm->mapping = OpenFileMapping(FILE_MAP_READ, FALSE, name);
+    if(shm->mapping == NULL || map(shm, FILE_MAP_READ) != 0)
+        return -1;
+    if(shm->header->magic != FLEET_SHM_MAGIC || shm->header->version != FLEET_SHM_VERSION
+    || shm->header->recordSize != FLEET_SHM_RECORD_SIZE){
+        fleet_shm_close(shm);
+        return -1;
+    }
+    return 0;
+}
+
+int fleet_shm_read(const FleetShm *shm, int index, FleetShmBox *box){
+    const FleetShmRecord *record = NULL;
+    LONG seq;
+    int tries;
+
+    if(index < 0 || index >= shm->header->numBoxes)
+        return -1;
+    record = &shm->records[index];
+    for(tries = 0; tries < READ_TRIES; tries++){
+        seq = record->r.seq;
+        if(seq & 1){
+            YieldProcessor();
+            continue;
+        }
+        MemoryBarrier();
+        *box = record->r.box;
+        MemoryBarrier();
+        if(record->r.seq == seq)
+            return 0;
+    }
+    return -1;
+}
+
+void fleet_shm_close(FleetShm *shm){
+    if(shm->view != NULL)
+        UnmapViewOfFile(shm->view);
+    if(shm->mapping != NULL)
+        CloseHandle(shm->mapping);
+    memset(shm, 0, sizeof(*shm));
+}
@@ -0,0 +1,100 @@
+#ifndef FLEETSHM_H
+#define FLEETSHM_H
+
+#include "common.h"
+
+/**************************************************
+* shared memory fleet state table
+* one process (rsctool publish) writes the state of
+* every box into a named file mapping, any local
+* process maps it read only and reads from it with
+* plain memory accesses, without rsc2 sessions,
+* system calls or round trips.
+* layout: one cache line of FleetShmHeader, then
+* maxBoxes records of FLEET_SHM_RECORD_SIZE bytes.
+* each record starts with a sequence number that is
+* odd while the writer changes it (seqlock); readers
+* copy the record and retry when the number was odd
+* or changed meanwhile, for a bounded number of
+* tries. there is a single writer, a second create
+* of the same name fails. the writer bumps the
+* heartbeat every intervalMs, a heartbeat that stops
+* moving means the table is stale.
+**************************************************/
+
+#define FLEET_SHM_NAME          "Local\\rsctool_fleet_state"
+#define FLEET_SHM_MAGIC         0x32435352      /* "RSC2" */
+#define FLEET_SHM_VERSION       1
+#define FLEET_SHM_CACHE_LINE    64
+#define FLEET_SHM_RECORD_SIZE   (4 * FLEET_SHM_CACHE_LINE)
+#define FLEET_SHM_SIGNALS       NUM_SIGNALS
+#define FLEET_SHM_TEXT_LEN      64
+#define FLEET_SHM_UNKNOWN       255             /* a signal whose read failed */
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned int maxBoxes;
+    volatile LONG numBoxes;
+    volatile LONG publisherPid;
+    volatile LONG heartbeat;            /* bumped by every publish pass */
+    volatile LONG intervalMs;           /* time between passes */
+} FleetShmHeader;
+
+/* the state of one box as the readers get it */
+typedef struct
+{
+    int hostIndex;
+    int status;                         /* Rsc2_BoxStatus */
+    int usbMux;                         /* Rsc2_UsbMuxState */
+    int pwrCycleResult;                 /* Rsc2_Result of reading the fields below */
+    unsigned char signals[FLEET_SHM_SIGNALS];  /* Rsc2_SignalState by Rsc2_SignalID, or FLEET_SHM_UNKNOWN */
+    unsigned char pwrCycleType;
+    unsigned char pwrCycleInProgress;
+    unsigned char pwrCyclePhaseError;
+    unsigned char pwrCycleTimedOut;     /* waiting for continue timed out */
+    unsigned short pwrCycleNumCycles;
+    unsigned short pwrCycleContinueWaitSecs;
+    unsigned short pwrCycleOffTimeMs;
+    char host[FLEET_SHM_TEXT_LEN];
+    char description[FLEET_SHM_TEXT_LEN];
+    char lockHolder[FLEET_SHM_TEXT_LEN];
+} FleetShmBox;
+
+typedef union
+{
+    struct
+    {
+        volatile LONG seq;
+        LONG updates;                   /* number of writes, for readers that poll */
+        FleetShmBox box;
+    } r;
+    char bytes[FLEET_SHM_RECORD_SIZE];
+} FleetShmRecord;
+
+typedef struct
+{
+    HANDLE mapping;
+    char *view;
+    FleetShmHeader *header;
+    FleetShmRecord *records;
+} FleetShm;
+
+/* writer: creates the mapping for up to maxBoxes boxes, -1 when
+ * another publisher already has one under that name */
+int fleet_shm_create(FleetShm *shm, const char *name, int maxBoxes);
+void fleet_shm_write(FleetShm *shm, int index, const FleetShmBox *box);
+
+/* reader: maps an existing table read only. -1 when there is none
+ * or it has another layout version */
+int fleet_shm_open(FleetShm *shm, const char *name);
+
+/* consistent copy of one record, returns -1 for a bad index or a
+ * record that stays in the middle of a write (the writer died) */
+int fleet_shm_read(const FleetShm *shm, int index, FleetShmBox *box);
+
+void fleet_shm_close(FleetShm *shm);
+
+#endif /* FLEETSHM_H */
@@ -0,0 +1,558 @@
+#include <winsock2.h>
+#include <stdarg.h>
+#include "common.h"
+#include "commands.h"
+#include "statecache.h"
+
+/**************************************************
+* rsctool gateway [--hosts h1,h2] [--port n]
+*                 [--ttl-ms ms] [--threads n]
+*                 [--max-staleness ms] [--duration sec]
+* serves box and signal state over http/json on
+* localhost so that many ci jobs and dashboards can
+* share one set of connections to the rsc2 hosts:
+*   GET  /boxes                   fleet inventory
+*   GET  /box/<n>/status          online status
+*   GET  /box/<n>/signal/<id>     one signal, e.g. AC_1
+*   GET  /box/<n>/signals         all signals
+*   POST /batch                   writes, see below
+*   GET  /stats                   request/cache counters
+* reads of the same box/signal that arrive while one
+* is in flight wait for it and take its result instead
+* of asking the host again, results are then served
+* for --ttl-ms. a failed read is not cached, the
+* client gets an error (502 for single reads). with
+* --max-staleness reads come from the listener
+* maintained state cache (statecache.c) instead. the
+* batch body is a json array of writes:
+*   [{"box":0,"signal":"AC_1","state":1}, ...]
+* they run in parallel and the response lists the
+* result of each.
+**************************************************/
+
+#define KEY_STATUS      NUM_SIGNALS     /* cache slot of the online status */
+#define NUM_KEYS        (NUM_SIGNALS + 1)
+#define DESC_LEN        64
+#define REQUEST_LEN     65536
+#define QUEUE_LEN       256
+#define MAX_BATCH       4096
+#define IO_TIMEOUT_MS   5000
+
+typedef struct
+{
+    int value;                  /* -1 when the last read failed */
+    long long fetchedAt;        /* 0 while nothing is cached */
+    int fetching;
+    unsigned int generation;    /* bumped by writes, drops fetches started before */
+    unsigned int flights;       /* fetches done, a waiter takes the one it waited on */
+    int landed;                 /* the last fetch was not dropped by a write */
+} CacheEntry;
+
+typedef struct
+{
+    char *data;
+    int len;
+    int size;
+} Out;
+
+typedef struct
+{
+    int box;
+    Rsc2_SignalID sigId;
+    int state;
+    Rsc2_Result result;
+} BatchWrite;
+
+typedef struct
+{
+    Fleet fleet;
+    char (*descriptions)[DESC_LEN];
+    Rsc2_Signal *(*signals)[NUM_SIGNALS];  /* resolved once, per box */
+    CacheEntry *cache;          /* numBoxes * NUM_KEYS */
+    CRITICAL_SECTION cacheLock;
+    CONDITION_VARIABLE fetched;
+    long long ttlUs;
+    StateCache *stateCache;     /* NULL unless --max-staleness */
+    int maxStalenessMs;
+    SOCKET queue[QUEUE_LEN];
+    int queueHead;
+    int queueCount;
+    CRITICAL_SECTION queueLock;
+    CONDITION_VARIABLE queued;
+    volatile LONG requests;
+    volatile LONG reads;
+    volatile LONG hits;
+    volatile LONG coalesced;
+    volatile LONG fetches;
+    volatile LONG writes;
+    volatile LONG batches;
+} Gateway;
+
+static Gateway gw;
+
+static void out_printf(Out *out, const char *format, ...){
+    va_list args;
+    int n;
+
+    for(;;){
+        va_start(args, format);
+        n = vsnprintf(out->data + out->len, out->size - out->len, format, args);
+        va_end(args);
+        if(n >= 0 && n < out->size - out->len)
+            break;
+        out->size = out->size * 2 + (n > 0 ? n : 0);
+        out->data = realloc(out->data, out->size);
+    }
+    out->len += n;
+}
+
+static const char *short_sig_name(Rsc2_SignalID id){
+    const char *name = Rsc2_SignalIDToAssignedString(id);
+
+    return strncmp(name, "RSC2_ID_", 8) == 0 ? name + 8 : name;
+}
+
+static int parse_sig_id(const char *text, int len, Rsc2_SignalID *id){
+    char name[64];
+
+    if(len <= 0 || len > 40)
+        return -1;
+    sprintf(name, "%.*s", len, text);
+    if(Rsc2_StringToSignalID(name, id) == 0)
+        return 0;
+    sprintf(name, "RSC2_ID_%.*s", len, text);
+    return Rsc2_StringToSignalID(name, id);
+}
+
+/* a signal handle, resolved again only while the box could not be reached */
+static Rsc2_Signal *box_signal(int box, Rsc2_SignalID id){
+    Rsc2_Signal *sig = gw.signals[box][id];
+
+    if(sig == NULL){
+        sig = Rsc2_GetSignal(gw.fleet.boxes[box].box, id);
+        gw.signals[box][id] = sig;
+    }
+    return sig;
+}
+
+/* the state or status, -1 when the read failed */
+static int fetch(int box, int key){
+    Rsc2_Signal *sig = NULL;
+    Rsc2_BoxStatus status;
+
+    InterlockedIncrement(&gw.fetches);
+    if(key == KEY_STATUS){
+        status = Rsc2_GetOnlineStatus(gw.fleet.boxes[box].box);
+        return status == RSC2_STAT_UNKNOWN ? -1 : (int)status;
+    }
+    sig = box_signal(box, (Rsc2_SignalID)key);
+    return sig != NULL ? (int)Rsc2_GetSigAssertionState(sig) : -1;
+}
+
+/* single flight read through the ttl cache, -1 when the read failed */
+static int cached_read(int box, int key){
+    CacheEntry *entry = &gw.cache[box * NUM_KEYS + key];
+    unsigned int generation, flight;
+    int value;
+
+    InterlockedIncrement(&gw.reads);
+    if(gw.stateCache != NULL){
+        if(key == KEY_STATUS){
+            value = state_cache_status(gw.stateCache, box, gw.maxStalenessMs);
+            return value == RSC2_STAT_UNKNOWN ? -1 : value;
+        }
+        return (int)state_cache_signal(gw.stateCache, box, (Rsc2_SignalID)key, gw.maxStalenessMs);
+    }
+    EnterCriticalSection(&gw.cacheLock);
+    for(;;){
+        if(entry->fetchedAt != 0 && now_us() - entry->fetchedAt < gw.ttlUs){
+            value = entry->value;
+            LeaveCriticalSection(&gw.cacheLock);
+            InterlockedIncrement(&gw.hits);
+            return value;
+        }
+        if(!entry->fetching)
+            break;
+        /* the flight's result, even when the ttl has run out meanwhile */
+        flight = entry->flights;
+        while(entry->flights == flight)
+            SleepConditionVariableCS(&gw.fetched, &gw.cacheLock, INFINITE);
+        if(entry->landed){
+            value = entry->value;
+            LeaveCriticalSection(&gw.cacheLock);
+            InterlockedIncrement(&gw.coalesced);
+            return value;
+        }
+    }
+    entry->fetching = 1;
+    generation = entry->generation;
+    LeaveCriticalSection(&gw.cacheLock);
+
+    value = fetch(box, key);
+
+    EnterCriticalSection(&gw.cacheLock);
+    entry->fetching = 0;
+    entry->flights++;
+    entry->landed = entry->generation == generation;
+    if(entry->landed){
+        entry->value = value;
+        entry->fetchedAt = value >= 0 ? now_us() : 0;
+    }
+    WakeAllConditionVariable(&gw.fetched);
+    LeaveCriticalSection(&gw.cacheLock);
+    return value;
+}
+
+static void invalidate(int box, int key){
+    CacheEntry *entry = &gw.cache[box * NUM_KEYS + key];
+
+    EnterCriticalSection(&gw.cacheLock);
+    entry->generation++;
+    entry->fetchedAt = 0;
+    LeaveCriticalSection(&gw.cacheLock);
+}
+
+/* a json string, with the quotes */
+static void out_string(Out *out, const char *text){
+    out_printf(out, "\"");
+    for(; *text != '\0'; text++){
+        if(*text == '"' || *text == '\\')
+            out_printf(out, "\\%c", *text);
+        else if((unsigned char)*text < 0x20)
+            out_printf(out, "\\u%04x", (unsigned char)*text);
+        else
+            out_printf(out, "%c", *text);
+    }
+    out_printf(out, "\"");
+}
+
+/* returns -1 when the read failed, the entry then carries an error */
+static int signal_json(Out *out, int box, Rsc2_SignalID id){
+    int state = cached_read(box, id);
+
+    if(state < 0){
+        out_printf(out, "{\"box\":%d,\"signal\":\"%s\",\"error\":\"read failed\"}", box, short_sig_name(id));
+        return -1;
+    }
+    out_printf(out, "{\"box\":%d,\"signal\":\"%s\",\"state\":%d}", box, short_sig_name(id), state);
+    return 0;
+}
+
+static void write_one(int index, void *ctx){
+    BatchWrite *write = (BatchWrite *)ctx + index;
+    Rsc2_Signal *sig = box_signal(write->box, write->sigId);
+
+    InterlockedIncrement(&gw.writes);
+    write->result = sig != NULL ? Rsc2_SetSigAssertionState(sig, (Rsc2_SignalState)write->state)
+                                : RSC2_ERR_INVALID_OBJ_REF;
+    if(gw.stateCache == NULL)
+        invalidate(write->box, write->sigId);
+}
+
+/* start of the value of "key" in a flat json object ending at "end" */
+static const char *json_field(const char *object, const char *end, const char *key){
+    const char *p = strstr(object, key);
+
+    if(p == NULL || p >= end)
+        return NULL;
+    p += strlen(key);
+    while(p < end && (*p == ' ' || *p == '"' || *p == ':'))
+        p++;
+    return p;
+}
+
+/* parses the batch body. returns the number of writes or -1 */
+static int parse_batch(const char *body, BatchWrite *writes){
+    const char *object = strchr(body, '{');
+    int count = 0;
+
+    while(object != NULL){
+        const char *end = strchr(object, '}');
+        const char *box, *sig, *state;
+
+        if(end == NULL || count == MAX_BATCH)
+            return -1;
+        box = json_field(object, end, "\"box\"");
+        sig = json_field(object, end, "\"signal\"");
+        state = json_field(object, end, "\"state\"");
+        if(box == NULL || sig == NULL || state == NULL)
+            return -1;
+        writes[count].box = atoi(box);
+        writes[count].state = atoi(state);
+        if(writes[count].box < 0 || writes[count].box >= gw.fleet.numBoxes
+        || parse_sig_id(sig, (int)strcspn(sig, "\""), &writes[count].sigId) != 0)
+            return -1;
+        count++;
+        object = strchr(end, '{');
+    }
+    return count;
+}
+
+static void handle_batch(Out *out, const char *body, int *status){
+    BatchWrite *writes = malloc(MAX_BATCH * sizeof(BatchWrite));
+    int count = parse_batch(body, writes);
+    int i;
+
+    InterlockedIncrement(&gw.batches);
+    if(count < 0){
+        *status = 400;
+        out_printf(out, "{\"error\":\"expected [{\\\"box\\\":n,\\\"signal\\\":\\\"id\\\",\\\"state\\\":n}, ...]\"}");
+    }else{
+        parallel_for(count, 32, write_one, writes);
+        out_printf(out, "[");
+        for(i = 0; i < count; i++)
+            out_printf(out, "%s{\"box\":%d,\"signal\":\"%s\",\"result\":\"%s\"}", i ? "," : "",
+                       writes[i].box, short_sig_name(writes[i].sigId), Rsc2_ResultCodeToString(writes[i].result));
+        out_printf(out, "]");
+    }
+    free(writes);
+}
+
+/* fills "out" with the json response for a request, returns the http status */
+static int route(const char *method, const char *path, const char *body, Out *out){
+    int status = 200;
+    int box = -1, n = 0, i;
+    Rsc2_SignalID id;
+
+    if(strcmp(method, "POST") == 0){
+        if(strcmp(path, "/batch") != 0)
+            return 404;
+        handle_batch(out, body, &status);
+        return status;
+    }
+    if(strcmp(method, "GET") != 0)
+        return 405;
+
+    if(strcmp(path, "/boxes") == 0){
+        out_printf(out, "[");
+        for(i = 0; i < gw.fleet.numBoxes; i++){
+            out_printf(out, "%s{\"box\":%d,\"host\":", i ? "," : "", i);
+            out_string(out, gw.fleet.hostNames[gw.fleet.boxes[i].hostIndex]);
+            out_printf(out, ",\"description\":");
+            out_string(out, gw.descriptions[i]);
+            out_printf(out, "}");
+        }
+        out_printf(out, "]");
+    }else if(strcmp(path, "/stats") == 0){
+        long hits = 0, liveReads = 0;
+
+        if(gw.stateCache != NULL)
+            state_cache_counts(gw.stateCache, &hits, &liveReads);
+        out_printf(out, "{\"requests\":%ld,\"reads\":%ld,\"cache_hits\":%ld,\"coalesced\":%ld,"
+                   "\"remote_reads\":%ld,\"listener_cache_hits\":%ld,\"listener_cache_live_reads\":%ld,"
+                   "\"batches\":%ld,\"writes\":%ld}", gw.requests, gw.reads, gw.hits, gw.coalesced,
+                   gw.fetches, hits, liveReads, gw.batches, gw.writes);
+    }else if(sscanf(path, "/box/%d%n", &box, &n) == 1 && box >= 0 && box < gw.fleet.numBoxes){
+        path += n;
+        if(strcmp(path, "/status") == 0){
+            n = cached_read(box, KEY_STATUS);
+            if(n < 0){
+                out_printf(out, "{\"box\":%d,\"error\":\"read failed\"}", box);
+                return 502;
+            }
+            out_printf(out, "{\"box\":%d,\"status\":\"%s\"}", box, Rsc2_BoxStatusToString((Rsc2_BoxStatus)n));
+        }else if(strcmp(path, "/signals") == 0){
+            out_printf(out, "[");
+            for(i = 0; i < NUM_SIGNALS; i++){
+                out_printf(out, i ? "," : "");
+                signal_json(out, box, (Rsc2_SignalID)i);
+            }
+            out_printf(out, "]");
+        }else if(strncmp(path, "/signal/", 8) == 0 && parse_sig_id(path + 8, (int)strlen(path + 8), &id) == 0){
+            if(signal_json(out, box, id) != 0)
+                return 502;
+        }else{
+            return 404;
+        }
+    }else{
+        return 404;
+    }
+    return status;
+}
+
+/* receives until the headers and content-length bytes of body are in */
+static int read_request(SOCKET s, char *buf, char **body){
+    int len = 0, need = -1;
+
+    for(;;){
+        fd_set readable;
+        struct timeval timeout = { IO_TIMEOUT_MS / 1000, 0 };
+        int n;
+
+        FD_ZERO(&readable);
+        FD_SET(s, &readable);
+        if(select((int)s + 1, &readable, NULL, NULL, &timeout) <= 0)
+            return -1;
+        n = recv(s, buf + len, REQUEST_LEN - 1 - len, 0);
+        if(n <= 0)
+            return -1;
+        len += n;
+        buf[len] = '\0';
+        if(need < 0){
+            char *end = strstr(buf, "\r\n\r\n");
+            const char *length = NULL;
+
+            if(end == NULL){
+                if(len == REQUEST_LEN - 1)
+                    return -1;
+                continue;
+            }
+            *body = end + 4;
+            length = strstr(buf, "Content-Length:");
+            if(length == NULL)
+                length = strstr(buf, "content-length:");
+            need = (int)(*body - buf) + (length != NULL && length < end ? atoi(length + 15) : 0);
+            if(need >= REQUEST_LEN)
+                return -1;
+        }
+        if(len >= need)
+            return 0;
+    }
+}
+
+static void serve(SOCKET s){
+    char *buf = malloc(REQUEST_LEN);
+    char method[8], path[256];
+    char *body = NULL;
+    Out out = { NULL, 0, 0 };
+    char header[160];
+    int status;
+
+    out.size = 4096;
+    out.data = malloc(out.size);
+    out.data[0] = '\0';
+    InterlockedIncrement(&gw.requests);
+    if(read_request(s, buf, &body) != 0)
+        status = 400;
+    else if(sscanf(buf, "%7s %255s", method, path) != 2)
+        status = 400;
+    else
+        status = route(method, path, body, &out);
+    if(status != 200 && out.len == 0)
+        out_printf(&out, "{\"error\":%d}", status);
+
+    sprintf(header, "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+            "Connection: close\r\n\r\n", status, status == 200 ? "OK" : "Error", out.len + 1);
+    out_printf(&out, "\n");
+    send(s, header, (int)strlen(header), 0);
+    send(s, out.data, out.len, 0);
+    shutdown(s, SD_SEND);
+    closesocket(s);
+    free(out.data);
+    free(buf);
+}
+
+static DWORD WINAPI worker(LPVOID arg){
+    (void)arg;
+    for(;;){
+        SOCKET s;
+
+        EnterCriticalSection(&gw.queueLock);
+        while(gw.queueCount == 0)
+            SleepConditionVariableCS(&gw.queued, &gw.queueLock, INFINITE);
+        s = gw.queue[gw.queueHead];
+        gw.queueHead = (gw.queueHead + 1) % QUEUE_LEN;
+        gw.queueCount--;
+        LeaveCriticalSection(&gw.queueLock);
+        serve(s);
+    }
+    return 0;
+}
+
+static void read_box(int index, void *ctx){
+    int i;
+
+    (void)ctx;
+    Rsc2_GetDescription(gw.fleet.boxes[index].box, gw.descriptions[index], DESC_LEN);
+    for(i = 0; i < NUM_SIGNALS; i++)
+        gw.signals[index][i] = Rsc2_GetSignal(gw.fleet.boxes[index].box, (Rsc2_SignalID)i);
+}
+
+int gateway_main(int argc, char *argv[]){
+    int port = opt_int(argc, argv, "--port", 8080);
+    int threads = opt_int(argc, argv, "--threads", 16);
+    int duration = opt_int(argc, argv, "--duration", 0);
+    long long startedAt;
+    struct sockaddr_in addr;
+    WSADATA wsaData;
+    SOCKET listener;
+    int i;
+
+    memset(&gw, 0, sizeof(gw));
+    gw.ttlUs = (long long)opt_int(argc, argv, "--ttl-ms", 500) * 1000;
+    gw.maxStalenessMs = opt_int(argc, argv, "--max-staleness", -1);
+    InitializeCriticalSection(&gw.cacheLock);
+    InitializeConditionVariable(&gw.fetched);
+    InitializeCriticalSection(&gw.queueLock);
+    InitializeConditionVariable(&gw.queued);
+
+    if(fleet_open(&gw.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    gw.descriptions = calloc(gw.fleet.numBoxes + 1, DESC_LEN);
+    gw.signals = calloc(gw.fleet.numBoxes + 1, sizeof(*gw.signals));
+    gw.cache = calloc((gw.fleet.numBoxes + 1) * NUM_KEYS, sizeof(CacheEntry));
+    parallel_for(gw.fleet.numBoxes, 32, read_box, NULL);
+    if(gw.maxStalenessMs >= 0){
+        gw.stateCache = state_cache_open(&gw.fleet);
+        if(gw.stateCache == NULL)
+            return -1;
+    }
+
+    if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0){
+        printf("unable to start winsock\n");
+        return -1;
+    }
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    i = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&i, sizeof(i));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if(listener == INVALID_SOCKET || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0
+    || listen(listener, 128) != 0){
+        printf("unable to listen on port %d (%d)\n", port, WSAGetLastError());
+        return -1;
+    }
+    for(i = 0; i < threads; i++){
+        HANDLE thread = CreateThread(NULL, 0, worker, NULL, 0, NULL);
+
+        if(thread == NULL){
+            printf("unable to start worker threads\n");
+            return -1;
+        }
+        CloseHandle(thread);
+    }
+    printf("gateway: %d boxes on %d hosts, http://127.0.0.1:%d/, ttl %d ms\n", gw.fleet.numBoxes,
+           gw.fleet.numHosts, port, (int)(gw.ttlUs / 1000));
+
+    startedAt = now_us();
+    while(duration == 0 || now_us() - startedAt < (long long)duration * 1000000){
+        fd_set readable;
+        struct timeval timeout = { 1, 0 };
+        SOCKET s;
+
+        FD_ZERO(&readable);
+        FD_SET(listener, &readable);
+        if(select((int)listener + 1, &readable, NULL, NULL, &timeout) <= 0)
+            continue;
+        s = accept(listener, NULL, NULL);
+        if(s == INVALID_SOCKET)
+            continue;
+        EnterCriticalSection(&gw.queueLock);
+        if(gw.queueCount == QUEUE_LEN){
+            LeaveCriticalSection(&gw.queueLock);
+            closesocket(s);
+            continue;
+        }
+        gw.queue[(gw.queueHead + gw.queueCount) % QUEUE_LEN] = s;
+        gw.queueCount++;
+        WakeConditionVariable(&gw.queued);
+        LeaveCriticalSection(&gw.queueLock);
+    }
+
+    closesocket(listener);
+    printf("requests %ld, reads %ld: %ld cache hits, %ld coalesced, %ld remote; %ld batches, %ld writes\n",
+           gw.requests, gw.reads, gw.hits, gw.coalesced, gw.fetches, gw.batches, gw.writes);
+    return 0;
+}
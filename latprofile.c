@@ -0,0 +1,114 @@
+#include "latprofile.h"
+
+#define LINE_LEN        512
+
+struct LatencyProfile
+{
+    LatencyEntry *entries;      /* sorted by description */
+    int numEntries;
+    int capacity;
+};
+
+static int compare_entries(const void *a, const void *b){
+    return strcmp(((const LatencyEntry *)a)->description, ((const LatencyEntry *)b)->description);
+}
+
+LatencyProfile *latency_profile_load(const char *path){
+    LatencyProfile *profile = calloc(1, sizeof(LatencyProfile));
+    char line[LINE_LEN];
+    int lineNo = 0;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL)
+        return profile;
+    while(fgets(line, LINE_LEN, file) != NULL){
+        LatencyEntry entry;
+        char *fields[6];
+        int i;
+
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+        fields[0] = strtok(line, "\t");
+        for(i = 1; i < 6; i++)
+            fields[i] = strtok(NULL, "\t");
+        if(fields[5] == NULL){
+            printf("%s:%d: invalid profile line\n", path, lineNo);
+            fclose(file);
+            latency_profile_close(profile);
+            return NULL;
+        }
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.description, fields[0], LATENCY_DESC_LEN - 1);
+        entry.samples = atoi(fields[1]);
+        entry.callUs = atoll(fields[2]);
+        entry.lineUs = atoll(fields[3]);
+        entry.lineP99Us = atoll(fields[4]);
+        entry.jitterUs = atoll(fields[5]);
+        latency_profile_set(profile, &entry);
+    }
+    fclose(file);
+    return profile;
+}
+
+void latency_profile_close(LatencyProfile *profile){
+    free(profile->entries);
+    free(profile);
+}
+
+const LatencyEntry *latency_profile_find(LatencyProfile *profile, const char *description){
+    LatencyEntry key;
+
+    if(profile->numEntries == 0)
+        return NULL;
+    strncpy(key.description, description, LATENCY_DESC_LEN - 1);
+    key.description[LATENCY_DESC_LEN - 1] = '\0';
+    return bsearch(&key, profile->entries, profile->numEntries, sizeof(LatencyEntry), compare_entries);
+}
+
+void latency_profile_set(LatencyProfile *profile, const LatencyEntry *entry){
+    LatencyEntry *found = (LatencyEntry *)latency_profile_find(profile, entry->description);
+    int i;
+
+    if(found != NULL){
+        *found = *entry;
+        return;
+    }
+    if(profile->numEntries == profile->capacity){
+        profile->capacity = profile->capacity ? profile->capacity * 2 : 64;
+        profile->entries = realloc(profile->entries, profile->capacity * sizeof(LatencyEntry));
+    }
+    /* keeps the entries sorted */
+    for(i = profile->numEntries; i > 0 && strcmp(profile->entries[i - 1].description, entry->description) > 0; i--)
+        profile->entries[i] = profile->entries[i - 1];
+    profile->entries[i] = *entry;
+    profile->numEntries++;
+}
+
+int latency_profile_write(LatencyProfile *profile, const char *path){
+    FILE *file = fopen(path, "w");
+    int i;
+
+    if(file == NULL){
+        printf("unable to write %s\n", path);
+        return -1;
+    }
+    fprintf(file, "# rsctool latency profile: description, samples, call us, line us, line p99 us, jitter us\n");
+    for(i = 0; i < profile->numEntries; i++){
+        LatencyEntry *entry = &profile->entries[i];
+
+        fprintf(file, "%s\t%d\t%lld\t%lld\t%lld\t%lld\n", entry->description, entry->samples, entry->callUs,
+                entry->lineUs, entry->lineP99Us, entry->jitterUs);
+    }
+    fclose(file);
+    return 0;
+}
+
+long long latency_lead_us(const LatencyEntry *entry){
+    return entry->callUs + entry->lineUs;
+}
+
+int latency_profile_count(LatencyProfile *profile){
+    return profile->numEntries;
+}
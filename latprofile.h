@@ -0,0 +1,53 @@
+#ifndef LATPROFILE_H
+#define LATPROFILE_H
+
+#include "common.h"
+
+/**************************************************
+* on-disk actuation latency profile
+* written by rsctool calibrate: one line per box,
+*   <description>  <samples>  <call us>  <line us>
+*   <line p99 us>  <jitter us>
+* tab separated and sorted by description. "call" is
+* the median time Rsc2_SetSigAssertionState takes,
+* "line" the median time from its return to the line
+* changing, measured on the aux a output looped back
+* to the aux a input; jitter is the standard
+* deviation of "line". commands that act at a given
+* moment start a write the lead time (call + line)
+* early, so the line changes at that moment.
+**************************************************/
+
+#define LATENCY_PATH        "rsctool.lat"
+#define LATENCY_DESC_LEN    64
+
+typedef struct
+{
+    char description[LATENCY_DESC_LEN];
+    int samples;
+    long long callUs;
+    long long lineUs;
+    long long lineP99Us;
+    long long jitterUs;
+} LatencyEntry;
+
+typedef struct LatencyProfile LatencyProfile;
+
+/* an empty profile when "path" does not exist, NULL when it is invalid */
+LatencyProfile *latency_profile_load(const char *path);
+void latency_profile_close(LatencyProfile *profile);
+
+/* the entry of the box with this description, NULL when there is none */
+const LatencyEntry *latency_profile_find(LatencyProfile *profile, const char *description);
+
+/* adds an entry or replaces the one with the same description */
+void latency_profile_set(LatencyProfile *profile, const LatencyEntry *entry);
+
+int latency_profile_write(LatencyProfile *profile, const char *path);
+
+/* from starting a write to the line changing */
+long long latency_lead_us(const LatencyEntry *entry);
+
+int latency_profile_count(LatencyProfile *profile);
+
+#endif /* LATPROFILE_H */
@@ -0,0 +1,180 @@
+#include "leddecode.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BLINK_WINDOW    6           /* newest intervals checked for a regular blink */
+#define JITTER_US       40000       /* slack on top of the regularity ratio */
+
+/* duration of the i-th newest complete interval and the level the led had */
+static int interval(const LedDecoder *led, int i, long long *duration){
+    int newer = (led->head - 1 - i + 2 * LED_HISTORY) % LED_HISTORY;
+    int older = (newer - 1 + LED_HISTORY) % LED_HISTORY;
+
+    *duration = led->edges[newer] - led->edges[older];
+    return led->levels[older];
+}
+
+/* the interval starting at init is partial and does not count */
+static int num_intervals(const LedDecoder *led){
+    return led->count - 1 - led->partial;
+}
+
+static int regular(long long shortest, long long longest){
+    return longest <= shortest * 3 / 2 + JITTER_US;
+}
+
+static int set_state(LedDecoder *led, LedState state, int periodMs, int pulses, long long at){
+    if(state == led->state && pulses == led->pulses
+    && (state != LED_BLINKING || (periodMs * 5 > led->periodMs * 4 && periodMs * 4 < led->periodMs * 5)))
+        return 0;
+    led->state = state;
+    led->periodMs = periodMs;
+    led->pulses = pulses;
+    led->since = at;
+    return 1;
+}
+
+/* bursts of pulses separated by pauses much longer than the pulses and
+ * the gaps inside a burst (a burst of one pulse has no gaps). walks back
+ * from the newest interval; the burst in progress is skipped, one
+ * complete burst is enough, a second one must agree. */
+static int find_pattern(const LedDecoder *led, int *pulses){
+    int n = num_intervals(led);
+    long long shortOff = -1, onMin = -1, onMax = 0, duration;
+    int bursts[2] = {0, 0};
+    int gaps = 0, count = 0;
+    int i;
+
+    for(i = 0; i < n; i++){
+        interval(led, i, &duration);
+        if(shortOff < 0 || duration < shortOff)
+            shortOff = duration;
+    }
+    if(shortOff < 0)
+        return 0;
+
+    for(i = 0; i < n && gaps < 3; i++){
+        if(interval(led, i, &duration)){
+            count++;
+            if(gaps > 0){
+                if(onMin < 0 || duration < onMin)
+                    onMin = duration;
+                if(duration > onMax)
+                    onMax = duration;
+            }
+        }else if(duration > shortOff * 5 / 2 + JITTER_US){
+            if(gaps > 0)
+                bursts[gaps - 1] = count;
+            gaps++;
+            count = 0;
+        }
+    }
+    if(gaps < 2 || bursts[0] == 0 || !regular(onMin, onMax))
+        return 0;
+    if(gaps == 3 && bursts[1] != bursts[0])
+        return 0;
+    *pulses = bursts[0];
+    return 1;
+}
+
+static int find_blink(const LedDecoder *led, int *periodMs){
+    long long onMin = -1, onMax = 0, onSum = 0;
+    long long offMin = -1, offMax = 0, offSum = 0;
+    long long duration;
+    int ons = 0, offs = 0;
+    int i;
+
+    for(i = 0; i < num_intervals(led) && i < BLINK_WINDOW; i++){
+        if(interval(led, i, &duration)){
+            if(onMin < 0 || duration < onMin)
+                onMin = duration;
+            if(duration > onMax)
+                onMax = duration;
+            onSum += duration;
+            ons++;
+        }else{
+            if(offMin < 0 || duration < offMin)
+                offMin = duration;
+            if(duration > offMax)
+                offMax = duration;
+            offSum += duration;
+            offs++;
+        }
+    }
+    if(ons < 2 || offs < 2 || !regular(onMin, onMax) || !regular(offMin, offMax))
+        return 0;
+    *periodMs = (int)((onSum / ons + offSum / offs) / 1000);
+    return 1;
+}
+
+void led_decoder_init(LedDecoder *led, int level, long long now, int steadyMs){
+    memset(led, 0, sizeof(*led));
+    led->level = level ? 1 : 0;
+    led->steadyUs = (long long)steadyMs * 1000;
+    led->state = LED_CHANGING;
+    led->since = now;
+    /* the starting level counts as the oldest transition */
+    led->edges[0] = now;
+    led->levels[0] = (unsigned char)led->level;
+    led->head = 1;
+    led->count = 1;
+    led->partial = 1;
+}
+
+int led_decoder_edge(LedDecoder *led, int level, long long at){
+    int pulses = 0, periodMs = 0;
+
+    level = level ? 1 : 0;
+    if(level == led->level)
+        return 0;
+    led->level = level;
+    /* a full ring overwrites its oldest slot, at first the start */
+    if(led->count == LED_HISTORY)
+        led->partial = 0;
+    led->edges[led->head] = at;
+    led->levels[led->head] = (unsigned char)level;
+    led->head = (led->head + 1) % LED_HISTORY;
+    if(led->count < LED_HISTORY)
+        led->count++;
+
+    if(find_pattern(led, &pulses))
+        return set_state(led, LED_PATTERN, 0, pulses, at);
+    if(find_blink(led, &periodMs))
+        return set_state(led, LED_BLINKING, periodMs, 0, at);
+    /* a blink or pattern holds through one odd transition */
+    if(led->state == LED_BLINKING || led->state == LED_PATTERN)
+        return 0;
+    return set_state(led, LED_CHANGING, 0, 0, at);
+}
+
+int led_decoder_tick(LedDecoder *led, long long now){
+    long long last = led->edges[(led->head - 1 + LED_HISTORY) % LED_HISTORY];
+
+    /* a blink that broke off into a long pause may be a pattern */
+    if(led->state == LED_BLINKING && now - last > (long long)led->periodMs * 1500 + JITTER_US
+    && now - last < led->steadyUs)
+        return set_state(led, LED_CHANGING, 0, 0, now);
+    if(now - last < led->steadyUs)
+        return 0;
+    return set_state(led, led->level ? LED_STEADY_ON : LED_STEADY_OFF, 0, 0, now);
+}
+
+void led_decoder_describe(const LedDecoder *led, char *buf, int size){
+    switch(led->state){
+    case LED_STEADY_OFF:
+        snprintf(buf, size, "steady off");
+        break;
+    case LED_STEADY_ON:
+        snprintf(buf, size, "steady on");
+        break;
+    case LED_BLINKING:
+        snprintf(buf, size, "blinking %d ms", led->periodMs);
+        break;
+    case LED_PATTERN:
+        snprintf(buf, size, "pattern %d pulses", led->pulses);
+        break;
+    default:
+        snprintf(buf, size, "changing");
+        break;
+    }
+}
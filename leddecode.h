@@ -0,0 +1,53 @@
+#ifndef LEDDECODE_H
+#define LEDDECODE_H
+
+/**************************************************
+* streaming led blink decoder
+* fed with the times of led transitions (from
+* sigStateChanged), keeps the last LED_HISTORY of
+* them in a ring buffer and classifies the led as
+* steady, blinking or showing a pulse pattern
+* (n short blinks, long pause, repeated).
+* not thread safe, callers lock around it.
+**************************************************/
+
+#define LED_HISTORY     32
+
+typedef enum
+{
+    LED_CHANGING,       /* not enough transitions to tell yet */
+    LED_STEADY_OFF,
+    LED_STEADY_ON,
+    LED_BLINKING,       /* regular on/off, see periodMs */
+    LED_PATTERN         /* bursts of "pulses" blinks, see pulses */
+} LedState;
+
+typedef struct
+{
+    long long edges[LED_HISTORY];       /* transition times (us), ring buffer */
+    unsigned char levels[LED_HISTORY];  /* level entered at each transition */
+    int head;                           /* next slot to write */
+    int count;
+    int partial;                        /* the oldest slot still holds the start, not an edge */
+    int level;
+    long long steadyUs;                 /* quiet time after which the led is steady */
+    LedState state;
+    int periodMs;
+    int pulses;
+    long long since;                    /* when the current state was entered */
+} LedDecoder;
+
+void led_decoder_init(LedDecoder *led, int level, long long now, int steadyMs);
+
+/* the led changed to "level" at "at" (us). returns 1 when the
+ * classification changed. repeated levels are ignored. */
+int led_decoder_edge(LedDecoder *led, int level, long long at);
+
+/* re-evaluates at "now" without a transition, a led that stopped
+ * changing becomes steady. returns 1 when the classification changed. */
+int led_decoder_tick(LedDecoder *led, long long now);
+
+/* "steady on", "blinking 1000 ms", "pattern 3 pulses", ... */
+void led_decoder_describe(const LedDecoder *led, char *buf, int size);
+
+#endif /* LEDDECODE_H */
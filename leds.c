@@ -0,0 +1,245 @@
+#include "common.h"
+#include "commands.h"
+#include "leddecode.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool leds [--hosts h1,h2] [--boot] [--timeout sec]
+*              [--steady-ms ms] [--post-errors n]
+* decodes the green/amber status leds and the blue id
+* led of every box from sigStateChanged events and
+* reports each box as booted (green steady on) or
+* failed (amber lit at all) as soon as that is known,
+* then keeps decoding the amber pattern.
+* --boot turns the ac ports on and presses the power
+* button of every box first. --post-errors makes n
+* boxes fail post (Standin build only).
+**************************************************/
+
+#define NUM_LEDS        3
+#define DESC_LEN        64
+#define TICK_MS         100
+
+enum
+{
+    VERDICT_PENDING,
+    VERDICT_BOOTED,
+    VERDICT_FAILED
+};
+
+static const Rsc2_SignalID ledIds[NUM_LEDS] = {
+    RSC2_ID_LED_STATUS_GREEN, RSC2_ID_LED_STATUS_AMBER, RSC2_ID_LED_ID_BLUE
+};
+static const char *ledNames[NUM_LEDS] = { "green", "amber", "blue" };
+
+typedef struct LedBox LedBox;
+
+typedef struct
+{
+    LedBox *owner;
+    int index;
+    Rsc2_Signal *sig;
+} LedWatch;
+
+struct LedBox
+{
+    Rsc2_Box *box;
+    char description[DESC_LEN];
+    CRITICAL_SECTION lock;
+    LedDecoder leds[NUM_LEDS];
+    LedWatch watch[NUM_LEDS];
+    int changed[NUM_LEDS];
+    int verdict;
+    long long verdictAt;
+};
+
+typedef struct
+{
+    Fleet fleet;
+    LedBox *boxes;
+    int steadyMs;
+    long long startedAt;
+    Rsc2_BoxListener listener;
+} Leds;
+
+static Leds leds;
+
+/* runs on the library's event thread. the state is inferred from the
+ * transition itself so no remote read is needed here; steady leds are
+ * re-read once from the main loop in case an event was lost. */
+static void on_sig_state_changed(Rsc2_Signal *sig){
+    LedWatch *watch = Rsc2_GetObjectClientData((Rsc2_Object *)sig);
+    long long at = now_us();
+    LedBox *lb = NULL;
+    LedDecoder *led = NULL;
+
+    if(watch == NULL)
+        return;
+    lb = watch->owner;
+    led = &lb->leds[watch->index];
+    EnterCriticalSection(&lb->lock);
+    if(led_decoder_edge(led, !led->level, at))
+        lb->changed[watch->index] = 1;
+    LeaveCriticalSection(&lb->lock);
+}
+
+static void power_on(int index, void *ctx){
+    (void)ctx;
+    if(power_on_box(leds.fleet.boxes[index].box) != RSC2_SUCCESS)
+        print_rsc_error("power on failed");
+}
+
+static int watch_box(LedBox *lb, Rsc2_Box *box){
+    long long now = now_us();
+    int i;
+
+    lb->box = box;
+    InitializeCriticalSection(&lb->lock);
+    Rsc2_GetDescription(box, lb->description, DESC_LEN);
+    for(i = 0; i < NUM_LEDS; i++){
+        LedWatch *watch = &lb->watch[i];
+
+        watch->owner = lb;
+        watch->index = i;
+        watch->sig = Rsc2_GetSignal(box, ledIds[i]);
+        if(watch->sig == NULL)
+            return -1;
+        led_decoder_init(&lb->leds[i], Rsc2_GetSigAssertionState(watch->sig) == RSC2_SIG_ASSERTED, now, leds.steadyMs);
+        Rsc2_SetObjectClientData((Rsc2_Object *)watch->sig, watch);
+    }
+    Rsc2_AttachBoxListener(box, &leds.listener);
+    return 0;
+}
+
+/* ticks the decoders of one box, prints what changed and updates the
+ * verdict. returns 1 while the box still needs watching. */
+static int update_box(LedBox *lb){
+    char text[NUM_LEDS][32];
+    int changed[NUM_LEDS];
+    int resync[NUM_LEDS];
+    long long now = now_us();
+    LedDecoder *green = &lb->leds[0];
+    LedDecoder *amber = &lb->leds[1];
+    int verdict, i;
+
+    EnterCriticalSection(&lb->lock);
+    for(i = 0; i < NUM_LEDS; i++){
+        resync[i] = led_decoder_tick(&lb->leds[i], now)
+                 && (lb->leds[i].state == LED_STEADY_ON || lb->leds[i].state == LED_STEADY_OFF);
+        /* leds that never changed are not worth a line */
+        changed[i] = lb->changed[i] || (resync[i] && lb->leds[i].count > 1);
+        lb->changed[i] = 0;
+        led_decoder_describe(&lb->leds[i], text[i], sizeof(text[i]));
+    }
+    verdict = lb->verdict;
+    if(verdict == VERDICT_PENDING){
+        if(amber->level || amber->state == LED_BLINKING || amber->state == LED_PATTERN)
+            verdict = VERDICT_FAILED;
+        else if(green->state == LED_STEADY_ON)
+            verdict = VERDICT_BOOTED;
+    }
+    LeaveCriticalSection(&lb->lock);
+
+    for(i = 0; i < NUM_LEDS; i++){
+        if(changed[i])
+            printf("%7.1f s  %-24s %-5s %s\n", (now - leds.startedAt) / 1000000.0,
+                   lb->description, ledNames[i], text[i]);
+        /* a lost event leaves the inferred level wrong, fix it once */
+        if(resync[i]){
+            int level = Rsc2_GetSigAssertionState(lb->watch[i].sig);
+
+            EnterCriticalSection(&lb->lock);
+            if(level >= 0 && level != lb->leds[i].level)
+                led_decoder_init(&lb->leds[i], level, now, leds.steadyMs);
+            LeaveCriticalSection(&lb->lock);
+        }
+    }
+    if(verdict != lb->verdict){
+        /* the wait for the leds, from the start (or boot) to the verdict */
+        trace_end("led_verdict", leds.startedAt, lb->box);
+        lb->verdict = verdict;
+        lb->verdictAt = now;
+        printf("%7.1f s  %-24s %s\n", (now - leds.startedAt) / 1000000.0, lb->description,
+               verdict == VERDICT_BOOTED ? "BOOTED" : "FAILED post, amber led active");
+    }
+
+    if(lb->verdict == VERDICT_PENDING)
+        return 1;
+    /* keep watching a failed box until its amber code has settled */
+    return lb->verdict == VERDICT_FAILED
+        && (amber->state == LED_CHANGING || now - amber->since < (long long)leds.steadyMs * 1000);
+}
+
+int leds_main(int argc, char *argv[]){
+    int timeout = opt_int(argc, argv, "--timeout", 120);
+    int booted = 0, failed = 0, pending = 0;
+    long long bootSum = 0, failSum = 0;
+    int i;
+
+    memset(&leds, 0, sizeof(leds));
+    leds.steadyMs = opt_int(argc, argv, "--steady-ms", 2500);
+    leds.listener.sigStateChanged = on_sig_state_changed;
+    if(fleet_open(&leds.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    if(leds.fleet.numBoxes == 0){
+        printf("no rsc2 connected to the hosts\n");
+        return -1;
+    }
+
+    leds.startedAt = now_us();
+    leds.boxes = calloc(leds.fleet.numBoxes, sizeof(LedBox));
+    for(i = 0; i < leds.fleet.numBoxes; i++){
+        if(watch_box(&leds.boxes[i], leds.fleet.boxes[i].box) != 0){
+            print_rsc_error("unable to get led signals");
+            return -1;
+        }
+    }
+
+#ifdef RSC_STANDIN
+    {
+        int postErrors = opt_int(argc, argv, "--post-errors", 0);
+
+        for(i = 0; i < postErrors && i < leds.fleet.numBoxes; i++)
+            standin_set_post_error(leds.fleet.boxes[i * leds.fleet.numBoxes / postErrors].box, 2 + i % 3);
+    }
+#endif
+    if(opt_flag(argc, argv, "--boot")){
+        printf("powering on %d boxes\n", leds.fleet.numBoxes);
+        parallel_for(leds.fleet.numBoxes, 32, power_on, NULL);
+    }
+
+    for(;;){
+        int watching = 0;
+
+        for(i = 0; i < leds.fleet.numBoxes; i++)
+            watching += update_box(&leds.boxes[i]);
+        if(watching == 0 || now_us() - leds.startedAt > (long long)timeout * 1000000)
+            break;
+        Sleep(TICK_MS);
+    }
+
+    for(i = 0; i < leds.fleet.numBoxes; i++){
+        LedBox *lb = &leds.boxes[i];
+
+        Rsc2_DetachBoxListener(lb->box, &leds.listener);
+        if(lb->verdict == VERDICT_BOOTED){
+            booted++;
+            bootSum += lb->verdictAt - leds.startedAt;
+        }else if(lb->verdict == VERDICT_FAILED){
+            failed++;
+            failSum += lb->verdictAt - leds.startedAt;
+        }else{
+            pending++;
+        }
+    }
+    printf("leds: %d booted", booted);
+    if(booted)
+        printf(" (avg %.1f s)", bootSum / 1000000.0 / booted);
+    printf(", %d failed", failed);
+    if(failed)
+        printf(" (flagged after avg %.1f s)", failSum / 1000000.0 / failed);
+    printf(", %d undecided\n", pending);
+    return failed || pending ? -1 : 0;
+}
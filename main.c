@@ -1,9 +1,7 @@
-#include "rsc2/include/Rsc2CApi.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include "common.h"
+#include "commands.h"
+#include "topology.h"
 #include <unistd.h>
-#include <windows.h>
 
 /**************************************************
 * rsctool argument description
@@ -16,8 +14,54 @@
         -dessert    dessert the signal
         -rename     rename
         -status     show the status of this signal
+* on | off [--label name [--index file]]
+*                   switch both ac ports of the first box,
+*                   or of the box labelled name in the
+*                   topology index, see topology.h
+* soak [options]    fault/recovery soak test, see soak.c
+* sync [options]    apply an inventory file, see sync.c
+* leds [options]    decode status/id leds, see leds.c
+* watchdog [options] hang recovery watchdog, see watchdog.c
+* gateway [options] http/json gateway with coalesced reads, see gateway.c
+* status [options]  box state via the listener cache, see status.c
+* publish [options] publish fleet state to shared memory, see publish.c
+* fire [options]    one action on many boxes at once, see fire.c
+* bringup [options] dependency ordered bring-up, see bringup.c
+* discover [options] find rsc2 hosts, write the topology index, see discover.c
+* events [options]  sharded listener event fan-in, see events.c
+* schedule [options] campaign load through the command scheduler, see schedule.c
+* converge [options] keep ac, jumpers and usb mux at a declared state, see converge.c
+* cycle [options]   firmware power cycling with an adaptive poller, see cycle.c
+* calibrate [options] aux a loopback latency profile, see calibrate.c
+* supervise [options] bounded memory supervisor, scale bench, see supervise.c
+* the commands from soak on take --trace file
+*                   [--trace-events n] to record their rsc2
+*                   calls, see trace.h (on and off do not)
 **************************************************/
 
+static const struct
+{
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+} commands[] = {
+    {"soak", soak_main},
+    {"sync", sync_main},
+    {"leds", leds_main},
+    {"watchdog", watchdog_main},
+    {"gateway", gateway_main},
+    {"status", status_main},
+    {"publish", publish_main},
+    {"fire", fire_main},
+    {"bringup", bringup_main},
+    {"discover", discover_main},
+    {"events", events_main},
+    {"schedule", schedule_main},
+    {"converge", converge_main},
+    {"cycle", cycle_main},
+    {"calibrate", calibrate_main},
+    {"supervise", supervise_main},
+};
+
 int main(int argc, char *argv[]){
     Rsc2_Host *host = NULL;
     Rsc2_Box *box = NULL;
@@ -29,8 +73,30 @@ int main(int argc, char *argv[]){
     Rsc2_Signal *ledPower = NULL;
     int num = 0;
     char error[128] = {0};
+    const char *tracePath = NULL;
+    const char *label = NULL;
+    Topology *topology = NULL;
+    unsigned int i;
+
+    for(i = 0; argc >= 2 && i < sizeof(commands) / sizeof(commands[0]); i++){
+        if(strcmp(argv[1], commands[i].name) == 0){
+            if(Rsc2_Init() != 0){
+                print_rsc_error("rsc2 init failed");
+                return -1;
+            }
+            tracePath = opt_str(argc - 1, argv + 1, "--trace", NULL);
+            if(tracePath != NULL
+            && trace_start(tracePath, opt_int(argc - 1, argv + 1, "--trace-events", 16384)) != 0)
+                return -1;
+            num = commands[i].run(argc - 1, argv + 1);
+            if(tracePath != NULL)
+                trace_stop();
+            return num;
+        }
+    }
 
-    if(argc != 2){
+    label = argc > 2 ? opt_str(argc - 1, argv + 1, "--label", NULL) : NULL;
+    if(argc != 2 && label == NULL){
         printf("invalid parameter number\n");
         return -1;
     }
@@ -44,21 +110,31 @@ int main(int argc, char *argv[]){
     Rsc2_Init();
     printf("rsc2 init done\n");
 
-    host = Rsc2_ConnectToHost("localhost");
-    if(host == NULL){
-        Rsc2_GetLastErrorMessage(error, 128);
-        printf ("unable to connect to host: %s\n", error);
-        return -1;
-    }
+    if(label != NULL){
+        topology = topology_load(opt_str(argc - 1, argv + 1, "--index", TOPOLOGY_PATH));
+        if(topology == NULL)
+            return -1;
+        box = topology_box(topology, label);
+        topology_close(topology);
+        if(box == NULL)
+            return -1;
+    }else{
+        host = Rsc2_ConnectToHost("localhost");
+        if(host == NULL){
+            Rsc2_GetLastErrorMessage(error, 128);
+            printf ("unable to connect to host: %s\n", error);
+            return -1;
+        }
 
-    num = Rsc2_GetNumBoxes(host);
-    if(num == 0){
-        printf("no rsc2 connected to the host\n");
-        return -1;
-    }else
-        printf("%d rsc2 connected tot host\n", num);
+        num = Rsc2_GetNumBoxes(host);
+        if(num == 0){
+            printf("no rsc2 connected to the host\n");
+            return -1;
+        }else
+            printf("%d rsc2 connected tot host\n", num);
 
-    box = Rsc2_GetBox(host, 0);
+        box = Rsc2_GetBox(host, 0);
+    }
 
     buttonPower = Rsc2_GetSignal(box, RSC2_ID_FPBUT_PWR);
     jumperMfgMode = Rsc2_GetSignal(box, RSC2_ID_JMP_MFG_MODE);
@@ -0,0 +1,133 @@
+#include "common.h"
+#include "commands.h"
+#include "fleetshm.h"
+#include "statecache.h"
+
+/**************************************************
+* rsctool publish [--hosts h1,h2] [--name mapping]
+*                 [--interval-ms ms] [--max-staleness ms]
+*                 [--pwrcycle-ms ms] [--duration sec]
+* publishes the state of every box into the shared
+* memory table of fleetshm.h (default name
+* FLEET_SHM_NAME) so local processes can read it
+* without their own rsc2 sessions, e.g. with
+* "rsctool status --shm". every --interval-ms (20)
+* the values of the listener maintained state cache
+* are read for all boxes in parallel (values past
+* --max-staleness are read live), compared with the
+* table and changed boxes are rewritten; a failed
+* signal read is published as FLEET_SHM_UNKNOWN, a
+* failed lock holder read keeps the last one. power
+* cycle status is not pushed by the
+* library and is polled every --pwrcycle-ms (1000).
+**************************************************/
+
+typedef struct
+{
+    Fleet fleet;
+    StateCache *cache;
+    FleetShm shm;
+    FleetShmBox *published;     /* what the table holds, per box */
+    FleetShmBox *next;          /* read this pass */
+    Rsc2_PwrCycleStatus *pwrCycle;
+    Rsc2_Result *pwrCycleResult;
+    int maxStalenessMs;
+} Publish;
+
+static void read_pwr_cycle(int index, void *ctx){
+    Publish *pub = ctx;
+
+    memset(&pub->pwrCycle[index], 0, sizeof(Rsc2_PwrCycleStatus));
+    pub->pwrCycleResult[index] = Rsc2_PwrCycleGetStatus(pub->fleet.boxes[index].box, &pub->pwrCycle[index]);
+}
+
+static void read_box(int index, void *ctx){
+    Publish *pub = ctx;
+    FleetShmBox *box = &pub->next[index];
+    Rsc2_PwrCycleStatus *pc = &pub->pwrCycle[index];
+    char holder[FLEET_SHM_TEXT_LEN];
+    int i, state;
+
+    *box = pub->published[index];
+    box->status = state_cache_status(pub->cache, index, pub->maxStalenessMs);
+    box->usbMux = state_cache_usb_mux(pub->cache, index, pub->maxStalenessMs);
+    if(state_cache_lock_holder(pub->cache, index, holder, FLEET_SHM_TEXT_LEN, pub->maxStalenessMs) >= 0)
+        strcpy(box->lockHolder, holder);
+    for(i = 0; i < FLEET_SHM_SIGNALS; i++){
+        state = state_cache_signal(pub->cache, index, (Rsc2_SignalID)i, pub->maxStalenessMs);
+        box->signals[i] = (unsigned char)(state < 0 ? FLEET_SHM_UNKNOWN : state);
+    }
+    box->pwrCycleResult = pub->pwrCycleResult[index];
+    box->pwrCycleType = (unsigned char)pc->type;
+    box->pwrCycleInProgress = pc->isCyclingInProgress;
+    box->pwrCyclePhaseError = pc->isPhaseErrorDetected;
+    box->pwrCycleTimedOut = pc->isTimedOutWaitingForContinue;
+    box->pwrCycleNumCycles = pc->numCycles;
+    box->pwrCycleContinueWaitSecs = pc->continueWaitTimeSecs;
+    box->pwrCycleOffTimeMs = pc->offTimeMSecs;
+}
+
+int publish_main(int argc, char *argv[]){
+    const char *name = opt_str(argc, argv, "--name", FLEET_SHM_NAME);
+    int intervalMs = opt_int(argc, argv, "--interval-ms", 20);
+    int pwrCycleMs = opt_int(argc, argv, "--pwrcycle-ms", 1000);
+    int duration = opt_int(argc, argv, "--duration", 0);
+    long long startedAt, pwrCycleAt = 0;
+    long passes = 0, writes = 0;
+    Publish pub;
+    int i;
+
+    memset(&pub, 0, sizeof(pub));
+    pub.maxStalenessMs = opt_int(argc, argv, "--max-staleness", 1000);
+    if(fleet_open(&pub.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    pub.cache = state_cache_open(&pub.fleet);
+    if(pub.cache == NULL)
+        return -1;
+    if(fleet_shm_create(&pub.shm, name, pub.fleet.numBoxes) != 0)
+        return -1;
+    pub.published = calloc(pub.fleet.numBoxes + 1, sizeof(FleetShmBox));
+    pub.next = calloc(pub.fleet.numBoxes + 1, sizeof(FleetShmBox));
+    pub.pwrCycle = calloc(pub.fleet.numBoxes + 1, sizeof(Rsc2_PwrCycleStatus));
+    pub.pwrCycleResult = calloc(pub.fleet.numBoxes + 1, sizeof(Rsc2_Result));
+
+    /* the parts that never change are written once */
+    for(i = 0; i < pub.fleet.numBoxes; i++){
+        FleetShmBox *box = &pub.published[i];
+
+        box->hostIndex = pub.fleet.boxes[i].hostIndex;
+        strcpy(box->host, pub.fleet.hostNames[box->hostIndex]);
+        Rsc2_GetDescription(pub.fleet.boxes[i].box, box->description, FLEET_SHM_TEXT_LEN);
+        fleet_shm_write(&pub.shm, i, box);
+    }
+    pub.shm.header->intervalMs = intervalMs;
+    pub.shm.header->numBoxes = pub.fleet.numBoxes;
+    printf("publishing %d boxes to %s every %d ms\n", pub.fleet.numBoxes, name, intervalMs);
+
+    startedAt = now_us();
+    while(duration == 0 || now_us() - startedAt < (long long)duration * 1000000){
+        if(now_us() >= pwrCycleAt){
+            parallel_for(pub.fleet.numBoxes, 32, read_pwr_cycle, &pub);
+            pwrCycleAt = now_us() + (long long)pwrCycleMs * 1000;
+        }
+        /* live reads of expired values overlap, the single writer stays serial */
+        parallel_for(pub.fleet.numBoxes, 32, read_box, &pub);
+        for(i = 0; i < pub.fleet.numBoxes; i++){
+            if(memcmp(&pub.next[i], &pub.published[i], sizeof(FleetShmBox)) != 0){
+                fleet_shm_write(&pub.shm, i, &pub.next[i]);
+                pub.published[i] = pub.next[i];
+                writes++;
+            }
+        }
+        InterlockedIncrement(&pub.shm.header->heartbeat);
+        passes++;
+        Sleep(intervalMs);
+    }
+
+    printf("%ld passes, %ld box updates\n", passes, writes);
+    pub.shm.header->numBoxes = 0;
+    fleet_shm_close(&pub.shm);
+    state_cache_close(pub.cache);
+    fleet_close(&pub.fleet);
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "common.h"
+#include "commands.h"
+#include "scheduler.h"
+
+/**************************************************
+* rsctool schedule [--hosts h1,h2] [--rate n] [--burst n]
+*                  [--workers n] [--tenants w1,w2,...]
+*                  [--batch n] [--interactive n]
+*                  [--interval-ms ms] [--hold-ms ms]
+* loads the fleet through the command scheduler
+* (scheduler.h) the way a power-cycle campaign and a
+* developer would. every tenant, one per weight in
+* --tenants (3,1), queues --batch (1000) aux a output
+* writes spread over the boxes at once; meanwhile
+* --interactive (20) reset presses, one every
+* --interval-ms (250), go in ahead of them. each host
+* gets --rate (50) calls per second with bursts of
+* --burst (10) and --workers (4) calls at a time.
+* the report shows how long the presses queued, each
+* tenant's share of the hosts while all of them had
+* work queued, and the most calls a host saw at once.
+**************************************************/
+
+typedef struct
+{
+    SchedCommand cmd;
+    Rsc2_Signal *signal;
+    Rsc2_SignalState state;
+} LoadCommand;
+
+typedef struct
+{
+    Fleet fleet;
+    Scheduler *sched;
+    Rsc2_Signal **aux;
+    Rsc2_Signal **reset;
+    int numTenants;
+    int weights[SCHED_MAX_TENANTS];
+    int perTenant;
+    volatile LONG done[SCHED_MAX_TENANTS];
+    volatile LONG snapshotTaken;
+    LONG snapshot[SCHED_MAX_TENANTS];   /* done counts when the first tenant ran out */
+    volatile LONG batchLeft;
+} ScheduleRun;
+
+static ScheduleRun sr;
+
+static void get_signals(int index, void *ctx){
+    (void)ctx;
+    sr.aux[index] = Rsc2_GetSignal(sr.fleet.boxes[index].box, RSC2_ID_OUT_AUX_A);
+    sr.reset[index] = Rsc2_GetSignal(sr.fleet.boxes[index].box, RSC2_ID_FPBUT_RESET);
+}
+
+static Rsc2_Result run_write(SchedCommand *cmd){
+    LoadCommand *lc = (LoadCommand *)cmd;
+
+    return Rsc2_SetSigAssertionState(lc->signal, lc->state);
+}
+
+static void batch_done(SchedCommand *cmd, Rsc2_Result result){
+    int i;
+
+    (void)result;
+    if(InterlockedIncrement(&sr.done[cmd->tenant]) == sr.perTenant
+    && InterlockedCompareExchange(&sr.snapshotTaken, 1, 0) == 0){
+        for(i = 0; i < sr.numTenants; i++)
+            sr.snapshot[i] = sr.done[i];
+    }
+    InterlockedDecrement(&sr.batchLeft);
+}
+
+static int parse_weights(const char *list){
+    char copy[256];
+    char *weight = NULL;
+
+    strncpy(copy, list, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+    for(weight = strtok(copy, ","); weight != NULL; weight = strtok(NULL, ",")){
+        if(sr.numTenants == SCHED_MAX_TENANTS || atoi(weight) < 1){
+            printf("--tenants takes up to %d weights of 1 or more\n", SCHED_MAX_TENANTS);
+            return -1;
+        }
+        sr.weights[sr.numTenants++] = atoi(weight);
+    }
+    return sr.numTenants > 0 ? 0 : -1;
+}
+
+static int compare_ll(const void *a, const void *b){
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int schedule_main(int argc, char *argv[]){
+    double rate = opt_int(argc, argv, "--rate", 50);
+    int burst = opt_int(argc, argv, "--burst", 10);
+    int workers = opt_int(argc, argv, "--workers", 4);
+    int numInteractive = opt_int(argc, argv, "--interactive", 20);
+    int intervalMs = opt_int(argc, argv, "--interval-ms", 250);
+    int holdMs = opt_int(argc, argv, "--hold-ms", 100);
+    LoadCommand *batch = NULL;
+    long long *waited = NULL;
+    SchedCounts counts;
+    long long start, callUs = 0;
+    double seconds;
+    int total, presses = 0, snapshotSum = 0;
+    int i, t;
+
+    memset(&sr, 0, sizeof(sr));
+    sr.perTenant = opt_int(argc, argv, "--batch", 1000);
+    if(parse_weights(opt_str(argc, argv, "--tenants", "3,1")) != 0)
+        return -1;
+    if(fleet_open(&sr.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    if(sr.fleet.numBoxes == 0){
+        printf("no boxes\n");
+        return -1;
+    }
+    sr.aux = calloc(sr.fleet.numBoxes, sizeof(Rsc2_Signal *));
+    sr.reset = calloc(sr.fleet.numBoxes, sizeof(Rsc2_Signal *));
+    parallel_for(sr.fleet.numBoxes, 32, get_signals, NULL);
+    for(i = 0; i < sr.fleet.numBoxes; i++){
+        if(sr.aux[i] == NULL || sr.reset[i] == NULL){
+            print_rsc_error("unable to get signals");
+            return -1;
+        }
+    }
+    sr.sched = scheduler_open(&sr.fleet, rate, burst, workers);
+    if(sr.sched == NULL)
+        return -1;
+
+    total = sr.numTenants * sr.perTenant;
+    batch = calloc(total + 1, sizeof(LoadCommand));
+    sr.batchLeft = total;
+    start = now_us();
+    for(t = 0; t < sr.numTenants; t++){
+        int tenant = scheduler_tenant(sr.sched, sr.weights[t]);
+
+        for(i = 0; i < sr.perTenant; i++){
+            LoadCommand *lc = &batch[t * sr.perTenant + i];
+            int box = i % sr.fleet.numBoxes;
+
+            lc->signal = sr.aux[box];
+            lc->state = (i / sr.fleet.numBoxes) % 2 ? RSC2_SIG_DEASSERTED : RSC2_SIG_ASSERTED;
+            lc->cmd.host = sr.fleet.boxes[box].hostIndex;
+            lc->cmd.tenant = tenant;
+            lc->cmd.priority = SCHED_BATCH;
+            lc->cmd.run = run_write;
+            lc->cmd.done = batch_done;
+            scheduler_submit(sr.sched, &lc->cmd);
+        }
+    }
+    printf("%d batch writes queued for %d tenants on %d hosts\n", total, sr.numTenants, sr.fleet.numHosts);
+
+    waited = calloc(numInteractive + 1, sizeof(long long));
+    for(i = 0; i < numInteractive && sr.batchLeft > 0; i++){
+        int box = i % sr.fleet.numBoxes;
+        LoadCommand press;
+
+        memset(&press, 0, sizeof(press));
+        press.signal = sr.reset[box];
+        press.state = RSC2_BUTTON_PRESSED;
+        press.cmd.host = sr.fleet.boxes[box].hostIndex;
+        press.cmd.priority = SCHED_INTERACTIVE;
+        press.cmd.run = run_write;
+        scheduler_call(sr.sched, &press.cmd);
+        waited[presses++] = press.cmd.startedAt - press.cmd.queuedAt;
+        callUs += press.cmd.doneAt - press.cmd.startedAt;
+        Sleep(holdMs);
+        press.state = RSC2_BUTTON_RELEASED;
+        scheduler_call(sr.sched, &press.cmd);
+        Sleep(intervalMs);
+    }
+    while(sr.batchLeft > 0)
+        Sleep(10);
+    seconds = (now_us() - start) / 1000000.0;
+    scheduler_counts(sr.sched, &counts);
+    scheduler_close(sr.sched);
+
+    printf("%d batch writes in %.1f s, %.1f per host per second (rate %.0f)\n", total, seconds,
+           total / seconds / sr.fleet.numHosts, rate);
+    for(t = 0; t < sr.numTenants; t++)
+        snapshotSum += sr.snapshot[t];
+    for(t = 0; t < sr.numTenants && snapshotSum > 0; t++){
+        printf("  tenant %d  weight %d  share %5.1f%% while all tenants were busy\n", t, sr.weights[t],
+               100.0 * sr.snapshot[t] / snapshotSum);
+    }
+    if(presses > 0){
+        qsort(waited, presses, sizeof(long long), compare_ll);
+        printf("%d interactive presses waited p50 %.2f ms  p99 %.2f ms  max %.2f ms, the call took %.1f ms\n",
+               presses, waited[presses / 2] / 1000.0, waited[presses * 99 / 100] / 1000.0,
+               waited[presses - 1] / 1000.0, callUs / 1000.0 / presses);
+    }
+    printf("longest batch wait %.1f s, at most %d calls in flight on a host (%d workers)\n",
+           counts.waitMaxUs[SCHED_BATCH] / 1000000.0, counts.maxInFlight, workers);
+    free(waited);
+    free(batch);
+    fleet_close(&sr.fleet);
+    return 0;
+}
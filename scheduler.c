@@ -0,0 +1,296 @@
+#include "scheduler.h"
+
+#define IDLE_MS         100
+#define RESERVED_TOKENS 1.0     /* batch leaves this much in the bucket */
+
+typedef struct
+{
+    SchedCommand *head;
+    SchedCommand *tail;
+} SchedQueue;
+
+typedef struct
+{
+    Scheduler *sched;
+    int index;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    SchedQueue interactive;
+    SchedQueue batch[SCHED_MAX_TENANTS];
+    double lastTag[SCHED_MAX_TENANTS];
+    double virtualTime;
+    double tokens;
+    long long refilledAt;
+    int queued;
+    int inFlight;
+    int batchInFlight;
+    int maxInFlight;
+    long long done[2];
+    long long waitMaxUs[2];
+    HANDLE *threads;
+} SchedHost;
+
+struct Scheduler
+{
+    Fleet *fleet;
+    double rate;
+    int burst;
+    int workers;
+    int numTenants;
+    int weights[SCHED_MAX_TENANTS];
+    SchedHost hosts[MAX_HOSTS];
+    volatile LONG stopping;
+};
+
+/* below, the caller holds host->lock */
+
+static void append(SchedQueue *queue, SchedCommand *cmd){
+    cmd->next = NULL;
+    if(queue->tail != NULL)
+        queue->tail->next = cmd;
+    else
+        queue->head = cmd;
+    queue->tail = cmd;
+}
+
+static SchedCommand *pop(SchedQueue *queue){
+    SchedCommand *cmd = queue->head;
+
+    queue->head = cmd->next;
+    if(queue->head == NULL)
+        queue->tail = NULL;
+    return cmd;
+}
+
+static void refill(SchedHost *host, long long now){
+    Scheduler *sched = host->sched;
+
+    host->tokens += (now - host->refilledAt) / 1000000.0 * sched->rate;
+    if(host->tokens > sched->burst)
+        host->tokens = sched->burst;
+    host->refilledAt = now;
+}
+
+/* the batch command with the earliest finish tag */
+static SchedQueue *next_batch(SchedHost *host){
+    SchedQueue *best = NULL;
+    int i;
+
+    for(i = 0; i < host->sched->numTenants; i++){
+        SchedQueue *queue = &host->batch[i];
+
+        if(queue->head != NULL && (best == NULL || queue->head->finishTag < best->head->finishTag))
+            best = queue;
+    }
+    return best;
+}
+
+/* NULL when nothing may run now, *waitMs says for how long */
+static SchedCommand *take(SchedHost *host, DWORD *waitMs){
+    Scheduler *sched = host->sched;
+    SchedQueue *batch = NULL;
+    SchedCommand *cmd = NULL;
+    double need = 0;
+
+    refill(host, now_us());
+    *waitMs = IDLE_MS;
+    if(host->interactive.head != NULL){
+        if(host->tokens >= 1.0)
+            cmd = pop(&host->interactive);
+        else
+            need = 1.0;
+    }else if(host->batchInFlight < sched->workers - 1 && (batch = next_batch(host)) != NULL){
+        if(host->tokens >= 1.0 + RESERVED_TOKENS){
+            cmd = pop(batch);
+            host->virtualTime = cmd->finishTag;
+            host->batchInFlight++;
+        }else{
+            need = 1.0 + RESERVED_TOKENS;
+        }
+    }
+    if(cmd == NULL){
+        if(need > 0)
+            *waitMs = (DWORD)((need - host->tokens) / sched->rate * 1000) + 1;
+        return NULL;
+    }
+    host->tokens -= 1.0;
+    host->queued--;
+    host->inFlight++;
+    if(host->inFlight > host->maxInFlight)
+        host->maxInFlight = host->inFlight;
+    cmd->startedAt = now_us();
+    if(cmd->startedAt - cmd->queuedAt > host->waitMaxUs[cmd->priority])
+        host->waitMaxUs[cmd->priority] = cmd->startedAt - cmd->queuedAt;
+    return cmd;
+}
+
+static DWORD WINAPI worker_thread(LPVOID arg){
+    SchedHost *host = arg;
+    SchedCommand *cmd = NULL;
+    void (*done)(SchedCommand *cmd, Rsc2_Result result);
+    Rsc2_Result result;
+    DWORD waitMs;
+
+    EnterCriticalSection(&host->lock);
+    for(;;){
+        cmd = take(host, &waitMs);
+        if(cmd == NULL){
+            if(host->sched->stopping && host->queued == 0)
+                break;
+            SleepConditionVariableCS(&host->wake, &host->lock, waitMs);
+            continue;
+        }
+        LeaveCriticalSection(&host->lock);
+
+        result = cmd->run(cmd);
+
+        EnterCriticalSection(&host->lock);
+        host->inFlight--;
+        if(cmd->priority == SCHED_BATCH)
+            host->batchInFlight--;
+        host->done[cmd->priority]++;
+        done = cmd->done;
+        cmd->doneAt = now_us();
+        cmd->result = result;
+        cmd->finished = 1;
+        if(cmd->waiter != NULL)
+            WakeAllConditionVariable(cmd->waiter);
+        /* a batch slot may have opened */
+        WakeConditionVariable(&host->wake);
+        if(done != NULL){
+            LeaveCriticalSection(&host->lock);
+            done(cmd, result);
+            EnterCriticalSection(&host->lock);
+        }
+    }
+    LeaveCriticalSection(&host->lock);
+    return 0;
+}
+
+Scheduler *scheduler_open(Fleet *fleet, double ratePerHost, int burst, int workers){
+    Scheduler *sched = calloc(1, sizeof(Scheduler));
+    int i, j;
+
+    sched->fleet = fleet;
+    sched->rate = ratePerHost > 0 ? ratePerHost : 1;
+    /* room for the reserved token and one batch call */
+    sched->burst = burst < 2 ? 2 : burst;
+    sched->workers = workers < 2 ? 2 : workers;
+    for(i = 0; i < fleet->numHosts; i++){
+        SchedHost *host = &sched->hosts[i];
+
+        host->sched = sched;
+        host->index = i;
+        host->tokens = sched->burst;
+        host->refilledAt = now_us();
+        InitializeCriticalSection(&host->lock);
+        InitializeConditionVariable(&host->wake);
+        host->threads = calloc(sched->workers, sizeof(HANDLE));
+        for(j = 0; j < sched->workers; j++){
+            host->threads[j] = CreateThread(NULL, 0, worker_thread, host, 0, NULL);
+            if(host->threads[j] == NULL){
+                printf("unable to start the workers of host %s\n", fleet->hostNames[i]);
+                scheduler_close(sched);
+                return NULL;
+            }
+        }
+    }
+    return sched;
+}
+
+void scheduler_close(Scheduler *sched){
+    int i, j;
+
+    /* the workers drain what is queued first */
+    sched->stopping = 1;
+    for(i = 0; i < sched->fleet->numHosts; i++){
+        SchedHost *host = &sched->hosts[i];
+
+        if(host->threads == NULL)
+            continue;
+        EnterCriticalSection(&host->lock);
+        WakeAllConditionVariable(&host->wake);
+        LeaveCriticalSection(&host->lock);
+        for(j = 0; j < sched->workers; j++){
+            if(host->threads[j] == NULL)
+                continue;
+            WaitForSingleObject(host->threads[j], INFINITE);
+            CloseHandle(host->threads[j]);
+        }
+        free(host->threads);
+    }
+    free(sched);
+}
+
+int scheduler_tenant(Scheduler *sched, int weight){
+    int id = sched->numTenants;
+
+    if(id == SCHED_MAX_TENANTS){
+        printf("too many tenants, only %d are supported\n", SCHED_MAX_TENANTS);
+        return -1;
+    }
+    sched->weights[id] = weight < 1 ? 1 : weight;
+    sched->numTenants++;
+    return id;
+}
+
+static void enqueue(Scheduler *sched, SchedCommand *cmd){
+    SchedHost *host = &sched->hosts[cmd->host];
+
+    EnterCriticalSection(&host->lock);
+    cmd->queuedAt = now_us();
+    cmd->finished = 0;
+    if(cmd->priority == SCHED_INTERACTIVE){
+        append(&host->interactive, cmd);
+    }else{
+        /* weighted fair queuing: a tenant's commands are spaced
+         * 1/weight apart in virtual time */
+        double start = host->lastTag[cmd->tenant] > host->virtualTime ? host->lastTag[cmd->tenant] : host->virtualTime;
+
+        cmd->finishTag = start + 1.0 / sched->weights[cmd->tenant];
+        host->lastTag[cmd->tenant] = cmd->finishTag;
+        append(&host->batch[cmd->tenant], cmd);
+    }
+    host->queued++;
+    WakeConditionVariable(&host->wake);
+    LeaveCriticalSection(&host->lock);
+}
+
+void scheduler_submit(Scheduler *sched, SchedCommand *cmd){
+    cmd->waiter = NULL;
+    enqueue(sched, cmd);
+}
+
+Rsc2_Result scheduler_call(Scheduler *sched, SchedCommand *cmd){
+    SchedHost *host = &sched->hosts[cmd->host];
+    CONDITION_VARIABLE finished;
+
+    InitializeConditionVariable(&finished);
+    cmd->waiter = &finished;
+    EnterCriticalSection(&host->lock);
+    enqueue(sched, cmd);
+    while(!cmd->finished)
+        SleepConditionVariableCS(&finished, &host->lock, INFINITE);
+    LeaveCriticalSection(&host->lock);
+    return cmd->result;
+}
+
+void scheduler_counts(Scheduler *sched, SchedCounts *counts){
+    int i, j;
+
+    memset(counts, 0, sizeof(*counts));
+    for(i = 0; i < sched->fleet->numHosts; i++){
+        SchedHost *host = &sched->hosts[i];
+
+        EnterCriticalSection(&host->lock);
+        for(j = 0; j < 2; j++){
+            counts->done[j] += host->done[j];
+            if(host->waitMaxUs[j] > counts->waitMaxUs[j])
+                counts->waitMaxUs[j] = host->waitMaxUs[j];
+        }
+        counts->queued += host->queued;
+        if(host->maxInFlight > counts->maxInFlight)
+            counts->maxInFlight = host->maxInFlight;
+        LeaveCriticalSection(&host->lock);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "common.h"
+
+/**************************************************
+* per-host rsc2 command scheduler
+* every host gets a token bucket (rate per second and
+* burst) and a fixed number of worker threads, so no
+* rsc2 server sees more than that many calls at a
+* time however many callers there are.
+* interactive commands go first, always; one worker
+* slot and one token of the bucket are kept for them,
+* so a single reset does not wait behind a campaign.
+* batch commands are shared between tenants by
+* weighted fair queuing: each tenant gets its weight's
+* share of a busy host, in submission order within
+* the tenant.
+**************************************************/
+
+#define SCHED_MAX_TENANTS   16
+
+typedef enum
+{
+    SCHED_INTERACTIVE,
+    SCHED_BATCH
+} SchedPriority;
+
+typedef struct SchedCommand SchedCommand;
+typedef struct Scheduler Scheduler;
+
+/* the caller owns a command until its done callback ran */
+struct SchedCommand
+{
+    int host;                   /* index into fleet->hosts */
+    int tenant;                 /* from scheduler_tenant, batch only */
+    SchedPriority priority;
+    Rsc2_Result (*run)(SchedCommand *cmd);
+    void (*done)(SchedCommand *cmd, Rsc2_Result result);   /* on a worker, may be NULL */
+    void *arg;
+    long long queuedAt;         /* set by the scheduler */
+    long long startedAt;
+    long long doneAt;
+    Rsc2_Result result;
+    /* private */
+    double finishTag;
+    int finished;
+    CONDITION_VARIABLE *waiter;
+    SchedCommand *next;
+};
+
+typedef struct
+{
+    long long done[2];          /* by priority */
+    long long waitMaxUs[2];     /* queued to started */
+    int queued;
+    int maxInFlight;            /* most calls any host had at once */
+} SchedCounts;
+
+/* "workers" per host, at least 2 */
+Scheduler *scheduler_open(Fleet *fleet, double ratePerHost, int burst, int workers);
+void scheduler_close(Scheduler *sched);
+
+/* registers a tenant with a weight, returns its id or -1 */
+int scheduler_tenant(Scheduler *sched, int weight);
+
+void scheduler_submit(Scheduler *sched, SchedCommand *cmd);
+
+/* submits and waits for the result */
+Rsc2_Result scheduler_call(Scheduler *sched, SchedCommand *cmd);
+
+void scheduler_counts(Scheduler *sched, SchedCounts *counts);
+
+#endif /* SCHEDULER_H */
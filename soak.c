@@ -0,0 +1,530 @@
+#include "common.h"
+#include "commands.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool soak [--hosts h1,h2] [--duration sec]
+*              [--workers n] [--interval-ms ms]
+*              [--retry-ms ms] [--stuck-ms ms]
+*              [--fault-every sec] [--fault-length sec]
+*              [--seed n]
+* keeps ac ports and the id button of every box busy
+* and, in the Standin build, takes hosts offline,
+* unplugs boxes and steals box locks meanwhile.
+* reports how long the workload needed to notice and
+* to get over each fault, slow/stuck operations and
+* the throughput lost while faults were active.
+**************************************************/
+
+#define MAX_FAULTS      256
+#define MAX_SECONDS     86400
+#define DESC_LEN        64
+
+enum
+{
+    FAULT_HOST_OFFLINE,
+    FAULT_BOX_REMOVED,
+    FAULT_BOX_LOCKED,
+    NUM_FAULT_TYPES
+};
+
+static const char *faultNames[NUM_FAULT_TYPES] = {
+    "host offline", "box removed", "box locked"
+};
+
+typedef struct
+{
+    int type;
+    int hostIndex;
+    int boxIndex;                   /* -1 for host wide faults */
+    Rsc2_Box *box;                  /* the box object that was faulted */
+    long long injectedAt;
+    long long clearedAt;
+    volatile LONGLONG detectedAt;   /* first failing operation */
+    volatile LONGLONG eventAt;      /* first listener callback */
+    volatile LONGLONG recoveredAt;  /* last affected box working again */
+    volatile LONG pending;          /* affected boxes not recovered yet */
+} SoakFault;
+
+typedef struct
+{
+    int hostIndex;
+    int boxIndex;
+    char description[DESC_LEN];
+    Rsc2_Box *box;
+    Rsc2_Signal *ac[2];
+    Rsc2_Signal *button;
+    int step;
+    volatile LONG fault;            /* index into soak.faults, -1 if none */
+} SoakBox;
+
+typedef struct
+{
+    int index;
+    HANDLE thread;
+    volatile LONGLONG opStart;      /* 0 while idle */
+} SoakWorker;
+
+static struct
+{
+    Fleet fleet;
+    int numBoxes;
+    SoakBox *boxes;
+    int numWorkers;
+    SoakWorker *workers;
+    int intervalMs;
+    int retryMs;
+    int stuckMs;
+    long long startedAt;
+    long long endAt;
+    volatile LONG stop;
+    volatile LONG okOps;
+    volatile LONG failedOps;
+    volatile LONG slowOps;
+    volatile LONG reconnects;
+    volatile LONG *okPerSecond;
+    int numSeconds;
+    volatile LONG numFaults;
+    SoakFault faults[MAX_FAULTS];
+    Rsc2_HostListener hostListener;
+    Rsc2_BoxListener boxListener;
+} soak;
+
+static void mark_time(volatile LONGLONG *slot){
+    if(*slot == 0)
+        InterlockedCompareExchange64(slot, now_us(), 0);
+}
+
+static int resolve_signals(SoakBox *sb){
+    sb->ac[0] = Rsc2_GetSignal(sb->box, RSC2_ID_AC_1);
+    sb->ac[1] = Rsc2_GetSignal(sb->box, RSC2_ID_AC_2);
+    sb->button = Rsc2_GetSignal(sb->box, RSC2_ID_FPBUT_ID);
+    if(sb->ac[0] == NULL || sb->ac[1] == NULL || sb->button == NULL)
+        return -1;
+    Rsc2_SetObjectClientData((Rsc2_Object *)sb->box, sb);
+    Rsc2_AttachBoxListener(sb->box, &soak.boxListener);
+    return 0;
+}
+
+/* what automation does after a failure: reconnect to the host when it
+ * went away, find the unit again by its description when the box object
+ * became invalid. */
+static void reacquire(SoakBox *sb, Rsc2_Result result){
+    char description[DESC_LEN];
+    Rsc2_Host *host = NULL;
+    int i, num;
+
+    if(result != RSC2_ERR_REMOTE_OBJ_DISCONNECTED && result != RSC2_ERR_INVALID_OBJ_REF)
+        return;
+    InterlockedIncrement(&soak.reconnects);
+    host = Rsc2_ConnectToHost(soak.fleet.hostNames[sb->hostIndex]);
+    if(host == NULL)
+        return;
+    soak.fleet.hosts[sb->hostIndex] = host;
+    if(result != RSC2_ERR_INVALID_OBJ_REF)
+        return;
+
+    num = Rsc2_GetNumBoxes(host);
+    for(i = 0; i < num; i++){
+        Rsc2_Box *box = Rsc2_GetBox(host, i);
+
+        if(box == NULL || Rsc2_GetDescription(box, description, DESC_LEN) <= 0)
+            continue;
+        if(strcmp(description, sb->description) == 0){
+            sb->box = box;
+            sb->boxIndex = i;
+            resolve_signals(sb);
+            return;
+        }
+    }
+}
+
+static void op_done(SoakBox *sb, Rsc2_Result result, long long started){
+    long long finished = now_us();
+    long fault = sb->fault;
+    int second;
+
+    if(finished - started > (long long)soak.stuckMs * 1000)
+        InterlockedIncrement(&soak.slowOps);
+
+    if(result != RSC2_SUCCESS){
+        InterlockedIncrement(&soak.failedOps);
+        if(fault >= 0)
+            mark_time(&soak.faults[fault].detectedAt);
+        return;
+    }
+
+    InterlockedIncrement(&soak.okOps);
+    second = (int)((finished - soak.startedAt) / 1000000);
+    if(second >= 0 && second < soak.numSeconds)
+        InterlockedIncrement(&soak.okPerSecond[second]);
+
+    if(fault >= 0 && soak.faults[fault].clearedAt != 0){
+        sb->fault = -1;
+        if(InterlockedDecrement(&soak.faults[fault].pending) == 0)
+            mark_time(&soak.faults[fault].recoveredAt);
+    }
+}
+
+/* one step of the workload: ac 1 on/off, ac 2 on/off, id button press */
+static Rsc2_Result workload_step(SoakBox *sb){
+    Rsc2_Result result;
+
+    switch(sb->step % 3){
+    case 0:
+    case 1:
+        result = Rsc2_SetSigAssertionState(sb->ac[sb->step % 3],
+                                           (sb->step / 3) % 2 ? RSC2_AC_OFF : RSC2_AC_ON);
+        break;
+    default:
+        result = Rsc2_SetSigAssertionState(sb->button, RSC2_BUTTON_PRESSED);
+        if(result == RSC2_SUCCESS)
+            result = Rsc2_SetSigAssertionState(sb->button, RSC2_BUTTON_RELEASED);
+        break;
+    }
+    return result;
+}
+
+static DWORD WINAPI soak_worker(LPVOID arg){
+    SoakWorker *worker = arg;
+    int i;
+
+    while(!soak.stop && now_us() < soak.endAt){
+        for(i = worker->index; i < soak.numBoxes && !soak.stop; i += soak.numWorkers){
+            SoakBox *sb = &soak.boxes[i];
+            Rsc2_Result result;
+            long long started = now_us();
+
+            worker->opStart = started;
+            if(sb->button == NULL){
+                result = RSC2_ERR_INVALID_OBJ_REF;
+            }else{
+                result = workload_step(sb);
+            }
+            worker->opStart = 0;
+            op_done(sb, result, started);
+            if(result == RSC2_SUCCESS){
+                sb->step++;
+            }else{
+                reacquire(sb, result);
+                Sleep(soak.retryMs);
+            }
+        }
+        Sleep(soak.intervalMs);
+    }
+    return 0;
+}
+
+static void mark_fault_event(int hostIndex, SoakBox *sb, int type){
+    int i;
+
+    for(i = soak.numFaults - 1; i >= 0; i--){
+        SoakFault *fault = &soak.faults[i];
+
+        if(fault->type != type || fault->clearedAt != 0)
+            continue;
+        if((fault->boxIndex < 0 && fault->hostIndex == hostIndex)
+        || (fault->boxIndex >= 0 && sb == &soak.boxes[fault->boxIndex])){
+            mark_time(&fault->eventAt);
+            return;
+        }
+    }
+}
+
+static int host_index(Rsc2_Host *host){
+    int i;
+
+    for(i = 0; i < soak.fleet.numHosts; i++){
+        if(soak.fleet.hosts[i] == host)
+            return i;
+    }
+    return -1;
+}
+
+static void on_host_offline(Rsc2_Host *host){
+    mark_fault_event(host_index(host), NULL, FAULT_HOST_OFFLINE);
+}
+
+static void on_box_removed(Rsc2_Host *host, Rsc2_Box *box){
+    SoakBox *sb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+
+    (void)host;
+    if(sb != NULL)
+        mark_fault_event(-1, sb, FAULT_BOX_REMOVED);
+}
+
+static void on_lock_holder_changed(Rsc2_Box *box){
+    SoakBox *sb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+
+    if(sb != NULL)
+        mark_fault_event(-1, sb, FAULT_BOX_LOCKED);
+}
+
+#ifdef RSC_STANDIN
+/* picks a target whose boxes are not still recovering from an earlier fault */
+static int inject_fault(int type){
+    SoakFault *fault = &soak.faults[soak.numFaults];
+    int target, i, attempts;
+
+    memset(fault, 0, sizeof(*fault));
+    fault->type = type;
+    for(attempts = 0; attempts < 16; attempts++){
+        if(type == FAULT_HOST_OFFLINE){
+            target = rand() % soak.fleet.numHosts;
+            for(i = 0; i < soak.numBoxes; i++){
+                if(soak.boxes[i].hostIndex == target && soak.boxes[i].fault != -1)
+                    break;
+            }
+            if(i < soak.numBoxes)
+                continue;
+            fault->hostIndex = target;
+            fault->boxIndex = -1;
+        }else{
+            target = rand() % soak.numBoxes;
+            if(soak.boxes[target].fault != -1)
+                continue;
+            fault->hostIndex = -1;
+            fault->boxIndex = target;
+            fault->box = soak.boxes[target].box;
+        }
+        break;
+    }
+    if(attempts == 16)
+        return -1;
+
+    for(i = 0; i < soak.numBoxes; i++){
+        if(i == fault->boxIndex || soak.boxes[i].hostIndex == fault->hostIndex){
+            soak.boxes[i].fault = soak.numFaults;
+            fault->pending++;
+        }
+    }
+
+    /* publish the fault before the listener can report it */
+    fault->injectedAt = now_us();
+    InterlockedIncrement(&soak.numFaults);
+    if(type == FAULT_HOST_OFFLINE)
+        standin_set_host_online(soak.fleet.hosts[fault->hostIndex], 0);
+    else if(type == FAULT_BOX_REMOVED)
+        standin_remove_box(fault->box);
+    else
+        standin_lock_box(fault->box, "soak-intruder");
+    return soak.numFaults - 1;
+}
+
+static void clear_fault(SoakFault *fault){
+    fault->clearedAt = now_us();
+    if(fault->type == FAULT_HOST_OFFLINE)
+        standin_set_host_online(soak.fleet.hosts[fault->hostIndex], 1);
+    else if(fault->type == FAULT_BOX_REMOVED)
+        standin_readd_box(fault->box);
+    else
+        standin_lock_box(fault->box, NULL);
+}
+
+static void run_faults(int everySec, int lengthSec){
+    int type = 0;
+
+    while(now_us() + (long long)(everySec + lengthSec) * 1000000 < soak.endAt
+       && soak.numFaults < MAX_FAULTS){
+        int index;
+
+        Sleep(everySec * 1000);
+        index = inject_fault(type);
+        type = (type + 1) % NUM_FAULT_TYPES;
+        if(index < 0)
+            continue;
+        Sleep(lengthSec * 1000);
+        clear_fault(&soak.faults[index]);
+    }
+}
+#endif
+
+static void print_ms(long long from, long long to){
+    if(from == 0 || to == 0)
+        printf("  %12s", "-");
+    else
+        printf("  %9.1f ms", (to - from) / 1000.0);
+}
+
+static void report(void){
+    long long detectSum = 0, recoverSum = 0;
+    long long detectMax = 0, recoverMax = 0;
+    int detected = 0, recovered = 0;
+    long long baseline = 0, degraded = 0;
+    int baselineSecs = 0, degradedSecs = 0;
+    int elapsed = (int)((now_us() - soak.startedAt) / 1000000);
+    LONG stuck = 0;
+    int i, s;
+
+    if(soak.numFaults > 0){
+        printf("\n%5s  %-12s  %-24s  %12s  %12s  %12s\n",
+               "fault", "type", "target", "detect(op)", "detect(evt)", "recover");
+    }
+    for(i = 0; i < soak.numFaults; i++){
+        SoakFault *fault = &soak.faults[i];
+        char target[HOST_NAME_LEN + DESC_LEN];
+
+        if(fault->boxIndex >= 0)
+            sprintf(target, "%s", soak.boxes[fault->boxIndex].description);
+        else
+            sprintf(target, "%s", soak.fleet.hostNames[fault->hostIndex]);
+        printf("%5d  %-12s  %-24.24s", i + 1, faultNames[fault->type], target);
+        print_ms(fault->injectedAt, fault->detectedAt);
+        print_ms(fault->injectedAt, fault->eventAt);
+        print_ms(fault->clearedAt, fault->recoveredAt);
+        printf("\n");
+
+        if(fault->detectedAt != 0){
+            detected++;
+            detectSum += fault->detectedAt - fault->injectedAt;
+            if(fault->detectedAt - fault->injectedAt > detectMax)
+                detectMax = fault->detectedAt - fault->injectedAt;
+        }
+        if(fault->recoveredAt != 0){
+            recovered++;
+            recoverSum += fault->recoveredAt - fault->clearedAt;
+            if(fault->recoveredAt - fault->clearedAt > recoverMax)
+                recoverMax = fault->recoveredAt - fault->clearedAt;
+        }
+    }
+
+    /* whole seconds overlapping a fault window count as degraded */
+    for(s = 0; s < elapsed && s < soak.numSeconds; s++){
+        long long from = soak.startedAt + (long long)s * 1000000;
+        long long to = from + 1000000;
+        int inFault = 0;
+
+        for(i = 0; i < soak.numFaults; i++){
+            SoakFault *fault = &soak.faults[i];
+            long long end = fault->recoveredAt ? fault->recoveredAt : soak.endAt;
+
+            if(fault->injectedAt < to && end > from)
+                inFault = 1;
+        }
+        if(inFault){
+            degraded += soak.okPerSecond[s];
+            degradedSecs++;
+        }else{
+            baseline += soak.okPerSecond[s];
+            baselineSecs++;
+        }
+    }
+
+    for(i = 0; i < soak.numWorkers; i++){
+        long long started = soak.workers[i].opStart;
+        if(started != 0 && now_us() - started > (long long)soak.stuckMs * 1000)
+            stuck++;
+    }
+
+    printf("\noperations: %ld ok, %ld failed, %ld slower than %d ms, %ld stuck at exit\n",
+           soak.okOps, soak.failedOps, soak.slowOps, soak.stuckMs, stuck);
+    printf("reacquire attempts: %ld\n", soak.reconnects);
+    if(soak.numFaults > 0){
+        printf("faults: %ld injected, %d detected, %d recovered\n",
+               soak.numFaults, detected, recovered);
+        if(detected)
+            printf("time to detect: avg %.1f ms, max %.1f ms\n",
+                   detectSum / 1000.0 / detected, detectMax / 1000.0);
+        if(recovered)
+            printf("time to recover: avg %.1f ms, max %.1f ms (from fault cleared)\n",
+                   recoverSum / 1000.0 / recovered, recoverMax / 1000.0);
+    }
+    if(baselineSecs > 0){
+        double base = (double)baseline / baselineSecs;
+
+        printf("throughput: %.0f ops/s without faults", base);
+        if(degradedSecs > 0 && base > 0){
+            double during = (double)degraded / degradedSecs;
+            printf(", %.0f ops/s during faults (%.1f%% degradation)",
+                   during, 100.0 * (base - during) / base);
+        }
+        printf("\n");
+    }
+}
+
+int soak_main(int argc, char *argv[]){
+    int duration = opt_int(argc, argv, "--duration", 60);
+    int faultEvery = opt_int(argc, argv, "--fault-every", 10);
+    int faultLength = opt_int(argc, argv, "--fault-length", 2);
+    int i;
+
+    memset(&soak, 0, sizeof(soak));
+    soak.numWorkers = opt_int(argc, argv, "--workers", 4);
+    soak.intervalMs = opt_int(argc, argv, "--interval-ms", 10);
+    soak.retryMs = opt_int(argc, argv, "--retry-ms", 50);
+    soak.stuckMs = opt_int(argc, argv, "--stuck-ms", 2000);
+    srand(opt_int(argc, argv, "--seed", 1));
+    if(duration <= 0 || duration > MAX_SECONDS || soak.numWorkers <= 0){
+        printf("invalid --duration or --workers\n");
+        return -1;
+    }
+
+    if(fleet_open(&soak.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    if(soak.fleet.numBoxes == 0){
+        printf("no rsc2 connected to the hosts\n");
+        return -1;
+    }
+
+    soak.hostListener.hostOffline = on_host_offline;
+    soak.hostListener.boxRemoved = on_box_removed;
+    soak.boxListener.lockHolderChanged = on_lock_holder_changed;
+    for(i = 0; i < soak.fleet.numHosts; i++)
+        Rsc2_AttachHostListener(soak.fleet.hosts[i], &soak.hostListener);
+
+    soak.numBoxes = soak.fleet.numBoxes;
+    soak.boxes = calloc(soak.numBoxes, sizeof(SoakBox));
+    for(i = 0; i < soak.numBoxes; i++){
+        SoakBox *sb = &soak.boxes[i];
+
+        sb->hostIndex = soak.fleet.boxes[i].hostIndex;
+        sb->boxIndex = soak.fleet.boxes[i].boxIndex;
+        sb->box = soak.fleet.boxes[i].box;
+        sb->fault = -1;
+        Rsc2_GetDescription(sb->box, sb->description, DESC_LEN);
+        if(resolve_signals(sb) != 0){
+            print_rsc_error("unable to get signals");
+            return -1;
+        }
+    }
+    if(soak.numWorkers > soak.numBoxes)
+        soak.numWorkers = soak.numBoxes;
+
+    soak.numSeconds = duration + 1;
+    soak.okPerSecond = calloc(soak.numSeconds, sizeof(LONG));
+    soak.workers = calloc(soak.numWorkers, sizeof(SoakWorker));
+    printf("soak: %d boxes on %d hosts, %d workers, %d s\n",
+           soak.numBoxes, soak.fleet.numHosts, soak.numWorkers, duration);
+
+    soak.startedAt = now_us();
+    soak.endAt = soak.startedAt + (long long)duration * 1000000;
+    for(i = 0; i < soak.numWorkers; i++){
+        soak.workers[i].index = i;
+        soak.workers[i].thread = CreateThread(NULL, 0, soak_worker, &soak.workers[i], 0, NULL);
+    }
+
+#ifdef RSC_STANDIN
+    if(faultEvery > 0)
+        run_faults(faultEvery, faultLength);
+#else
+    (void)faultEvery;
+    (void)faultLength;
+    printf("fault injection needs the Standin build, running the workload only\n");
+#endif
+
+    while(now_us() < soak.endAt)
+        Sleep(100);
+    soak.stop = 1;
+    for(i = 0; i < soak.numWorkers; i++){
+        /* a worker blocked in the library for too long counts as stuck */
+        if(WaitForSingleObject(soak.workers[i].thread, soak.stuckMs) == WAIT_OBJECT_0)
+            CloseHandle(soak.workers[i].thread);
+    }
+
+    report();
+    for(i = 0; i < soak.fleet.numHosts; i++)
+        Rsc2_DetachHostListener(soak.fleet.hosts[i], &soak.hostListener);
+    return 0;
+}
@@ -0,0 +1,1400 @@
+#define TRACE_NO_WRAP
+#include "common.h"
+#include "standin.h"
+#include <stdarg.h>
+
+/**************************************************
+* stand-in rsc2 backend
+* implements the whole Rsc2CApi.h surface in memory.
+* all state lives behind one lock; listener callbacks
+* are delivered from a private event thread, like the
+* real library delivers them from its own threads.
+* a getter that fails returns -1 (text, signal state
+* and type getters), RSC2_STAT_OFFLINE/UNKNOWN or
+* RSC2_MUX_STATE_UNKNOWN, and sets the last error.
+**************************************************/
+
+#define TEXT_LEN        64
+
+#define MAGIC_HOST      0x48435352
+#define MAGIC_BOX       0x42435352
+#define MAGIC_SIGNAL    0x53435352
+
+enum
+{
+    EV_SIG_STATE,
+    EV_SIG_LABEL,
+    EV_BOX_STATUS,
+    EV_LOCK_HOLDER,
+    EV_USER_LABEL,
+    EV_KVM_ADDRESS,
+    EV_USB_MUX,
+    EV_BOX_ADDED,
+    EV_BOX_REMOVED,
+    EV_HOST_OFFLINE,
+    EV_HOST_ONLINE,
+    EV_SUT_STEP,
+    EV_PWRCYC_STEP,
+    EV_LOOPBACK
+};
+
+/* what the simulated system under test is doing */
+enum
+{
+    SUT_OFF,
+    SUT_POST,           /* booting, green led blinks at 1 Hz */
+    SUT_RUNNING,        /* green led steady on */
+    SUT_POST_ERROR,     /* amber led blinks the error code, repeatedly */
+    SUT_HUNG            /* green led off, ignores buttons up to its hang depth */
+};
+
+#define SUT_BLINK_US        500000
+#define SUT_PULSE_US        250000
+#define SUT_PAUSE_US        1500000
+#define SUT_FORCE_OFF_US    4000000
+
+/* where the firmware power cycling of a box is */
+enum
+{
+    PWRCYC_IDLE,
+    PWRCYC_OFF,             /* power removed for the off time */
+    PWRCYC_BOOTING,         /* power back, waiting for the sut to boot */
+    PWRCYC_WAITING,         /* the sut did not boot, waiting for a continue */
+    PWRCYC_TIMED_OUT        /* no continue came in time, paused */
+};
+
+struct Rsc2_Object
+{
+    int magic;
+    void *clientData;
+};
+
+struct Rsc2_Signal
+{
+    Rsc2_Object obj;
+    Rsc2_Box *box;
+    Rsc2_SignalID id;
+    Rsc2_SignalState state;
+    Rsc2_SignalType type;
+    Rsc2_AssertionType assertion;
+    char name[TEXT_LEN];
+};
+
+struct Rsc2_Box
+{
+    Rsc2_Object obj;
+    Rsc2_Host *host;
+    volatile int removed;
+    Rsc2_BoxListener *listener;
+    char description[TEXT_LEN];
+    char label[TEXT_LEN];
+    char kvm[TEXT_LEN];
+    char lockHolder[TEXT_LEN];
+    int lockedByUs;
+    Rsc2_UsbMuxState mux;
+    Rsc2_Signal signals[NUM_SIGNALS];
+    int sut;
+    int sutGeneration;          /* bumped to cancel pending sut steps */
+    int sutStep;
+    int postError;              /* amber pulses shown after post, 0 = boots fine */
+    int hangDepth;              /* 1 reset helps, 2 needs a forced off, 3 needs ac */
+    long long powerPressedAt;
+    int loopbackUs;             /* aux a output to input, 0 = not wired */
+    int pwrCycle;               /* PWRCYC_ phase */
+    int pwrCycleGeneration;     /* bumped to cancel pending steps */
+    Rsc2_PwrCycleType pwrCycleType;
+    int pwrCycleCount;
+    int pwrCycleDone;
+    int bootTimeoutMs;
+    int offMs;
+    int endOffMs;
+    int offStepMs;
+    int acDcDelayMs;
+    long long pwrCycleStartedAt;
+    long long pwrCycleEndedAt;
+};
+
+struct Rsc2_Host
+{
+    Rsc2_Object obj;
+    char name[TEXT_LEN];
+    volatile int online;
+    Rsc2_HostListener *listener;
+    int numBoxes;
+    int capacity;
+    Rsc2_Box **boxes;
+    int serial;
+};
+
+typedef struct
+{
+    long long due;
+    int type;
+    void *obj;
+    int arg;
+} StandinEvent;
+
+static struct
+{
+    int initialized;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    HANDLE thread;
+    int boxesPerHost;
+    int latencyMs;
+    int bootMs;
+    const char *reachable;      /* comma separated host names, NULL = every name */
+    int unreachableMs;
+    int continueWaitS;
+    int loopbackUs;
+    volatile LONG remoteCalls;
+    int numHosts;
+    Rsc2_Host **hosts;
+    int numEvents;
+    int eventCapacity;
+    StandinEvent *events;
+} g;
+
+static __thread char lastError[256];
+
+static const char *assignedNames[NUM_SIGNALS] = {
+    "RSC2_ID_FPBUT_PWR", "RSC2_ID_FPBUT_RESET", "RSC2_ID_FPBUT_ID",
+    "RSC2_ID_JMP_MFG_MODE", "RSC2_ID_JMP_CLR_CMOS", "RSC2_ID_JMP_BMC_FRC_UPD",
+    "RSC2_ID_JMP_BIOS_RECOVERY", "RSC2_ID_OUT_AUX_A", "RSC2_ID_OUT_AUX_B",
+    "RSC2_ID_OUT_AUX_C", "RSC2_ID_LED_PWR", "RSC2_ID_LED_STATUS_GREEN",
+    "RSC2_ID_LED_STATUS_AMBER", "RSC2_ID_LED_ID_BLUE", "RSC2_ID_INP_AUX_A",
+    "RSC2_ID_INP_AUX_B", "RSC2_ID_AC_1", "RSC2_ID_AC_2"
+};
+
+static const char *genericNames[NUM_SIGNALS] = {
+    "RSC2_ID_OUT_1", "RSC2_ID_OUT_2", "RSC2_ID_OUT_3", "RSC2_ID_OUT_4",
+    "RSC2_ID_OUT_5", "RSC2_ID_OUT_6", "RSC2_ID_OUT_7", "RSC2_ID_OUT_8",
+    "RSC2_ID_OUT_9", "RSC2_ID_OUT_10", "RSC2_ID_INP_1", "RSC2_ID_INP_2",
+    "RSC2_ID_INP_3", "RSC2_ID_INP_4", "RSC2_ID_INP_5", "RSC2_ID_INP_6",
+    "RSC2_ID_AC_1", "RSC2_ID_AC_2"
+};
+
+static const char *stateStrings[] = { "RSC2_SIG_DEASSERTED", "RSC2_SIG_ASSERTED", NULL };
+static const char *boxStatusStrings[] = {
+    "RSC2_STAT_UNKNOWN", "RSC2_STAT_AVAILABLE", "RSC2_STAT_LOCKED",
+    "RSC2_STAT_OFFLINE", "RSC2_STAT_UPDATE_IN_PROG"
+};
+static const char *muxStrings[] = {
+    "RSC2_MUX_STATE_UNKNOWN", "RSC2_MUX_TO_HOST", "RSC2_MUX_TO_SUT",
+    "RSC2_MUX_DISCONNECTED", "RSC2_MUX_DISABLED"
+};
+
+static const Rsc2_SymRec sigIdTable[] = {
+    {"RSC2_ID_FPBUT_PWR", 0}, {"RSC2_ID_FPBUT_RESET", 1}, {"RSC2_ID_FPBUT_ID", 2},
+    {"RSC2_ID_JMP_MFG_MODE", 3}, {"RSC2_ID_JMP_CLR_CMOS", 4},
+    {"RSC2_ID_JMP_BMC_FRC_UPD", 5}, {"RSC2_ID_JMP_BIOS_RECOVERY", 6},
+    {"RSC2_ID_OUT_AUX_A", 7}, {"RSC2_ID_OUT_AUX_B", 8}, {"RSC2_ID_OUT_AUX_C", 9},
+    {"RSC2_ID_LED_PWR", 10}, {"RSC2_ID_LED_STATUS_GREEN", 11},
+    {"RSC2_ID_LED_STATUS_AMBER", 12}, {"RSC2_ID_LED_ID_BLUE", 13},
+    {"RSC2_ID_INP_AUX_A", 14}, {"RSC2_ID_INP_AUX_B", 15},
+    {"RSC2_ID_AC_1", 16}, {"RSC2_ID_AC_2", 17}, {NULL, 0}
+};
+static const Rsc2_SymRec sigStateTable[] = {
+    {"RSC2_SIG_ASSERTED", 1}, {"RSC2_SIG_DEASSERTED", 0}, {"RSC2_JMP_ENABLED", 1},
+    {"RSC2_JMP_DISABLED", 0}, {"RSC2_BUTTON_PRESSED", 1}, {"RSC2_BUTTON_RELEASED", 0},
+    {"RSC2_AC_ON", 1}, {"RSC2_AC_OFF", 0}, {"RSC2_LED_ON", 1}, {"RSC2_LED_OFF", 0},
+    {NULL, 0}
+};
+static const Rsc2_SymRec sigTypeTable[] = {
+    {"RSC2_GPIO", RSC2_GPIO}, {"RSC2_JUMPER", RSC2_JUMPER}, {"RSC2_BUTTON", RSC2_BUTTON},
+    {"RSC2_AC_PORT", RSC2_AC_PORT}, {"RSC2_LED", RSC2_LED}, {NULL, 0}
+};
+static const Rsc2_SymRec assertionTable[] = {
+    {"RSC2_ACTIVE_HIGH", RSC2_ACTIVE_HIGH}, {"RSC2_ACTIVE_LOW", RSC2_ACTIVE_LOW}, {NULL, 0}
+};
+static const Rsc2_SymRec muxTable[] = {
+    {"RSC2_MUX_STATE_UNKNOWN", 0}, {"RSC2_MUX_TO_HOST", 1}, {"RSC2_MUX_TO_SUT", 2},
+    {"RSC2_MUX_DISCONNECTED", 3}, {"RSC2_MUX_DISABLED", 4}, {NULL, 0}
+};
+static const Rsc2_SymRec boxStatusTable[] = {
+    {"RSC2_STAT_UNKNOWN", 0}, {"RSC2_STAT_AVAILABLE", 1}, {"RSC2_STAT_LOCKED", 2},
+    {"RSC2_STAT_OFFLINE", 3}, {"RSC2_STAT_UPDATE_IN_PROG", 4}, {NULL, 0}
+};
+static const Rsc2_SymRec resultTable[] = {
+    {"RSC2_SUCCESS", 0}, {"RSC2_ERR_UNSPECIFIED", -1},
+    {"RSC2_ERR_REMOTE_OBJ_DISCONNECTED", -2}, {"RSC2_ERR_BOX_LOCKED", -3},
+    {"RSC2_ERR_COMMAND_FAILED", -4}, {"RSC2_ERR_INVALID_OBJ_REF", -5},
+    {"RSC2_ERR_NOT_IMPLEMENTED_YET", -6}, {NULL, 0}
+};
+
+static void set_error(const char *format, ...){
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(lastError, sizeof(lastError), format, args);
+    va_end(args);
+}
+
+static int copy_text(char *buf, int size, const char *text){
+    int len = (int)strlen(text);
+
+    if(buf != NULL && size > 0){
+        strncpy(buf, text, size - 1);
+        buf[size - 1] = '\0';
+    }
+    return len;
+}
+
+static int env_int(const char *name, int def){
+    const char *value = getenv(name);
+
+    return value ? atoi(value) : def;
+}
+
+/* event queue, a binary min-heap on the due time. caller holds g.lock */
+static void post_event_at(long long due, int type, void *obj, int arg){
+    StandinEvent ev;
+    int i;
+
+    if(g.numEvents == g.eventCapacity){
+        g.eventCapacity = g.eventCapacity ? g.eventCapacity * 2 : 256;
+        g.events = realloc(g.events, g.eventCapacity * sizeof(StandinEvent));
+    }
+    ev.due = due;
+    ev.type = type;
+    ev.obj = obj;
+    ev.arg = arg;
+    for(i = g.numEvents++; i > 0 && g.events[(i - 1) / 2].due > due; i = (i - 1) / 2)
+        g.events[i] = g.events[(i - 1) / 2];
+    g.events[i] = ev;
+    WakeConditionVariable(&g.wake);
+}
+
+static void post_event(int type, void *obj){
+    post_event_at(now_us(), type, obj, 0);
+}
+
+static StandinEvent pop_event(void){
+    StandinEvent top = g.events[0];
+    StandinEvent last = g.events[--g.numEvents];
+    int i = 0, child;
+
+    while((child = 2 * i + 1) < g.numEvents){
+        if(child + 1 < g.numEvents && g.events[child + 1].due < g.events[child].due)
+            child++;
+        if(g.events[child].due >= last.due)
+            break;
+        g.events[i] = g.events[child];
+        i = child;
+    }
+    if(g.numEvents > 0)
+        g.events[i] = last;
+    return top;
+}
+
+static void sut_step(Rsc2_Box *box, int generation);
+static void pwrcyc_step(Rsc2_Box *box, int generation);
+static void set_input(Rsc2_Box *box, Rsc2_SignalID id, int level);
+
+/* runs with g.lock held, drops it around the callback */
+static void deliver(StandinEvent *ev){
+    Rsc2_Signal *sig = ev->obj;
+    Rsc2_Box *box = ev->obj;
+    Rsc2_Host *host = ev->obj;
+    Rsc2_BoxListener *bl = NULL;
+    Rsc2_HostListener *hl = NULL;
+    void (*sigFn)(Rsc2_Signal *) = NULL;
+    void (*boxFn)(Rsc2_Box *) = NULL;
+    void (*membershipFn)(Rsc2_Host *, Rsc2_Box *) = NULL;
+    void (*hostFn)(Rsc2_Host *) = NULL;
+
+    if(ev->type == EV_SUT_STEP){
+        sut_step(box, ev->arg);
+        return;
+    }
+    if(ev->type == EV_PWRCYC_STEP){
+        pwrcyc_step(box, ev->arg);
+        return;
+    }
+    if(ev->type == EV_LOOPBACK){
+        if(!box->removed)
+            set_input(box, RSC2_ID_INP_AUX_A, ev->arg);
+        return;
+    }
+
+    switch(ev->type){
+    case EV_SIG_STATE:
+    case EV_SIG_LABEL:
+        bl = sig->box->listener;
+        if(bl)
+            sigFn = ev->type == EV_SIG_STATE ? bl->sigStateChanged : bl->sigLabelChanged;
+        break;
+    case EV_BOX_STATUS:
+    case EV_LOCK_HOLDER:
+    case EV_USER_LABEL:
+    case EV_KVM_ADDRESS:
+    case EV_USB_MUX:
+        bl = box->listener;
+        if(bl == NULL)
+            break;
+        if(ev->type == EV_BOX_STATUS)
+            boxFn = bl->boxStatusChanged;
+        else if(ev->type == EV_LOCK_HOLDER)
+            boxFn = bl->lockHolderChanged;
+        else if(ev->type == EV_USER_LABEL)
+            boxFn = bl->userLabelChanged;
+        else if(ev->type == EV_KVM_ADDRESS)
+            boxFn = bl->kvmAddressChanged;
+        else
+            boxFn = bl->usbMuxChanged;
+        break;
+    case EV_BOX_ADDED:
+    case EV_BOX_REMOVED:
+        hl = box->host->listener;
+        if(hl)
+            membershipFn = ev->type == EV_BOX_ADDED ? hl->boxAdded : hl->boxRemoved;
+        break;
+    case EV_HOST_OFFLINE:
+    case EV_HOST_ONLINE:
+        hl = host->listener;
+        if(hl)
+            hostFn = ev->type == EV_HOST_OFFLINE ? hl->hostOffline : hl->hostOnline;
+        break;
+    }
+
+    LeaveCriticalSection(&g.lock);
+    if(sigFn)
+        sigFn(sig);
+    if(boxFn)
+        boxFn(box);
+    if(membershipFn)
+        membershipFn(box->host, box);
+    if(hostFn)
+        hostFn(host);
+    EnterCriticalSection(&g.lock);
+}
+
+static DWORD WINAPI event_thread(LPVOID arg){
+    (void)arg;
+    EnterCriticalSection(&g.lock);
+    for(;;){
+        long long wait;
+
+        if(g.numEvents == 0){
+            SleepConditionVariableCS(&g.wake, &g.lock, INFINITE);
+            continue;
+        }
+        wait = g.events[0].due - now_us();
+        if(wait >= 1000){
+            SleepConditionVariableCS(&g.wake, &g.lock, (DWORD)(wait / 1000));
+        }else if(wait > 0){
+            LeaveCriticalSection(&g.lock);
+            SwitchToThread();
+            EnterCriticalSection(&g.lock);
+        }else{
+            StandinEvent ev = pop_event();
+            deliver(&ev);
+        }
+    }
+    return 0;
+}
+
+/* every call that would reach an rsc2 server goes through here: it is
+ * counted, costs the configured latency and fails while the box or its
+ * host is gone. */
+static Rsc2_Result remote_box(Rsc2_Box *box){
+    InterlockedIncrement(&g.remoteCalls);
+    if(g.latencyMs > 0)
+        Sleep(g.latencyMs);
+    if(box == NULL || box->obj.magic != MAGIC_BOX){
+        set_error("invalid box object");
+        return RSC2_ERR_INVALID_OBJ_REF;
+    }
+    if(!box->host->online){
+        set_error("host %s is not reachable", box->host->name);
+        return RSC2_ERR_REMOTE_OBJ_DISCONNECTED;
+    }
+    if(box->removed){
+        set_error("box %s has been removed", box->description);
+        return RSC2_ERR_INVALID_OBJ_REF;
+    }
+    return RSC2_SUCCESS;
+}
+
+static Rsc2_Result check_lock(Rsc2_Box *box){
+    if(box->lockHolder[0] != '\0' && !box->lockedByUs){
+        set_error("box %s is locked by %s", box->description, box->lockHolder);
+        return RSC2_ERR_BOX_LOCKED;
+    }
+    return RSC2_SUCCESS;
+}
+
+static Rsc2_Result remote_write_box(Rsc2_Box *box){
+    Rsc2_Result result = remote_box(box);
+
+    return result == RSC2_SUCCESS ? check_lock(box) : result;
+}
+
+static Rsc2_Result check_signal(Rsc2_Signal *sig){
+    if(sig == NULL || sig->obj.magic != MAGIC_SIGNAL){
+        InterlockedIncrement(&g.remoteCalls);
+        set_error("invalid signal object");
+        return RSC2_ERR_INVALID_OBJ_REF;
+    }
+    return RSC2_SUCCESS;
+}
+
+static Rsc2_Result remote_signal(Rsc2_Signal *sig){
+    Rsc2_Result result = check_signal(sig);
+
+    return result == RSC2_SUCCESS ? remote_box(sig->box) : result;
+}
+
+/* one round trip, like a read */
+static Rsc2_Result remote_write_signal(Rsc2_Signal *sig){
+    Rsc2_Result result = check_signal(sig);
+
+    return result == RSC2_SUCCESS ? remote_write_box(sig->box) : result;
+}
+
+static Rsc2_SignalType default_type(int id){
+    if(id <= RSC2_ID_FPBUT_ID)
+        return RSC2_BUTTON;
+    if(id <= RSC2_ID_JMP_BIOS_RECOVERY)
+        return RSC2_JUMPER;
+    if(id >= RSC2_ID_LED_PWR && id <= RSC2_ID_LED_ID_BLUE)
+        return RSC2_LED;
+    if(id >= RSC2_ID_AC_1)
+        return RSC2_AC_PORT;
+    return RSC2_GPIO;
+}
+
+static int is_input(int id){
+    return id >= RSC2_ID_INP_1 && id <= RSC2_ID_INP_6;
+}
+
+/* caller holds g.lock */
+static Rsc2_Box *attach_box(Rsc2_Host *host, const Rsc2_Box *like){
+    Rsc2_Box *box = calloc(1, sizeof(Rsc2_Box));
+    int i;
+
+    if(like != NULL){
+        *box = *like;
+    }else{
+        snprintf(box->description, TEXT_LEN, "RSC2 SN %s-%04d", host->name, host->serial++);
+        box->mux = RSC2_MUX_TO_HOST;
+        /* every unit's wiring is a little different, base to twice the base */
+        if(g.loopbackUs > 0)
+            box->loopbackUs = g.loopbackUs + (int)((long long)(host->serial * 7919 % 1000) * g.loopbackUs / 1000);
+        for(i = 0; i < NUM_SIGNALS; i++){
+            box->signals[i].id = (Rsc2_SignalID)i;
+            box->signals[i].type = default_type(i);
+            box->signals[i].assertion = RSC2_ACTIVE_HIGH;
+            copy_text(box->signals[i].name, TEXT_LEN, assignedNames[i] + strlen("RSC2_ID_"));
+        }
+    }
+    box->obj.magic = MAGIC_BOX;
+    box->obj.clientData = NULL;
+    box->host = host;
+    box->removed = 0;
+    box->listener = NULL;
+    for(i = 0; i < NUM_SIGNALS; i++){
+        box->signals[i].obj.magic = MAGIC_SIGNAL;
+        box->signals[i].obj.clientData = NULL;
+        box->signals[i].box = box;
+    }
+
+    if(host->numBoxes == host->capacity){
+        host->capacity = host->capacity ? host->capacity * 2 : 8;
+        host->boxes = realloc(host->boxes, host->capacity * sizeof(Rsc2_Box *));
+    }
+    host->boxes[host->numBoxes++] = box;
+    return box;
+}
+
+/* the system under test. caller holds g.lock for all sut_ functions */
+static void set_input(Rsc2_Box *box, Rsc2_SignalID id, int level){
+    Rsc2_Signal *sig = &box->signals[id];
+
+    if(sig->state != (Rsc2_SignalState)level){
+        sig->state = level ? RSC2_SIG_ASSERTED : RSC2_SIG_DEASSERTED;
+        post_event(EV_SIG_STATE, sig);
+    }
+}
+
+static void sut_schedule(Rsc2_Box *box, long long delay){
+    post_event_at(now_us() + delay, EV_SUT_STEP, box, box->sutGeneration);
+}
+
+static void sut_boot(Rsc2_Box *box){
+    box->sutGeneration++;
+    box->sut = SUT_POST;
+    box->hangDepth = 0;
+    box->sutStep = 0;
+    set_input(box, RSC2_ID_LED_STATUS_GREEN, 0);
+    set_input(box, RSC2_ID_LED_STATUS_AMBER, 0);
+    sut_schedule(box, SUT_BLINK_US);
+}
+
+static void sut_power_off(Rsc2_Box *box){
+    box->sutGeneration++;
+    box->sut = SUT_OFF;
+    box->hangDepth = 0;
+    set_input(box, RSC2_ID_LED_PWR, 0);
+    set_input(box, RSC2_ID_LED_STATUS_GREEN, 0);
+    set_input(box, RSC2_ID_LED_STATUS_AMBER, 0);
+}
+
+static void pwrcyc_booted(Rsc2_Box *box);
+
+static void sut_step(Rsc2_Box *box, int generation){
+    int position;
+
+    if(generation != box->sutGeneration || box->removed)
+        return;
+    switch(box->sut){
+    case SUT_POST:
+        box->sutStep++;
+        if((long long)box->sutStep * SUT_BLINK_US < (long long)g.bootMs * 1000){
+            set_input(box, RSC2_ID_LED_STATUS_GREEN, box->sutStep % 2);
+            sut_schedule(box, SUT_BLINK_US);
+        }else if(box->postError > 0){
+            box->sut = SUT_POST_ERROR;
+            box->sutStep = 0;
+            set_input(box, RSC2_ID_LED_STATUS_GREEN, 0);
+            sut_schedule(box, 0);
+        }else{
+            box->sut = SUT_RUNNING;
+            set_input(box, RSC2_ID_LED_STATUS_GREEN, 1);
+            if(box->pwrCycle == PWRCYC_BOOTING)
+                pwrcyc_booted(box);
+        }
+        break;
+    case SUT_POST_ERROR:
+        /* postError short pulses, then a long pause */
+        position = box->sutStep++ % (2 * box->postError + 1);
+        if(position < 2 * box->postError){
+            set_input(box, RSC2_ID_LED_STATUS_AMBER, position % 2 == 0);
+            sut_schedule(box, SUT_PULSE_US);
+        }else{
+            sut_schedule(box, SUT_PAUSE_US);
+        }
+        break;
+    }
+}
+
+static void sut_output_changed(Rsc2_Box *box, Rsc2_SignalID id){
+    int powered = box->signals[RSC2_ID_AC_1].state || box->signals[RSC2_ID_AC_2].state;
+    int level = box->signals[id].state;
+
+    switch(id){
+    case RSC2_ID_AC_1:
+    case RSC2_ID_AC_2:
+        if(!powered){
+            sut_power_off(box);
+            set_input(box, RSC2_ID_LED_ID_BLUE, 0);
+        }
+        break;
+    case RSC2_ID_FPBUT_PWR:
+        /* the button acts when released */
+        if(level){
+            box->powerPressedAt = now_us();
+            break;
+        }
+        if(!powered)
+            break;
+        if(box->sut == SUT_OFF){
+            set_input(box, RSC2_ID_LED_PWR, 1);
+            sut_boot(box);
+        }else if(box->sut != SUT_HUNG){
+            sut_power_off(box);
+        }else if(box->hangDepth <= 2 && now_us() - box->powerPressedAt >= SUT_FORCE_OFF_US){
+            sut_power_off(box);
+        }
+        break;
+    case RSC2_ID_FPBUT_RESET:
+        if(!level && box->sut != SUT_OFF && (box->sut != SUT_HUNG || box->hangDepth <= 1))
+            sut_boot(box);
+        break;
+    case RSC2_ID_FPBUT_ID:
+        if(!level && powered)
+            set_input(box, RSC2_ID_LED_ID_BLUE, !box->signals[RSC2_ID_LED_ID_BLUE].state);
+        break;
+    case RSC2_ID_OUT_AUX_A:
+        /* wired back to aux a input, which follows with +-10% jitter */
+        if(box->loopbackUs > 0)
+            post_event_at(now_us() + box->loopbackUs + (rand() % 201 - 100) * box->loopbackUs / 1000,
+                          EV_LOOPBACK, box, level);
+        break;
+    default:
+        break;
+    }
+}
+
+/* the firmware power cycling. caller holds g.lock for all pwrcyc_ functions */
+static void pwrcyc_schedule(Rsc2_Box *box, long long delay){
+    post_event_at(now_us() + delay, EV_PWRCYC_STEP, box, box->pwrCycleGeneration);
+}
+
+static void pwrcyc_set_ac(Rsc2_Box *box, int on){
+    int id;
+
+    for(id = RSC2_ID_AC_1; id <= RSC2_ID_AC_2; id++){
+        if(box->signals[id].state != (Rsc2_SignalState)on){
+            set_input(box, (Rsc2_SignalID)id, on);
+            sut_output_changed(box, (Rsc2_SignalID)id);
+        }
+    }
+}
+
+static void pwrcyc_power_off(Rsc2_Box *box){
+    long long offUs = (long long)box->offMs * 1000;
+
+    box->pwrCycleGeneration++;
+    box->pwrCycle = PWRCYC_OFF;
+    /* the firmware holds the power button, which a deeply hung sut ignores */
+    if((box->pwrCycleType & RSC2_PWRCYC_DC) && box->sut != SUT_OFF
+    && (box->sut != SUT_HUNG || box->hangDepth <= 2))
+        sut_power_off(box);
+    if(box->pwrCycleType & RSC2_PWRCYC_AC)
+        pwrcyc_set_ac(box, 0);
+    if(box->pwrCycleType == RSC2_PWRCYC_AC_DC)
+        offUs += (long long)box->acDcDelayMs * 1000;
+    pwrcyc_schedule(box, offUs);
+}
+
+static void pwrcyc_power_on(Rsc2_Box *box){
+    box->pwrCycle = PWRCYC_BOOTING;
+    if(box->pwrCycleType & RSC2_PWRCYC_AC)
+        pwrcyc_set_ac(box, 1);
+    /* with ac only, the sut comes up on its own when power returns */
+    if(box->sut == SUT_OFF && (box->signals[RSC2_ID_AC_1].state || box->signals[RSC2_ID_AC_2].state)){
+        set_input(box, RSC2_ID_LED_PWR, 1);
+        sut_boot(box);
+    }
+    pwrcyc_schedule(box, (long long)box->bootTimeoutMs * 1000);
+}
+
+static void pwrcyc_end(Rsc2_Box *box){
+    box->pwrCycleGeneration++;
+    box->pwrCycle = PWRCYC_IDLE;
+    box->pwrCycleEndedAt = now_us();
+}
+
+static void pwrcyc_booted(Rsc2_Box *box){
+    box->pwrCycleDone++;
+    if(box->offMs < box->endOffMs)
+        box->offMs = box->offMs + box->offStepMs < box->endOffMs ? box->offMs + box->offStepMs : box->endOffMs;
+    if(box->pwrCycleDone >= box->pwrCycleCount)
+        pwrcyc_end(box);
+    else
+        pwrcyc_power_off(box);
+}
+
+static void pwrcyc_step(Rsc2_Box *box, int generation){
+    if(generation != box->pwrCycleGeneration || box->removed)
+        return;
+    switch(box->pwrCycle){
+    case PWRCYC_OFF:
+        pwrcyc_power_on(box);
+        break;
+    case PWRCYC_BOOTING:
+        /* boot timeout, a phase error */
+        box->pwrCycle = PWRCYC_WAITING;
+        pwrcyc_schedule(box, (long long)g.continueWaitS * 1000000);
+        break;
+    case PWRCYC_WAITING:
+        box->pwrCycle = PWRCYC_TIMED_OUT;
+        break;
+    }
+}
+
+RSC2CAPI int RSC2CALL Rsc2_Init(){
+    if(g.initialized)
+        return 0;
+    InitializeCriticalSection(&g.lock);
+    InitializeConditionVariable(&g.wake);
+    g.boxesPerHost = env_int("RSC_STANDIN_BOXES", 4);
+    g.latencyMs = env_int("RSC_STANDIN_LATENCY_MS", 0);
+    g.bootMs = env_int("RSC_STANDIN_BOOT_MS", 3000);
+    g.reachable = getenv("RSC_STANDIN_HOSTS");
+    g.unreachableMs = env_int("RSC_STANDIN_UNREACHABLE_MS", 5000);
+    g.continueWaitS = env_int("RSC_STANDIN_CONTINUE_WAIT_S", 30);
+    g.loopbackUs = env_int("RSC_STANDIN_LOOPBACK_US", 1500);
+    g.thread = CreateThread(NULL, 0, event_thread, NULL, 0, NULL);
+    if(g.thread == NULL){
+        set_error("unable to start the event thread");
+        return -1;
+    }
+    now_us();
+    g.initialized = 1;
+    return 0;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetLastErrorMessage(char *buf, int bufSize){
+    return copy_text(buf, bufSize, lastError);
+}
+
+RSC2CAPI void RSC2CALL Rsc2_SetObjectClientData(Rsc2_Object *obj, void *clientData){
+    if(obj != NULL)
+        obj->clientData = clientData;
+}
+
+RSC2CAPI void *RSC2CALL Rsc2_GetObjectClientData(Rsc2_Object *obj){
+    return obj ? obj->clientData : NULL;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_IsValidObjPtr(void *obj){
+    return Rsc2_IsValidHostPtr(obj) || Rsc2_IsValidBoxPtr(obj) || Rsc2_IsValidSignalPtr(obj);
+}
+
+RSC2CAPI int RSC2CALL Rsc2_IsValidHostPtr(void *obj){
+    return obj != NULL && ((Rsc2_Object *)obj)->magic == MAGIC_HOST;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_IsValidBoxPtr(void *obj){
+    return obj != NULL && ((Rsc2_Object *)obj)->magic == MAGIC_BOX && !((Rsc2_Box *)obj)->removed;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_IsValidSignalPtr(void *obj){
+    return obj != NULL && ((Rsc2_Object *)obj)->magic == MAGIC_SIGNAL;
+}
+
+/* nothing answers on names outside RSC_STANDIN_HOSTS, connecting
+ * to them takes as long as a connect timeout */
+static int is_reachable(const char *name){
+    const char *at = g.reachable;
+    int len = (int)strlen(name);
+
+    if(at == NULL)
+        return 1;
+    while((at = strstr(at, name)) != NULL){
+        if((at == g.reachable || at[-1] == ',') && (at[len] == ',' || at[len] == '\0'))
+            return 1;
+        at += len;
+    }
+    return 0;
+}
+
+RSC2CAPI Rsc2_Host *RSC2CALL Rsc2_ConnectToHost(const char *name){
+    Rsc2_Host *host = NULL;
+    int i;
+
+    InterlockedIncrement(&g.remoteCalls);
+    if(g.latencyMs > 0)
+        Sleep(g.latencyMs);
+    if(!g.initialized || name == NULL){
+        set_error("library not initialized");
+        return NULL;
+    }
+    if(!is_reachable(name)){
+        Sleep(g.unreachableMs);
+        set_error("host %s is not reachable", name);
+        return NULL;
+    }
+
+    EnterCriticalSection(&g.lock);
+    for(i = 0; i < g.numHosts; i++){
+        if(strcmp(g.hosts[i]->name, name) == 0){
+            host = g.hosts[i];
+            break;
+        }
+    }
+    if(host == NULL){
+        host = calloc(1, sizeof(Rsc2_Host));
+        host->obj.magic = MAGIC_HOST;
+        copy_text(host->name, TEXT_LEN, name);
+        host->online = 1;
+        for(i = 0; i < g.boxesPerHost; i++)
+            attach_box(host, NULL);
+        g.hosts = realloc(g.hosts, (g.numHosts + 1) * sizeof(Rsc2_Host *));
+        g.hosts[g.numHosts++] = host;
+    }
+    LeaveCriticalSection(&g.lock);
+
+    if(!host->online){
+        set_error("host %s is not reachable", name);
+        return NULL;
+    }
+    return host;
+}
+
+RSC2CAPI void RSC2CALL Rsc2_AttachHostListener(Rsc2_Host *host, Rsc2_HostListener *listener){
+    if(Rsc2_IsValidHostPtr(host))
+        host->listener = listener;
+}
+
+RSC2CAPI void RSC2CALL Rsc2_DetachHostListener(Rsc2_Host *host, Rsc2_HostListener *listener){
+    if(Rsc2_IsValidHostPtr(host) && host->listener == listener)
+        host->listener = NULL;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetNumBoxes(Rsc2_Host *host){
+    int num;
+
+    InterlockedIncrement(&g.remoteCalls);
+    if(g.latencyMs > 0)
+        Sleep(g.latencyMs);
+    if(!Rsc2_IsValidHostPtr(host) || !host->online){
+        set_error("host is not reachable");
+        return 0;
+    }
+    EnterCriticalSection(&g.lock);
+    num = host->numBoxes;
+    LeaveCriticalSection(&g.lock);
+    return num;
+}
+
+RSC2CAPI Rsc2_Box *RSC2CALL Rsc2_GetBox(Rsc2_Host *host, int index){
+    Rsc2_Box *box = NULL;
+
+    InterlockedIncrement(&g.remoteCalls);
+    if(g.latencyMs > 0)
+        Sleep(g.latencyMs);
+    if(!Rsc2_IsValidHostPtr(host) || !host->online){
+        set_error("host is not reachable");
+        return NULL;
+    }
+    EnterCriticalSection(&g.lock);
+    if(index >= 0 && index < host->numBoxes)
+        box = host->boxes[index];
+    LeaveCriticalSection(&g.lock);
+    if(box == NULL)
+        set_error("no box at index %d", index);
+    return box;
+}
+
+RSC2CAPI void RSC2CALL Rsc2_AttachBoxListener(Rsc2_Box *box, Rsc2_BoxListener *listener){
+    if(box != NULL && box->obj.magic == MAGIC_BOX)
+        box->listener = listener;
+}
+
+RSC2CAPI void RSC2CALL Rsc2_DetachBoxListener(Rsc2_Box *box, Rsc2_BoxListener *listener){
+    if(box != NULL && box->obj.magic == MAGIC_BOX && box->listener == listener)
+        box->listener = NULL;
+}
+
+static Rsc2_Result set_box_text(Rsc2_Box *box, char *field, const char *text, int type){
+    Rsc2_Result result = remote_write_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    EnterCriticalSection(&g.lock);
+    if(strcmp(field, text ? text : "") != 0){
+        copy_text(field, TEXT_LEN, text ? text : "");
+        post_event(type, box);
+    }
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+static int get_box_text(Rsc2_Box *box, const char *field, char *buf, int size){
+    int len;
+
+    if(remote_box(box) != RSC2_SUCCESS){
+        copy_text(buf, size, "");
+        return -1;
+    }
+    EnterCriticalSection(&g.lock);
+    len = copy_text(buf, size, field);
+    LeaveCriticalSection(&g.lock);
+    return len;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_SetUserLabel(Rsc2_Box *box, const char *label){
+    return set_box_text(box, box ? box->label : NULL, label, EV_USER_LABEL);
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_SetKvmAddress(Rsc2_Box *box, const char *address){
+    return set_box_text(box, box ? box->kvm : NULL, address, EV_KVM_ADDRESS);
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_LockBox(Rsc2_Box *box, const char *contactString){
+    Rsc2_Result result = remote_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    EnterCriticalSection(&g.lock);
+    copy_text(box->lockHolder, TEXT_LEN, contactString ? contactString : "rsctool");
+    box->lockedByUs = 1;
+    post_event(EV_LOCK_HOLDER, box);
+    post_event(EV_BOX_STATUS, box);
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_UnlockBox(Rsc2_Box *box){
+    Rsc2_Result result = remote_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    EnterCriticalSection(&g.lock);
+    if(box->lockHolder[0] != '\0'){
+        box->lockHolder[0] = '\0';
+        box->lockedByUs = 0;
+        post_event(EV_LOCK_HOLDER, box);
+        post_event(EV_BOX_STATUS, box);
+    }
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_SetUsbMux(Rsc2_Box *box, Rsc2_UsbMuxState state){
+    Rsc2_Result result = remote_write_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    if(state < RSC2_MUX_TO_HOST || state > RSC2_MUX_DISABLED){
+        set_error("invalid usb mux state %d", state);
+        return RSC2_ERR_COMMAND_FAILED;
+    }
+    EnterCriticalSection(&g.lock);
+    if(box->mux != state){
+        box->mux = state;
+        post_event(EV_USB_MUX, box);
+    }
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI Rsc2_Signal *RSC2CALL Rsc2_GetSignal(Rsc2_Box *box, Rsc2_SignalID signalId){
+    if(remote_box(box) != RSC2_SUCCESS)
+        return NULL;
+    if(signalId < 0 || signalId >= NUM_SIGNALS){
+        set_error("invalid signal id %d", signalId);
+        return NULL;
+    }
+    return &box->signals[signalId];
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetDescription(Rsc2_Box *box, char *buf, int size){
+    return get_box_text(box, box ? box->description : "", buf, size);
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetUserLabel(Rsc2_Box *box, char *buf, int size){
+    return get_box_text(box, box ? box->label : "", buf, size);
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetKvmAddress(Rsc2_Box *box, char *buf, int size){
+    return get_box_text(box, box ? box->kvm : "", buf, size);
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetLockHolder(Rsc2_Box *box, char *buf, int size){
+    return get_box_text(box, box ? box->lockHolder : "", buf, size);
+}
+
+RSC2CAPI Rsc2_BoxStatus RSC2CALL Rsc2_GetOnlineStatus(Rsc2_Box *box){
+    Rsc2_Result result = remote_box(box);
+
+    if(result == RSC2_ERR_REMOTE_OBJ_DISCONNECTED)
+        return RSC2_STAT_OFFLINE;
+    if(result != RSC2_SUCCESS)
+        return RSC2_STAT_UNKNOWN;
+    return box->lockHolder[0] != '\0' ? RSC2_STAT_LOCKED : RSC2_STAT_AVAILABLE;
+}
+
+RSC2CAPI Rsc2_UsbMuxState RSC2CALL Rsc2_GetUsbMuxState(Rsc2_Box *box){
+    if(remote_box(box) != RSC2_SUCCESS)
+        return RSC2_MUX_STATE_UNKNOWN;
+    return box->mux;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_PwrCycleStart(
+    Rsc2_Box *box, Rsc2_PwrCycleType cycleType, int cycleCount,
+    int bootTimeout, int startOffTime, int endOffTime,
+    int offTimeStep, int acDcDelay){
+    Rsc2_Result result = remote_write_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    if(cycleType < RSC2_PWRCYC_AC || cycleType > RSC2_PWRCYC_AC_DC || cycleCount < 1 || bootTimeout < 1
+    || startOffTime < 0 || offTimeStep < 0 || acDcDelay < 0){
+        set_error("invalid power cycling parameters");
+        return RSC2_ERR_COMMAND_FAILED;
+    }
+    EnterCriticalSection(&g.lock);
+    if(box->pwrCycle != PWRCYC_IDLE){
+        LeaveCriticalSection(&g.lock);
+        set_error("box %s is power cycling already", box->description);
+        return RSC2_ERR_COMMAND_FAILED;
+    }
+    box->pwrCycleType = cycleType;
+    box->pwrCycleCount = cycleCount;
+    box->pwrCycleDone = 0;
+    box->bootTimeoutMs = bootTimeout * 1000;
+    box->offMs = startOffTime;
+    box->endOffMs = endOffTime;
+    box->offStepMs = offTimeStep;
+    box->acDcDelayMs = acDcDelay;
+    box->pwrCycleStartedAt = now_us();
+    box->pwrCycleEndedAt = 0;
+    pwrcyc_power_off(box);
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_PwrCycleGetStatus(Rsc2_Box *box, Rsc2_PwrCycleStatus *status){
+    Rsc2_Result result = remote_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    if(status == NULL)
+        return RSC2_SUCCESS;
+    memset(status, 0, sizeof(*status));
+    EnterCriticalSection(&g.lock);
+    status->type = box->pwrCycleType;
+    status->numCycles = (unsigned short)box->pwrCycleDone;
+    status->continueWaitTimeSecs = (unsigned short)g.continueWaitS;
+    status->offTimeMSecs = (unsigned short)box->offMs;
+    status->isCyclingInProgress = box->pwrCycle != PWRCYC_IDLE;
+    status->isPhaseErrorDetected = box->pwrCycle >= PWRCYC_WAITING;
+    status->isTimedOutWaitingForContinue = box->pwrCycle == PWRCYC_TIMED_OUT;
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_PwrCycleStop(Rsc2_Box *box){
+    Rsc2_Result result = remote_write_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    EnterCriticalSection(&g.lock);
+    if(box->pwrCycle != PWRCYC_IDLE)
+        pwrcyc_end(box);
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+/* after a phase error the firmware retries the cycle that failed */
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_PwrCycleContinue(Rsc2_Box *box){
+    Rsc2_Result result = remote_write_box(box);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    EnterCriticalSection(&g.lock);
+    if(box->pwrCycle == PWRCYC_IDLE){
+        set_error("box %s is not power cycling", box->description);
+        result = RSC2_ERR_COMMAND_FAILED;
+    }else if(box->pwrCycle >= PWRCYC_WAITING){
+        pwrcyc_power_off(box);
+    }
+    LeaveCriticalSection(&g.lock);
+    return result;
+}
+
+/* in seconds */
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_PwrCycleGetTotalTime(Rsc2_Box *box, int *time){
+    Rsc2_Result result = remote_box(box);
+
+    if(result != RSC2_SUCCESS || time == NULL)
+        return result;
+    EnterCriticalSection(&g.lock);
+    if(box->pwrCycleStartedAt == 0)
+        *time = 0;
+    else
+        *time = (int)(((box->pwrCycleEndedAt ? box->pwrCycleEndedAt : now_us()) - box->pwrCycleStartedAt) / 1000000);
+    LeaveCriticalSection(&g.lock);
+    return result;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_SetSigAssertionState(Rsc2_Signal *sig, Rsc2_SignalState state){
+    Rsc2_Result result = remote_write_signal(sig);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    if(is_input(sig->id)){
+        set_error("%s is an input", assignedNames[sig->id]);
+        return RSC2_ERR_COMMAND_FAILED;
+    }
+    EnterCriticalSection(&g.lock);
+    if(sig->state != (state ? RSC2_SIG_ASSERTED : RSC2_SIG_DEASSERTED)){
+        sig->state = state ? RSC2_SIG_ASSERTED : RSC2_SIG_DEASSERTED;
+        post_event(EV_SIG_STATE, sig);
+        sut_output_changed(sig->box, sig->id);
+    }
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI Rsc2_SignalState RSC2CALL Rsc2_GetSigAssertionState(Rsc2_Signal *sig){
+    if(remote_signal(sig) != RSC2_SUCCESS)
+        return (Rsc2_SignalState)-1;
+    return sig->state;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_SetSigAssertionType(Rsc2_Signal *sig, Rsc2_AssertionType type){
+    Rsc2_Result result = remote_write_signal(sig);
+
+    if(result == RSC2_SUCCESS)
+        sig->assertion = type;
+    return result;
+}
+
+RSC2CAPI Rsc2_AssertionType RSC2CALL Rsc2_GetSigAssertionType(Rsc2_Signal *sig){
+    if(remote_signal(sig) != RSC2_SUCCESS)
+        return (Rsc2_AssertionType)-1;
+    return sig->assertion;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetSigName(Rsc2_Signal *sig, char *buf, int size){
+    int len;
+
+    if(remote_signal(sig) != RSC2_SUCCESS){
+        copy_text(buf, size, "");
+        return -1;
+    }
+    EnterCriticalSection(&g.lock);
+    len = copy_text(buf, size, sig->name);
+    LeaveCriticalSection(&g.lock);
+    return len;
+}
+
+RSC2CAPI Rsc2_Result RSC2CALL Rsc2_SetSigName(Rsc2_Signal *sig, const char *name){
+    Rsc2_Result result = remote_write_signal(sig);
+
+    if(result != RSC2_SUCCESS)
+        return result;
+    EnterCriticalSection(&g.lock);
+    if(strcmp(sig->name, name ? name : "") != 0){
+        copy_text(sig->name, TEXT_LEN, name ? name : "");
+        post_event(EV_SIG_LABEL, sig);
+    }
+    LeaveCriticalSection(&g.lock);
+    return RSC2_SUCCESS;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_GetSigGenericName(Rsc2_Signal *sig, char *buf, int size){
+    if(sig == NULL || sig->obj.magic != MAGIC_SIGNAL){
+        copy_text(buf, size, "");
+        return 0;
+    }
+    return copy_text(buf, size, genericNames[sig->id]);
+}
+
+RSC2CAPI Rsc2_SignalType RSC2CALL Rsc2_GetSigType(Rsc2_Signal *sig){
+    if(remote_signal(sig) != RSC2_SUCCESS)
+        return (Rsc2_SignalType)-1;
+    return sig->type;
+}
+
+RSC2CAPI void RSC2CALL Rsc2_SetSigType(Rsc2_Signal *sig, Rsc2_SignalType type){
+    if(remote_write_signal(sig) == RSC2_SUCCESS)
+        sig->type = type;
+}
+
+RSC2CAPI const char **RSC2CALL Rsc2_GetSignalStateStrings(){
+    return stateStrings;
+}
+
+RSC2CAPI const char **RSC2CALL Rsc2_GetSignalIDAssignmentStrings(){
+    return assignedNames;
+}
+
+RSC2CAPI const char **RSC2CALL Rsc2_GetSignalIDGenericStrings(){
+    return genericNames;
+}
+
+RSC2CAPI const char *RSC2CALL Rsc2_BoxStatusToString(Rsc2_BoxStatus status){
+    if(status < RSC2_STAT_UNKNOWN || status > RSC2_STAT_UPDATE_IN_PROG)
+        return "";
+    return boxStatusStrings[status];
+}
+
+RSC2CAPI const char *RSC2CALL Rsc2_UsbMuxStateToString(Rsc2_UsbMuxState state){
+    if(state < RSC2_MUX_STATE_UNKNOWN || state > RSC2_MUX_DISABLED)
+        return "";
+    return muxStrings[state];
+}
+
+RSC2CAPI const char *RSC2CALL Rsc2_SignalStateToString(Rsc2_SignalState state, Rsc2_SignalType type){
+    switch(type){
+    case RSC2_JUMPER:
+        return state ? "RSC2_JMP_ENABLED" : "RSC2_JMP_DISABLED";
+    case RSC2_BUTTON:
+        return state ? "RSC2_BUTTON_PRESSED" : "RSC2_BUTTON_RELEASED";
+    case RSC2_AC_PORT:
+        return state ? "RSC2_AC_ON" : "RSC2_AC_OFF";
+    case RSC2_LED:
+        return state ? "RSC2_LED_ON" : "RSC2_LED_OFF";
+    default:
+        return state ? "RSC2_SIG_ASSERTED" : "RSC2_SIG_DEASSERTED";
+    }
+}
+
+RSC2CAPI const char *RSC2CALL Rsc2_SignalIDToGenericString(Rsc2_SignalID id){
+    return id >= 0 && id < NUM_SIGNALS ? genericNames[id] : "";
+}
+
+RSC2CAPI const char *RSC2CALL Rsc2_SignalIDToAssignedString(Rsc2_SignalID id){
+    return id >= 0 && id < NUM_SIGNALS ? assignedNames[id] : "";
+}
+
+static int lookup(const Rsc2_SymRec *table, const char *name, int *value){
+    int i;
+
+    for(i = 0; name != NULL && table[i].name != NULL; i++){
+        if(strcmp(table[i].name, name) == 0){
+            *value = table[i].value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+RSC2CAPI const char *RSC2CALL Rsc2_ResultCodeToString(Rsc2_Result rcode){
+    int i;
+
+    for(i = 0; resultTable[i].name != NULL; i++){
+        if(resultTable[i].value == rcode)
+            return resultTable[i].name;
+    }
+    return "";
+}
+
+RSC2CAPI int RSC2CALL Rsc2_StringToBoxStatus(const char *sstatus, Rsc2_BoxStatus *status){
+    int value;
+
+    if(lookup(boxStatusTable, sstatus, &value) != 0)
+        return -1;
+    *status = (Rsc2_BoxStatus)value;
+    return 0;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_StringToUsbMuxState(const char *sstate, Rsc2_UsbMuxState *state){
+    int value;
+
+    if(lookup(muxTable, sstate, &value) != 0)
+        return -1;
+    *state = (Rsc2_UsbMuxState)value;
+    return 0;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_StringToSignalState(const char *sstate, Rsc2_SignalState *state){
+    int value;
+
+    if(lookup(sigStateTable, sstate, &value) != 0)
+        return -1;
+    *state = (Rsc2_SignalState)value;
+    return 0;
+}
+
+RSC2CAPI int RSC2CALL Rsc2_StringToSignalID(const char *ssigID, Rsc2_SignalID *sigID){
+    int value;
+
+    if(lookup(sigIdTable, ssigID, &value) != 0)
+        return -1;
+    *sigID = (Rsc2_SignalID)value;
+    return 0;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetSigIDTable(){
+    return sigIdTable;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetSigStateTable(){
+    return sigStateTable;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetSigTypeTable(){
+    return sigTypeTable;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetAssertionTypeTable(){
+    return assertionTable;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetUsbMuxStateTable(){
+    return muxTable;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetBoxStatusTable(){
+    return boxStatusTable;
+}
+
+RSC2CAPI const Rsc2_SymRec *RSC2CALL Rsc2_GetResultCodeTable(){
+    return resultTable;
+}
+
+/* fault injection */
+
+void standin_set_host_online(Rsc2_Host *host, int online){
+    if(!Rsc2_IsValidHostPtr(host))
+        return;
+    EnterCriticalSection(&g.lock);
+    if(host->online != online){
+        host->online = online;
+        post_event(online ? EV_HOST_ONLINE : EV_HOST_OFFLINE, host);
+    }
+    LeaveCriticalSection(&g.lock);
+}
+
+void standin_remove_box(Rsc2_Box *box){
+    Rsc2_Host *host = NULL;
+    int i;
+
+    if(!Rsc2_IsValidBoxPtr(box))
+        return;
+    host = box->host;
+    EnterCriticalSection(&g.lock);
+    for(i = 0; i < host->numBoxes; i++){
+        if(host->boxes[i] == box){
+            memmove(&host->boxes[i], &host->boxes[i + 1], (host->numBoxes - i - 1) * sizeof(Rsc2_Box *));
+            host->numBoxes--;
+            break;
+        }
+    }
+    box->removed = 1;
+    post_event(EV_BOX_REMOVED, box);
+    LeaveCriticalSection(&g.lock);
+}
+
+Rsc2_Box *standin_readd_box(Rsc2_Box *box){
+    Rsc2_Box *added = NULL;
+
+    if(box == NULL || box->obj.magic != MAGIC_BOX || !box->removed)
+        return NULL;
+    EnterCriticalSection(&g.lock);
+    added = attach_box(box->host, box);
+    added->lockHolder[0] = '\0';
+    added->lockedByUs = 0;
+    post_event(EV_BOX_ADDED, added);
+    LeaveCriticalSection(&g.lock);
+    return added;
+}
+
+void standin_lock_box(Rsc2_Box *box, const char *holder){
+    if(box == NULL || box->obj.magic != MAGIC_BOX)
+        return;
+    EnterCriticalSection(&g.lock);
+    copy_text(box->lockHolder, TEXT_LEN, holder ? holder : "");
+    box->lockedByUs = 0;
+    post_event(EV_LOCK_HOLDER, box);
+    post_event(EV_BOX_STATUS, box);
+    LeaveCriticalSection(&g.lock);
+}
+
+void standin_set_boxes_per_host(int count){
+    EnterCriticalSection(&g.lock);
+    g.boxesPerHost = count;
+    LeaveCriticalSection(&g.lock);
+}
+
+long standin_remote_calls(void){
+    return g.remoteCalls;
+}
+
+void standin_set_post_error(Rsc2_Box *box, int pulses){
+    if(box == NULL || box->obj.magic != MAGIC_BOX)
+        return;
+    EnterCriticalSection(&g.lock);
+    box->postError = pulses;
+    LeaveCriticalSection(&g.lock);
+}
+
+void standin_hang_sut(Rsc2_Box *box, int depth){
+    if(box == NULL || box->obj.magic != MAGIC_BOX)
+        return;
+    EnterCriticalSection(&g.lock);
+    if(box->sut != SUT_OFF){
+        box->sutGeneration++;
+        box->sut = SUT_HUNG;
+        box->hangDepth = depth;
+        set_input(box, RSC2_ID_LED_STATUS_GREEN, 0);
+    }
+    LeaveCriticalSection(&g.lock);
+}
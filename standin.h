@@ -0,0 +1,72 @@
+#ifndef STANDIN_H
+#define STANDIN_H
+
+#include "common.h"
+
+/**************************************************
+* stand-in rsc2 backend (standin.c)
+* an in-process replacement for Rsc2CApi.dll that is
+* linked instead of the real library by the Standin
+* build target (RSC_STANDIN and RSC2CAPI_EXPORTS are
+* defined there). every host name connects to a
+* simulated host unless RSC_STANDIN_HOSTS lists the
+* reachable ones. environment:
+*   RSC_STANDIN_BOXES       boxes per host (default 4)
+*   RSC_STANDIN_LATENCY_MS  cost of a remote call (default 0)
+*   RSC_STANDIN_BOOT_MS     post duration of the suts (default 3000)
+*   RSC_STANDIN_HOSTS       reachable host names, comma separated (default all)
+*   RSC_STANDIN_UNREACHABLE_MS  time to fail connecting elsewhere (default 5000)
+*   RSC_STANDIN_CONTINUE_WAIT_S time the firmware power cycling waits for a
+*                               continue after a phase error (default 30)
+*   RSC_STANDIN_LOOPBACK_US     delay of the aux a output to input loopback,
+*                               base of a per box spread (default 1500, 0 = not wired)
+* each box models a system under test: ac ports power it,
+* the power button switches it (a hung sut only on a 4 s
+* press), post blinks the green status led and then
+* leaves it on. firmware power cycling removes power for
+* the off time, restores it and counts the cycle when the
+* sut has booted; a sut that does not boot within the
+* boot timeout is a phase error, and cycling pauses until
+* a continue retries that cycle.
+* aux a output is wired back to aux a input, which
+* follows it after the box's loopback delay.
+* the functions below inject faults and inspect the
+* simulation; they do not exist in the real library.
+**************************************************/
+
+/* takes a host off the network or brings it back.
+ * while offline every remote call fails with
+ * RSC2_ERR_REMOTE_OBJ_DISCONNECTED and connecting to it fails. */
+void standin_set_host_online(Rsc2_Host *host, int online);
+
+/* unplugs a box from its host. the Rsc2_Box pointer stays
+ * allocated but every call on it fails with RSC2_ERR_INVALID_OBJ_REF. */
+void standin_remove_box(Rsc2_Box *box);
+
+/* plugs a removed box back in. the unit keeps its description,
+ * labels and signal settings but gets a new Rsc2_Box object,
+ * the same way the real library reports a re-attached unit. */
+Rsc2_Box *standin_readd_box(Rsc2_Box *box);
+
+/* another user takes (holder != NULL) or drops (holder == NULL)
+ * the box lock. writes fail with RSC2_ERR_BOX_LOCKED meanwhile. */
+void standin_lock_box(Rsc2_Box *box, const char *holder);
+
+/* makes the next boots of the sut fail post: instead of turning
+ * the green led on it blinks the amber led "pulses" times, pauses
+ * and repeats. 0 lets it boot normally again. */
+void standin_set_post_error(Rsc2_Box *box, int pulses);
+
+/* hangs a running sut: the green led goes off and the sut ignores
+ * the reset button (depth 2) or also a 4 s power button press
+ * (depth 3, only removing ac helps). depth 1 still takes a reset. */
+void standin_hang_sut(Rsc2_Box *box, int depth);
+
+/* the number of boxes of the hosts connected from now on,
+ * in place of RSC_STANDIN_BOXES */
+void standin_set_boxes_per_host(int count);
+
+/* number of calls that reached the simulated rsc2 servers */
+long standin_remote_calls(void);
+
+#endif /* STANDIN_H */
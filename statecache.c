@@ -0,0 +1,345 @@
+#include "statecache.h"
+
+#define HOLDER_LEN      64
+#define OPEN_THREADS    32
+
+typedef struct CacheBox CacheBox;
+
+typedef struct
+{
+    volatile LONG value;
+    volatile LONGLONG confirmedAt;      /* 0 while unknown */
+    volatile LONG generation;           /* bumped by every event, under the box lock */
+} CacheValue;
+
+typedef struct
+{
+    CacheBox *owner;
+    CacheValue state;
+} CacheSignal;
+
+typedef struct
+{
+    StateCache *cache;
+    volatile LONGLONG heardAt;          /* last event or live read from the host */
+    volatile LONG online;
+} CacheHost;
+
+struct CacheBox
+{
+    CacheHost *host;
+    Rsc2_Box *box;
+    Rsc2_Signal *signals[NUM_SIGNALS];
+    CacheSignal sig[NUM_SIGNALS];
+    CacheValue status;
+    CacheValue mux;
+    CacheValue holder;                  /* the text is in holderText */
+    char holderText[HOLDER_LEN];
+    CRITICAL_SECTION lock;
+};
+
+struct StateCache
+{
+    Fleet *fleet;
+    CacheHost hosts[MAX_HOSTS];
+    CacheBox *boxes;
+    Rsc2_BoxListener boxListener;
+    Rsc2_HostListener hostListener;
+    volatile LONG hits;
+    volatile LONG liveReads;
+};
+
+/* 64 bit loads and stores are not atomic on 32 bit windows */
+static long long load64(volatile LONGLONG *p){
+    return InterlockedCompareExchange64(p, 0, 0);
+}
+
+static void store64(volatile LONGLONG *p, long long value){
+    InterlockedExchange64(p, value);
+}
+
+static int is_fresh(CacheBox *cb, CacheValue *v, int maxStalenessMs){
+    long long confirmed = load64(&v->confirmedAt);
+    long long heard = load64(&cb->host->heardAt);
+
+    if(confirmed == 0 || !cb->host->online)
+        return 0;
+    if(heard > confirmed)
+        confirmed = heard;
+    return now_us() - confirmed <= (long long)maxStalenessMs * 1000;
+}
+
+static void heard(CacheHost *host){
+    store64(&host->heardAt, now_us());
+}
+
+/* stores a live read unless an event arrived while it was in flight */
+static void confirm(CacheBox *cb, CacheValue *v, LONG generation, LONG value){
+    if(!cb->host->online)
+        return;
+    EnterCriticalSection(&cb->lock);
+    if(v->generation == generation){
+        v->value = value;
+        store64(&v->confirmedAt, now_us());
+    }
+    LeaveCriticalSection(&cb->lock);
+    heard(cb->host);
+}
+
+static void invalidate(CacheBox *cb, CacheValue *v){
+    EnterCriticalSection(&cb->lock);
+    v->generation++;
+    store64(&v->confirmedAt, 0);
+    LeaveCriticalSection(&cb->lock);
+}
+
+static void invalidate_box(CacheBox *cb){
+    int i;
+
+    for(i = 0; i < NUM_SIGNALS; i++)
+        invalidate(cb, &cb->sig[i].state);
+    invalidate(cb, &cb->status);
+    invalidate(cb, &cb->mux);
+    invalidate(cb, &cb->holder);
+}
+
+/* the events below run on the library's event thread */
+
+/* the event does not say the new state and flipping the cached one
+ * goes wrong once a live read already stored it, so the next reader
+ * reads it again */
+static void on_sig_state_changed(Rsc2_Signal *sig){
+    CacheSignal *cs = Rsc2_GetObjectClientData((Rsc2_Object *)sig);
+
+    if(cs == NULL)
+        return;
+    invalidate(cs->owner, &cs->state);
+    heard(cs->owner->host);
+}
+
+static void on_box_status_changed(Rsc2_Box *box){
+    CacheBox *cb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+
+    if(cb == NULL)
+        return;
+    invalidate(cb, &cb->status);
+    heard(cb->host);
+}
+
+static void on_lock_holder_changed(Rsc2_Box *box){
+    CacheBox *cb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+
+    if(cb == NULL)
+        return;
+    invalidate(cb, &cb->holder);
+    invalidate(cb, &cb->status);
+    heard(cb->host);
+}
+
+static void on_usb_mux_changed(Rsc2_Box *box){
+    CacheBox *cb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+
+    if(cb == NULL)
+        return;
+    invalidate(cb, &cb->mux);
+    heard(cb->host);
+}
+
+static void on_box_removed(Rsc2_Host *host, Rsc2_Box *box){
+    CacheBox *cb = Rsc2_GetObjectClientData((Rsc2_Object *)box);
+
+    (void)host;
+    if(cb != NULL)
+        invalidate_box(cb);
+}
+
+static void on_host_offline(Rsc2_Host *host){
+    CacheHost *ch = Rsc2_GetObjectClientData((Rsc2_Object *)host);
+
+    if(ch != NULL)
+        InterlockedExchange(&ch->online, 0);
+}
+
+/* events may have been missed while offline, forget the host's values */
+static void on_host_online(Rsc2_Host *host){
+    CacheHost *ch = Rsc2_GetObjectClientData((Rsc2_Object *)host);
+    int i;
+
+    if(ch == NULL)
+        return;
+    for(i = 0; i < ch->cache->fleet->numBoxes; i++){
+        if(ch->cache->boxes[i].host == ch)
+            invalidate_box(&ch->cache->boxes[i]);
+    }
+    InterlockedExchange(&ch->online, 1);
+}
+
+Rsc2_SignalState state_cache_signal(StateCache *cache, int box, Rsc2_SignalID id, int maxStalenessMs){
+    CacheBox *cb = &cache->boxes[box];
+    CacheValue *v = &cb->sig[id].state;
+    LONG generation;
+    int state;
+
+    if(is_fresh(cb, v, maxStalenessMs)){
+        InterlockedIncrement(&cache->hits);
+        return (Rsc2_SignalState)v->value;
+    }
+    InterlockedIncrement(&cache->liveReads);
+    generation = v->generation;
+    /* an int, the enum may be unsigned and a failed read is -1 */
+    state = Rsc2_GetSigAssertionState(cb->signals[id]);
+    if(state >= 0)
+        confirm(cb, v, generation, state);
+    return (Rsc2_SignalState)state;
+}
+
+Rsc2_BoxStatus state_cache_status(StateCache *cache, int box, int maxStalenessMs){
+    CacheBox *cb = &cache->boxes[box];
+    CacheValue *v = &cb->status;
+    LONG generation;
+    Rsc2_BoxStatus status;
+
+    if(is_fresh(cb, v, maxStalenessMs)){
+        InterlockedIncrement(&cache->hits);
+        return (Rsc2_BoxStatus)v->value;
+    }
+    InterlockedIncrement(&cache->liveReads);
+    generation = v->generation;
+    status = Rsc2_GetOnlineStatus(cb->box);
+    if(status != RSC2_STAT_OFFLINE && status != RSC2_STAT_UNKNOWN)
+        confirm(cb, v, generation, status);
+    return status;
+}
+
+Rsc2_UsbMuxState state_cache_usb_mux(StateCache *cache, int box, int maxStalenessMs){
+    CacheBox *cb = &cache->boxes[box];
+    CacheValue *v = &cb->mux;
+    LONG generation;
+    Rsc2_UsbMuxState state;
+
+    if(is_fresh(cb, v, maxStalenessMs)){
+        InterlockedIncrement(&cache->hits);
+        return (Rsc2_UsbMuxState)v->value;
+    }
+    InterlockedIncrement(&cache->liveReads);
+    generation = v->generation;
+    state = Rsc2_GetUsbMuxState(cb->box);
+    if(state != RSC2_MUX_STATE_UNKNOWN)
+        confirm(cb, v, generation, state);
+    return state;
+}
+
+int state_cache_lock_holder(StateCache *cache, int box, char *buf, int size, int maxStalenessMs){
+    CacheBox *cb = &cache->boxes[box];
+    CacheValue *v = &cb->holder;
+    char text[HOLDER_LEN];
+    LONG generation;
+    int len;
+
+    if(is_fresh(cb, v, maxStalenessMs)){
+        InterlockedIncrement(&cache->hits);
+        EnterCriticalSection(&cb->lock);
+        len = snprintf(buf, size, "%s", cb->holderText);
+        LeaveCriticalSection(&cb->lock);
+        return len;
+    }
+    InterlockedIncrement(&cache->liveReads);
+    generation = v->generation;
+    len = Rsc2_GetLockHolder(cb->box, text, HOLDER_LEN);
+    if(len < 0){
+        snprintf(buf, size, "%s", "");
+        return -1;
+    }
+    EnterCriticalSection(&cb->lock);
+    if(v->generation == generation)
+        strcpy(cb->holderText, text);
+    LeaveCriticalSection(&cb->lock);
+    confirm(cb, v, generation, 0);
+    return snprintf(buf, size, "%s", text);
+}
+
+void state_cache_counts(StateCache *cache, long *hits, long *liveReads){
+    *hits = cache->hits;
+    *liveReads = cache->liveReads;
+}
+
+static void open_box(int index, void *ctx){
+    StateCache *cache = ctx;
+    CacheBox *cb = &cache->boxes[index];
+    char holder[HOLDER_LEN];
+    int i;
+
+    cb->box = cache->fleet->boxes[index].box;
+    cb->host = &cache->hosts[cache->fleet->boxes[index].hostIndex];
+    InitializeCriticalSection(&cb->lock);
+    for(i = 0; i < NUM_SIGNALS; i++){
+        cb->signals[i] = Rsc2_GetSignal(cb->box, (Rsc2_SignalID)i);
+        cb->sig[i].owner = cb;
+        if(cb->signals[i] != NULL)
+            Rsc2_SetObjectClientData((Rsc2_Object *)cb->signals[i], &cb->sig[i]);
+    }
+    Rsc2_SetObjectClientData((Rsc2_Object *)cb->box, cb);
+    /* listen first, a change during the reads below then drops the value read */
+    Rsc2_AttachBoxListener(cb->box, &cache->boxListener);
+    for(i = 0; i < NUM_SIGNALS; i++)
+        state_cache_signal(cache, index, (Rsc2_SignalID)i, 0);
+    state_cache_status(cache, index, 0);
+    state_cache_usb_mux(cache, index, 0);
+    state_cache_lock_holder(cache, index, holder, HOLDER_LEN, 0);
+}
+
+StateCache *state_cache_open(Fleet *fleet){
+    StateCache *cache = calloc(1, sizeof(StateCache));
+    int i;
+
+    cache->fleet = fleet;
+    cache->boxes = calloc(fleet->numBoxes + 1, sizeof(CacheBox));
+    cache->boxListener.sigStateChanged = on_sig_state_changed;
+    cache->boxListener.boxStatusChanged = on_box_status_changed;
+    cache->boxListener.lockHolderChanged = on_lock_holder_changed;
+    cache->boxListener.usbMuxChanged = on_usb_mux_changed;
+    cache->hostListener.boxRemoved = on_box_removed;
+    cache->hostListener.hostOffline = on_host_offline;
+    cache->hostListener.hostOnline = on_host_online;
+    for(i = 0; i < fleet->numHosts; i++){
+        cache->hosts[i].cache = cache;
+        cache->hosts[i].online = 1;
+        Rsc2_SetObjectClientData((Rsc2_Object *)fleet->hosts[i], &cache->hosts[i]);
+        Rsc2_AttachHostListener(fleet->hosts[i], &cache->hostListener);
+    }
+    parallel_for(fleet->numBoxes, OPEN_THREADS, open_box, cache);
+    for(i = 0; i < fleet->numBoxes; i++){
+        if(cache->boxes[i].signals[0] == NULL){
+            print_rsc_error("unable to read box state");
+            state_cache_close(cache);
+            return NULL;
+        }
+    }
+    /* the priming reads are not what callers should see in the counts */
+    cache->hits = 0;
+    cache->liveReads = 0;
+    return cache;
+}
+
+void state_cache_close(StateCache *cache){
+    int i;
+
+    for(i = 0; i < cache->fleet->numHosts; i++){
+        Rsc2_DetachHostListener(cache->fleet->hosts[i], &cache->hostListener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)cache->fleet->hosts[i], NULL);
+    }
+    for(i = 0; i < cache->fleet->numBoxes; i++){
+        CacheBox *cb = &cache->boxes[i];
+        int j;
+
+        Rsc2_DetachBoxListener(cb->box, &cache->boxListener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)cb->box, NULL);
+        for(j = 0; j < NUM_SIGNALS; j++){
+            if(cb->signals[j] != NULL)
+                Rsc2_SetObjectClientData((Rsc2_Object *)cb->signals[j], NULL);
+        }
+        DeleteCriticalSection(&cb->lock);
+    }
+    free(cache->boxes);
+    free(cache);
+}
@@ -0,0 +1,40 @@
+#ifndef STATECACHE_H
+#define STATECACHE_H
+
+#include "common.h"
+
+/**************************************************
+* listener maintained box state cache
+* attaches a box listener to every box of a fleet
+* (and a host listener to every host) and keeps
+* signal states, box status, usb mux position and
+* lock holder current from the events, so reads do
+* not go to the rsc2 server.
+* a value counts as confirmed when it was read live,
+* or when any event or live read came from its host
+* since (the host connection is then known to deliver
+* events). an event about a value drops it, so the
+* next read of it goes to the server. reads older
+* than maxStalenessMs, and all reads while the host
+* is offline, go to the server instead.
+* the cache owns the box and host listeners and the
+* client data of the hosts, boxes and signals.
+**************************************************/
+
+typedef struct StateCache StateCache;
+
+/* reads everything once and attaches the listeners. NULL on failure */
+StateCache *state_cache_open(Fleet *fleet);
+void state_cache_close(StateCache *cache);
+
+/* "box" indexes fleet->boxes */
+Rsc2_SignalState state_cache_signal(StateCache *cache, int box, Rsc2_SignalID id, int maxStalenessMs);
+Rsc2_BoxStatus state_cache_status(StateCache *cache, int box, int maxStalenessMs);
+Rsc2_UsbMuxState state_cache_usb_mux(StateCache *cache, int box, int maxStalenessMs);
+/* -1 and an empty buf when the read failed, which is not cached */
+int state_cache_lock_holder(StateCache *cache, int box, char *buf, int size, int maxStalenessMs);
+
+/* reads served from the cache and reads that went to the server */
+void state_cache_counts(StateCache *cache, long *hits, long *liveReads);
+
+#endif /* STATECACHE_H */
@@ -0,0 +1,189 @@
+#include "common.h"
+#include "commands.h"
+#include "statecache.h"
+#include "fleetshm.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool status [--hosts h1,h2] [--max-staleness ms]
+*                [--bench n] [--threads n] [--shm]
+* prints status, usb mux, lock holder, ac ports and
+* leds of every box, read through the listener
+* maintained state cache (statecache.c): values are
+* at most --max-staleness ms (default 1000) older
+* than the last event or live read from their host.
+* --bench then does n more reads of random boxes and
+* signals from --threads threads and reports the
+* time per read and how many reached the server.
+* --shm [--name mapping] reads the table written by
+* "rsctool publish" instead and connects to nothing;
+* a table whose heartbeat does not move for 3
+* publish intervals is reported as stale.
+**************************************************/
+
+#define DESC_LEN        64
+#define HOLDER_LEN      64
+#define ROW_FORMAT      "%-24s %-22s %-17s %-12s %-4s %-4s %-4s %-5s %-5s\n"
+#define STALE_PASSES    3       /* publish passes without a heartbeat and the table is stale */
+
+typedef struct
+{
+    StateCache *cache;
+    FleetShm *shm;              /* read from here instead when set */
+    int numBoxes;
+    int reads;
+    int maxStalenessMs;
+    volatile LONGLONG elapsedUs;
+} StatusBench;
+
+/* "?" for a failed read */
+static const char *on_off(int state){
+    return state == RSC2_SIG_ASSERTED ? "on" : state == RSC2_SIG_DEASSERTED ? "off" : "?";
+}
+
+static void bench_thread(int index, void *ctx){
+    StatusBench *bench = ctx;
+    unsigned int seed = 2654435761u * (index + 1);
+    long long startedAt = now_us();
+    int i;
+
+    for(i = 0; i < bench->reads; i++){
+        seed = seed * 1103515245 + 12345;
+        if(bench->shm != NULL){
+            FleetShmBox box;
+
+            fleet_shm_read(bench->shm, (seed >> 8) % bench->numBoxes, &box);
+        }else{
+            state_cache_signal(bench->cache, (seed >> 8) % bench->numBoxes,
+                               (Rsc2_SignalID)((seed >> 4) % NUM_SIGNALS), bench->maxStalenessMs);
+        }
+    }
+    InterlockedExchangeAdd64(&bench->elapsedUs, now_us() - startedAt);
+}
+
+static int status_from_shm(int argc, char *argv[]){
+    const char *name = opt_str(argc, argv, "--name", FLEET_SHM_NAME);
+    int reads = opt_int(argc, argv, "--bench", 0);
+    int threads = opt_int(argc, argv, "--threads", 4);
+    StatusBench bench;
+    FleetShm shm;
+    FleetShmBox box;
+    long long sampledAt, waitUs;
+    LONG heartbeat;
+    int numBoxes, i;
+
+    if(threads < 1){
+        printf("--threads must be 1 or more\n");
+        return -1;
+    }
+    if(fleet_shm_open(&shm, name) != 0){
+        printf("no fleet state published as %s, start rsctool publish\n", name);
+        return -1;
+    }
+    heartbeat = shm.header->heartbeat;
+    sampledAt = now_us();
+    numBoxes = shm.header->numBoxes;
+    printf(ROW_FORMAT, "box", "status", "usb mux", "lock holder", "ac1", "ac2", "pwr", "green", "amber");
+    for(i = 0; i < numBoxes; i++){
+        if(fleet_shm_read(&shm, i, &box) != 0){
+            printf("box %d: unreadable, the publisher stopped in the middle of a write\n", i);
+            continue;
+        }
+        printf(ROW_FORMAT, box.description, Rsc2_BoxStatusToString((Rsc2_BoxStatus)box.status),
+               Rsc2_UsbMuxStateToString((Rsc2_UsbMuxState)box.usbMux), box.lockHolder[0] ? box.lockHolder : "-",
+               on_off(box.signals[RSC2_ID_AC_1]), on_off(box.signals[RSC2_ID_AC_2]),
+               on_off(box.signals[RSC2_ID_LED_PWR]), on_off(box.signals[RSC2_ID_LED_STATUS_GREEN]),
+               on_off(box.signals[RSC2_ID_LED_STATUS_AMBER]));
+    }
+    /* a publisher that died leaves the table behind while readers map it */
+    waitUs = (long long)STALE_PASSES * (shm.header->intervalMs > 0 ? shm.header->intervalMs : 1) * 1000;
+    if(now_us() - sampledAt < waitUs)
+        Sleep((DWORD)((waitUs - (now_us() - sampledAt)) / 1000 + 1));
+    if(shm.header->heartbeat == heartbeat)
+        printf("stale: process %ld published no pass in %lld ms (pass %ld), the publisher is not running\n",
+               shm.header->publisherPid, (now_us() - sampledAt) / 1000, heartbeat);
+    else
+        printf("published by process %ld, pass %ld\n", shm.header->publisherPid, shm.header->heartbeat);
+
+    if(reads > 0 && numBoxes > 0){
+        memset(&bench, 0, sizeof(bench));
+        bench.shm = &shm;
+        bench.numBoxes = numBoxes;
+        bench.reads = reads / threads;
+        parallel_for(threads, threads, bench_thread, &bench);
+        printf("%d box reads from %d threads: %.0f ns per read\n", bench.reads * threads, threads,
+               bench.elapsedUs * 1000.0 / (bench.reads * threads));
+    }
+    fleet_shm_close(&shm);
+    return 0;
+}
+
+int status_main(int argc, char *argv[]){
+    int maxStalenessMs = opt_int(argc, argv, "--max-staleness", 1000);
+    int reads = opt_int(argc, argv, "--bench", 0);
+    int threads = opt_int(argc, argv, "--threads", 4);
+    StatusBench bench;
+    StateCache *cache = NULL;
+    Fleet fleet;
+    long hits, liveReads, benchHits, benchLive;
+    int i;
+
+    if(opt_flag(argc, argv, "--shm"))
+        return status_from_shm(argc, argv);
+    if(threads < 1){
+        printf("--threads must be 1 or more\n");
+        return -1;
+    }
+    if(fleet_open(&fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    cache = state_cache_open(&fleet);
+    if(cache == NULL)
+        return -1;
+
+    printf(ROW_FORMAT, "box", "status", "usb mux",
+           "lock holder", "ac1", "ac2", "pwr", "green", "amber");
+    for(i = 0; i < fleet.numBoxes; i++){
+        char description[DESC_LEN], holder[HOLDER_LEN];
+        int holderLen;
+
+        Rsc2_GetDescription(fleet.boxes[i].box, description, DESC_LEN);
+        holderLen = state_cache_lock_holder(cache, i, holder, HOLDER_LEN, maxStalenessMs);
+        printf(ROW_FORMAT, description,
+               Rsc2_BoxStatusToString(state_cache_status(cache, i, maxStalenessMs)),
+               Rsc2_UsbMuxStateToString(state_cache_usb_mux(cache, i, maxStalenessMs)),
+               holderLen < 0 ? "?" : holder[0] ? holder : "-",
+               on_off(state_cache_signal(cache, i, RSC2_ID_AC_1, maxStalenessMs)),
+               on_off(state_cache_signal(cache, i, RSC2_ID_AC_2, maxStalenessMs)),
+               on_off(state_cache_signal(cache, i, RSC2_ID_LED_PWR, maxStalenessMs)),
+               on_off(state_cache_signal(cache, i, RSC2_ID_LED_STATUS_GREEN, maxStalenessMs)),
+               on_off(state_cache_signal(cache, i, RSC2_ID_LED_STATUS_AMBER, maxStalenessMs)));
+    }
+
+    if(reads > 0 && fleet.numBoxes > 0){
+#ifdef RSC_STANDIN
+        long remoteBefore = standin_remote_calls();
+#endif
+        memset(&bench, 0, sizeof(bench));
+        bench.cache = cache;
+        bench.numBoxes = fleet.numBoxes;
+        bench.reads = reads / threads;
+        bench.maxStalenessMs = maxStalenessMs;
+        state_cache_counts(cache, &hits, &liveReads);
+        parallel_for(threads, threads, bench_thread, &bench);
+        state_cache_counts(cache, &benchHits, &benchLive);
+        printf("\n%d reads from %d threads: %.0f ns per read, %ld from the cache, %ld live\n",
+               bench.reads * threads, threads, bench.elapsedUs * 1000.0 / (bench.reads * threads),
+               benchHits - hits, benchLive - liveReads);
+#ifdef RSC_STANDIN
+        printf("remote calls: %ld\n", standin_remote_calls() - remoteBefore);
+#endif
+    }
+
+    state_cache_counts(cache, &hits, &liveReads);
+    printf("state cache: %ld reads from the cache, %ld live\n", hits, liveReads);
+    state_cache_close(cache);
+    fleet_close(&fleet);
+    return 0;
+}
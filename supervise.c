@@ -0,0 +1,205 @@
+#include "common.h"
+#include "commands.h"
+#include "supervisor.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool supervise [--hosts h1,h2] [--seconds n]
+*                   [--events-per-box n] [--reconcile n]
+*                   [--verbose]
+*                   [--bench n1,n2,... [--bench-hosts n]
+*                    [--bench-events n] [--labels n]]
+* keeps the state of every box of the fleet in the
+* bounded memory supervisor (supervisor.h) for
+* --seconds (60) and prints its counters every
+* second: events, handler time per event, strings
+* and memory per box. --events-per-box (4) sizes the
+* event ring, --verbose prints the events as well.
+* events flip the known signal states without a read,
+* every second --reconcile (1000) boxes are read
+* back, round robin, to correct what a lost event
+* left wrong.
+* --bench (Standin only) measures the supervisor at
+* each fleet size of the list, e.g. 1000,10000,50000:
+* the boxes are spread over --bench-hosts (16) new
+* hosts, then --bench-events (100000) changes of aux b
+* outputs and, one in 16, user labels out of
+* --labels (50) are made and the supervisor takes the
+* events. the report shows the bytes per box, the
+* time to read the fleet and the handler time per
+* event.
+**************************************************/
+
+#define REPORT_MS       1000
+#define SETTLE_MS       200     /* no new event for this long, the bench is done */
+#define LABEL_EVERY     16
+
+static const char *eventNames[] = {
+    "signal", "status", "lock holder", "user label", "usb mux", "box removed", "host offline", "host online"
+};
+
+static void print_counts(Supervisor *sup, int numBoxes, double seconds){
+    SupCounts counts;
+
+    supervisor_counts(sup, &counts);
+    printf("%6.1f s  events %lld (%lld overwritten)  %.2f us per event  %d strings (%d refused)  "
+           "%.1f bytes per box  %lld reconciled\n", seconds, counts.events, counts.overwritten,
+           counts.events ? (double)counts.handlerUs / counts.events : 0.0, counts.strings, counts.refused,
+           (double)(counts.bytes + numBoxes * sizeof(FleetBox)) / numBoxes, counts.reconciled);
+}
+
+static void print_events(Supervisor *sup, long long *printed){
+    SupEvent events[256];
+    SupCounts counts;
+    int n, i;
+
+    supervisor_counts(sup, &counts);
+    n = supervisor_events(sup, events, 256);
+    for(i = 0; i < n; i++){
+        if(counts.events - n + i < *printed)
+            continue;
+        printf("%10u ms  %-12s %s %u  %s%s%d\n", events[i].atMs, eventNames[events[i].type],
+               events[i].type >= SUP_HOST_OFFLINE ? "host" : "box", events[i].box,
+               events[i].type == SUP_SIG_STATE ? Rsc2_SignalIDToAssignedString((Rsc2_SignalID)events[i].signal) : "",
+               events[i].type == SUP_SIG_STATE ? " " : "", events[i].value);
+    }
+    *printed = counts.events;
+}
+
+#ifdef RSC_STANDIN
+typedef struct
+{
+    Fleet *fleet;
+    int labels;
+} BenchLoad;
+
+static void make_changes(int index, void *ctx){
+    BenchLoad *load = ctx;
+    int box = (int)((long long)index * 7919 % load->fleet->numBoxes);
+    Rsc2_Box *rbox = load->fleet->boxes[box].box;
+    char label[32];
+
+    if(index % LABEL_EVERY == 0){
+        snprintf(label, sizeof(label), "rack-%02d", index / LABEL_EVERY % load->labels);
+        Rsc2_SetUserLabel(rbox, label);
+    }else{
+        Rsc2_Signal *aux = Rsc2_GetSignal(rbox, RSC2_ID_OUT_AUX_B);
+
+        Rsc2_SetSigAssertionState(aux, !Rsc2_GetSigAssertionState(aux));
+    }
+}
+
+static int bench_round(int numBoxes, int numHosts, int numChanges, int labels, int eventsPerBox){
+    static int round;
+    char hosts[MAX_HOSTS * HOST_NAME_LEN] = "";
+    BenchLoad load;
+    SupCounts counts;
+    Supervisor *sup = NULL;
+    Fleet fleet;
+    long long start, events = -1;
+    double openSeconds;
+    int i;
+
+    round++;
+    standin_set_boxes_per_host((numBoxes + numHosts - 1) / numHosts);
+    for(i = 0; i < numHosts; i++)
+        snprintf(hosts + strlen(hosts), sizeof(hosts) - strlen(hosts), "%sscale%d-%d", i ? "," : "", round, i);
+    if(fleet_open(&fleet, hosts) != 0)
+        return -1;
+    start = now_us();
+    sup = supervisor_open(&fleet, eventsPerBox);
+    if(sup == NULL){
+        fleet_close(&fleet);
+        return -1;
+    }
+    openSeconds = (now_us() - start) / 1000000.0;
+
+    load.fleet = &fleet;
+    load.labels = labels > 0 ? labels : 1;
+    parallel_for(numChanges, 8, make_changes, &load);
+    /* the events arrive on the library's threads */
+    do{
+        supervisor_counts(sup, &counts);
+        if(counts.events == events)
+            break;
+        events = counts.events;
+        Sleep(SETTLE_MS);
+    }while(1);
+
+    printf("%6d boxes  %6.1f bytes per box (%d strings, %lld bytes)  read in %.3f s  "
+           "%lld events  %.2f us per event\n", fleet.numBoxes,
+           (double)(counts.bytes + fleet.numBoxes * sizeof(FleetBox)) / fleet.numBoxes, counts.strings,
+           counts.stringBytes, openSeconds, counts.events,
+           counts.events ? (double)counts.handlerUs / counts.events : 0.0);
+    supervisor_close(sup);
+    fleet_close(&fleet);
+    return 0;
+}
+
+static int bench(const char *sizes, int numHosts, int numChanges, int labels, int eventsPerBox){
+    const char *size = sizes;
+
+    if(numHosts < 1 || numHosts > MAX_HOSTS){
+        printf("--bench-hosts takes 1 to %d\n", MAX_HOSTS);
+        return -1;
+    }
+    /* not strtok, fleet_open uses it */
+    for(; size != NULL; size = strchr(size, ',') ? strchr(size, ',') + 1 : NULL){
+        if(atoi(size) < numHosts){
+            printf("a fleet size of %d is too small for %d hosts\n", atoi(size), numHosts);
+            return -1;
+        }
+        if(bench_round(atoi(size), numHosts, numChanges, labels, eventsPerBox) != 0)
+            return -1;
+    }
+    return 0;
+}
+#endif
+
+int supervise_main(int argc, char *argv[]){
+    int seconds = opt_int(argc, argv, "--seconds", 60);
+    int eventsPerBox = opt_int(argc, argv, "--events-per-box", 4);
+    int reconcile = opt_int(argc, argv, "--reconcile", 1000);
+    int verbose = opt_flag(argc, argv, "--verbose");
+    const char *sizes = opt_str(argc, argv, "--bench", NULL);
+    Supervisor *sup = NULL;
+    Fleet fleet;
+    long long start, printed = 0;
+
+    if(sizes != NULL){
+#ifdef RSC_STANDIN
+        return bench(sizes, opt_int(argc, argv, "--bench-hosts", 16), opt_int(argc, argv, "--bench-events", 100000),
+                     opt_int(argc, argv, "--labels", 50), eventsPerBox);
+#else
+        printf("--bench needs the Standin build\n");
+        return -1;
+#endif
+    }
+
+    if(fleet_open(&fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    if(fleet.numBoxes == 0){
+        printf("no boxes\n");
+        fleet_close(&fleet);
+        return -1;
+    }
+    start = now_us();
+    sup = supervisor_open(&fleet, eventsPerBox);
+    if(sup == NULL){
+        fleet_close(&fleet);
+        return -1;
+    }
+    printf("supervising %d boxes, read in %.2f s\n", fleet.numBoxes, (now_us() - start) / 1000000.0);
+    while(now_us() - start < (long long)seconds * 1000000){
+        Sleep(REPORT_MS);
+        supervisor_reconcile(sup, reconcile);
+        if(verbose)
+            print_events(sup, &printed);
+        print_counts(sup, fleet.numBoxes, (now_us() - start) / 1000000.0);
+    }
+    supervisor_close(sup);
+    fleet_close(&fleet);
+    return 0;
+}
@@ -0,0 +1,501 @@
+#include "supervisor.h"
+
+#define ARENA_CHUNK     65536
+#define TEXT_LEN        64      /* longest label or lock holder kept */
+#define MIN_EVENTS      1024
+#define SPARE_STRINGS   1024    /* interned beyond the two a box holds */
+#define SEQ_SHIFT       24      /* the top bits of a box's signal word count its events */
+#define OVERFLOW_ID     1       /* "?", the id of a string past the cap */
+#define QUIET_MS        1000    /* reconciled only this long after the last event */
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    int used;
+    char data[ARENA_CHUNK];
+} ArenaChunk;
+
+struct Supervisor
+{
+    Fleet *fleet;
+    long long openedAt;
+    /* box state, one element per box */
+    volatile LONG *signals;     /* bit n is signal n, event count above SEQ_SHIFT */
+    unsigned char *status;
+    unsigned char *mux;
+    volatile LONG *labelId;
+    volatile LONG *lockId;
+    unsigned int *changedMs;
+    int nextReconcile;          /* the box the next reconcile starts at */
+    volatile LONG reconciled;   /* signal bits a reconcile corrected */
+    /* interned strings, id 0 is "" */
+    CRITICAL_SECTION stringLock;
+    ArenaChunk *chunks;
+    const char **strings;
+    int numStrings;
+    int maxStrings;
+    int refused;                /* new strings past maxStrings */
+    int stringCapacity;
+    int *table;                 /* open addressing, string id + 1, 0 free */
+    int tableSize;
+    long long stringBytes;
+    /* event ring */
+    CRITICAL_SECTION eventLock;
+    SupEvent *ring;
+    unsigned int ringMask;
+    long long numEvents;
+    long long handlerUs;
+    long long bytes;
+    Rsc2_BoxListener boxListener;
+    Rsc2_HostListener hostListener;
+};
+
+/* the listener callbacks carry no context, one supervisor at a time */
+static Supervisor *active;
+
+static void *sup_alloc(Supervisor *sup, int count, int size){
+    sup->bytes += (long long)count * size;
+    return calloc(count, size);
+}
+
+static unsigned int hash_text(const char *text){
+    unsigned int hash = 2166136261u;
+
+    while(*text != '\0')
+        hash = (hash ^ (unsigned char)*text++) * 16777619u;
+    return hash;
+}
+
+/* below, the caller holds sup->stringLock */
+
+static char *arena_copy(Supervisor *sup, const char *text){
+    int size = (int)strlen(text) + 1;
+    ArenaChunk *chunk = sup->chunks;
+    char *copy = NULL;
+
+    if(chunk == NULL || chunk->used + size > ARENA_CHUNK){
+        chunk = sup_alloc(sup, 1, sizeof(ArenaChunk));
+        chunk->next = sup->chunks;
+        sup->chunks = chunk;
+    }
+    copy = chunk->data + chunk->used;
+    memcpy(copy, text, size);
+    chunk->used += size;
+    sup->stringBytes += size;
+    return copy;
+}
+
+static void grow_table(Supervisor *sup){
+    int size = sup->tableSize ? sup->tableSize * 2 : 256;
+    int *table = sup_alloc(sup, size, sizeof(int));
+    int i, slot;
+
+    for(i = 0; i < sup->numStrings; i++){
+        slot = hash_text(sup->strings[i]) & (size - 1);
+        while(table[slot] != 0)
+            slot = (slot + 1) & (size - 1);
+        table[slot] = i + 1;
+    }
+    sup->bytes -= (long long)sup->tableSize * sizeof(int);
+    free(sup->table);
+    sup->table = table;
+    sup->tableSize = size;
+}
+
+static int intern_locked(Supervisor *sup, const char *text){
+    int slot, capacity;
+
+    if(2 * (sup->numStrings + 1) > sup->tableSize)
+        grow_table(sup);
+    slot = hash_text(text) & (sup->tableSize - 1);
+    while(sup->table[slot] != 0){
+        if(strcmp(sup->strings[sup->table[slot] - 1], text) == 0)
+            return sup->table[slot] - 1;
+        slot = (slot + 1) & (sup->tableSize - 1);
+    }
+    /* the arena is never compacted, churn past the cap is not kept */
+    if(sup->numStrings >= sup->maxStrings){
+        sup->refused++;
+        return OVERFLOW_ID;
+    }
+    if(sup->numStrings == sup->stringCapacity){
+        capacity = sup->stringCapacity ? sup->stringCapacity * 2 : 256;
+        sup->bytes += (long long)(capacity - sup->stringCapacity) * sizeof(char *);
+        sup->stringCapacity = capacity;
+        sup->strings = realloc(sup->strings, sup->stringCapacity * sizeof(char *));
+    }
+    sup->strings[sup->numStrings] = arena_copy(sup, text);
+    sup->table[slot] = sup->numStrings + 1;
+    return sup->numStrings++;
+}
+
+static int intern(Supervisor *sup, const char *text){
+    int id;
+
+    EnterCriticalSection(&sup->stringLock);
+    id = intern_locked(sup, text);
+    LeaveCriticalSection(&sup->stringLock);
+    return id;
+}
+
+static const char *string_of(Supervisor *sup, int id){
+    const char *text;
+
+    EnterCriticalSection(&sup->stringLock);
+    text = sup->strings[id];
+    LeaveCriticalSection(&sup->stringLock);
+    return text;
+}
+
+/* adds the time since "start" to the handler time */
+static void record_event(Supervisor *sup, int box, int type, int signal, int value, long long start){
+    SupEvent *event = NULL;
+    unsigned int atMs = (unsigned int)((start - sup->openedAt) / 1000);
+
+    if(type < SUP_HOST_OFFLINE)
+        sup->changedMs[box] = atMs;
+    EnterCriticalSection(&sup->eventLock);
+    event = &sup->ring[sup->numEvents++ & sup->ringMask];
+    event->box = box;
+    event->type = (unsigned char)type;
+    event->signal = (unsigned char)signal;
+    event->value = (unsigned char)value;
+    event->atMs = atMs;
+    sup->handlerUs += now_us() - start;
+    LeaveCriticalSection(&sup->eventLock);
+}
+
+static int box_of(Rsc2_Box *box){
+    return (int)(INT_PTR)Rsc2_GetObjectClientData((Rsc2_Object *)box) - 1;
+}
+
+/* the signal word with signal "id" set to "state" */
+static LONG with_signal(LONG bits, int id, int state){
+    unsigned long bit = 1UL << id;
+
+    return (LONG)(state == RSC2_SIG_ASSERTED ? (unsigned long)bits | bit : (unsigned long)bits & ~bit);
+}
+
+/* no read in the callback: the event is a flip of the known state */
+static void on_sig_state_changed(Rsc2_Signal *sig){
+    long long start = now_us();
+    Supervisor *sup = active;
+    INT_PTR ref = (INT_PTR)Rsc2_GetObjectClientData((Rsc2_Object *)sig) - 1;
+    int box, id;
+    LONG old, bits;
+
+    if(sup == NULL || ref < 0)
+        return;
+    box = (int)(ref / SUP_NUM_SIGNALS);
+    id = (int)(ref % SUP_NUM_SIGNALS);
+    do{
+        old = sup->signals[box];
+        bits = (LONG)(((unsigned long)old ^ (1UL << id)) + (1UL << SEQ_SHIFT));
+    }while(InterlockedCompareExchange(&sup->signals[box], bits, old) != old);
+    record_event(sup, box, SUP_SIG_STATE, id, ((unsigned long)bits >> id) & 1, start);
+}
+
+static void on_box_status_changed(Rsc2_Box *rbox){
+    long long start = now_us();
+    Supervisor *sup = active;
+    int box = box_of(rbox);
+
+    if(sup == NULL || box < 0)
+        return;
+    sup->status[box] = (unsigned char)Rsc2_GetOnlineStatus(rbox);
+    record_event(sup, box, SUP_BOX_STATUS, 0, sup->status[box], start);
+}
+
+static void on_usb_mux_changed(Rsc2_Box *rbox){
+    long long start = now_us();
+    Supervisor *sup = active;
+    int box = box_of(rbox);
+
+    if(sup == NULL || box < 0)
+        return;
+    sup->mux[box] = (unsigned char)Rsc2_GetUsbMuxState(rbox);
+    record_event(sup, box, SUP_USB_MUX, 0, sup->mux[box], start);
+}
+
+static void on_user_label_changed(Rsc2_Box *rbox){
+    long long start = now_us();
+    Supervisor *sup = active;
+    int box = box_of(rbox);
+    char text[TEXT_LEN];
+
+    if(sup == NULL || box < 0)
+        return;
+    Rsc2_GetUserLabel(rbox, text, TEXT_LEN);
+    InterlockedExchange(&sup->labelId[box], intern(sup, text));
+    record_event(sup, box, SUP_USER_LABEL, 0, 0, start);
+}
+
+static void on_lock_holder_changed(Rsc2_Box *rbox){
+    long long start = now_us();
+    Supervisor *sup = active;
+    int box = box_of(rbox);
+    char text[TEXT_LEN];
+
+    if(sup == NULL || box < 0)
+        return;
+    Rsc2_GetLockHolder(rbox, text, TEXT_LEN);
+    InterlockedExchange(&sup->lockId[box], intern(sup, text));
+    record_event(sup, box, SUP_LOCK_HOLDER, 0, 0, start);
+}
+
+static void on_box_removed(Rsc2_Host *host, Rsc2_Box *rbox){
+    long long start = now_us();
+    Supervisor *sup = active;
+    int box = box_of(rbox);
+
+    (void)host;
+    if(sup == NULL || box < 0)
+        return;
+    sup->status[box] = RSC2_STAT_UNKNOWN;
+    record_event(sup, box, SUP_BOX_REMOVED, 0, RSC2_STAT_UNKNOWN, start);
+}
+
+/* the boxes of the host keep their last state, marked offline or unknown */
+static void set_host_status(Rsc2_Host *host, int type, Rsc2_BoxStatus status){
+    long long start = now_us();
+    Supervisor *sup = active;
+    int index = (int)(INT_PTR)Rsc2_GetObjectClientData((Rsc2_Object *)host) - 1;
+    int i;
+
+    if(sup == NULL || index < 0)
+        return;
+    for(i = 0; i < sup->fleet->numBoxes; i++){
+        if(sup->fleet->boxes[i].hostIndex == index)
+            sup->status[i] = (unsigned char)status;
+    }
+    record_event(sup, index, type, 0, status, start);
+}
+
+static void on_host_offline(Rsc2_Host *host){
+    set_host_status(host, SUP_HOST_OFFLINE, RSC2_STAT_OFFLINE);
+}
+
+static void on_host_online(Rsc2_Host *host){
+    /* the status events that follow tell the real one */
+    set_host_status(host, SUP_HOST_ONLINE, RSC2_STAT_UNKNOWN);
+}
+
+/* reads signal "id" of the box into its word, 1 if that changed the word */
+static int read_signal(Supervisor *sup, int index, int id){
+    Rsc2_Signal *sig = Rsc2_GetSignal(sup->fleet->boxes[index].box, (Rsc2_SignalID)id);
+    LONG old;
+    int state;
+
+    if(sig == NULL)
+        return 0;
+    /* an event during the read moved the count, read again */
+    do{
+        old = sup->signals[index];
+        state = Rsc2_GetSigAssertionState(sig);
+        if(state < 0)
+            return 0;
+    }while(InterlockedCompareExchange(&sup->signals[index], with_signal(old, id, state), old) != old);
+    return with_signal(old, id, state) != old;
+}
+
+static void read_box(int index, void *ctx){
+    Supervisor *sup = ctx;
+    Rsc2_Box *box = sup->fleet->boxes[index].box;
+    Rsc2_Signal *sig = NULL;
+    char text[TEXT_LEN];
+    int id;
+
+    for(id = 0; id < SUP_NUM_SIGNALS; id++){
+        sig = Rsc2_GetSignal(box, (Rsc2_SignalID)id);
+        if(sig != NULL)
+            Rsc2_SetObjectClientData((Rsc2_Object *)sig, (void *)(INT_PTR)(index * SUP_NUM_SIGNALS + id + 1));
+    }
+    /* listening before the reads, a change after a read has its event */
+    Rsc2_SetObjectClientData((Rsc2_Object *)box, (void *)(INT_PTR)(index + 1));
+    Rsc2_AttachBoxListener(box, &sup->boxListener);
+    for(id = 0; id < SUP_NUM_SIGNALS; id++)
+        read_signal(sup, index, id);
+    sup->status[index] = (unsigned char)Rsc2_GetOnlineStatus(box);
+    sup->mux[index] = (unsigned char)Rsc2_GetUsbMuxState(box);
+    Rsc2_GetUserLabel(box, text, TEXT_LEN);
+    sup->labelId[index] = intern(sup, text);
+    Rsc2_GetLockHolder(box, text, TEXT_LEN);
+    sup->lockId[index] = intern(sup, text);
+}
+
+typedef struct
+{
+    Supervisor *sup;
+    int first;
+    unsigned int nowMs;
+} Reconcile;
+
+static void reconcile_box(int index, void *ctx){
+    Reconcile *run = ctx;
+    Supervisor *sup = run->sup;
+    int box = (run->first + index) % sup->fleet->numBoxes;
+    int id;
+
+    /* an event still on its way would flip the state read here */
+    if(run->nowMs - sup->changedMs[box] < QUIET_MS)
+        return;
+    for(id = 0; id < SUP_NUM_SIGNALS; id++){
+        if(read_signal(sup, box, id))
+            InterlockedIncrement(&sup->reconciled);
+    }
+}
+
+static void forget_box(int index, void *ctx){
+    Supervisor *sup = ctx;
+    Rsc2_Box *box = sup->fleet->boxes[index].box;
+    Rsc2_Signal *sig = NULL;
+    int id;
+
+    Rsc2_DetachBoxListener(box, &sup->boxListener);
+    Rsc2_SetObjectClientData((Rsc2_Object *)box, NULL);
+    for(id = 0; id < SUP_NUM_SIGNALS; id++){
+        sig = Rsc2_GetSignal(box, (Rsc2_SignalID)id);
+        if(sig != NULL)
+            Rsc2_SetObjectClientData((Rsc2_Object *)sig, NULL);
+    }
+}
+
+Supervisor *supervisor_open(Fleet *fleet, int eventsPerBox){
+    Supervisor *sup = NULL;
+    unsigned int ringSize = MIN_EVENTS;
+    int n = fleet->numBoxes;
+    int i;
+
+    if(active != NULL){
+        printf("a supervisor is open already\n");
+        return NULL;
+    }
+    sup = calloc(1, sizeof(Supervisor));
+    sup->bytes = sizeof(Supervisor);
+    sup->fleet = fleet;
+    sup->openedAt = now_us();
+    sup->signals = sup_alloc(sup, n + 1, sizeof(LONG));
+    sup->status = sup_alloc(sup, n + 1, sizeof(unsigned char));
+    sup->mux = sup_alloc(sup, n + 1, sizeof(unsigned char));
+    sup->labelId = sup_alloc(sup, n + 1, sizeof(LONG));
+    sup->lockId = sup_alloc(sup, n + 1, sizeof(LONG));
+    sup->changedMs = sup_alloc(sup, n + 1, sizeof(unsigned int));
+    while(ringSize < (unsigned int)n * (eventsPerBox > 0 ? eventsPerBox : 1))
+        ringSize *= 2;
+    sup->ring = sup_alloc(sup, ringSize, sizeof(SupEvent));
+    sup->ringMask = ringSize - 1;
+    InitializeCriticalSection(&sup->stringLock);
+    InitializeCriticalSection(&sup->eventLock);
+    sup->maxStrings = 2 * n + SPARE_STRINGS;
+    intern(sup, "");
+    intern(sup, "?");
+
+    sup->boxListener.sigStateChanged = on_sig_state_changed;
+    sup->boxListener.boxStatusChanged = on_box_status_changed;
+    sup->boxListener.lockHolderChanged = on_lock_holder_changed;
+    sup->boxListener.userLabelChanged = on_user_label_changed;
+    sup->boxListener.usbMuxChanged = on_usb_mux_changed;
+    sup->hostListener.boxRemoved = on_box_removed;
+    sup->hostListener.hostOffline = on_host_offline;
+    sup->hostListener.hostOnline = on_host_online;
+    active = sup;
+    for(i = 0; i < fleet->numHosts; i++){
+        Rsc2_SetObjectClientData((Rsc2_Object *)fleet->hosts[i], (void *)(INT_PTR)(i + 1));
+        Rsc2_AttachHostListener(fleet->hosts[i], &sup->hostListener);
+    }
+    parallel_for(n, 32, read_box, sup);
+    return sup;
+}
+
+void supervisor_close(Supervisor *sup){
+    ArenaChunk *chunk = NULL;
+    int i;
+
+    for(i = 0; i < sup->fleet->numHosts; i++){
+        Rsc2_DetachHostListener(sup->fleet->hosts[i], &sup->hostListener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)sup->fleet->hosts[i], NULL);
+    }
+    parallel_for(sup->fleet->numBoxes, 32, forget_box, sup);
+    active = NULL;
+    while((chunk = sup->chunks) != NULL){
+        sup->chunks = chunk->next;
+        free(chunk);
+    }
+    free(sup->strings);
+    free(sup->table);
+    free(sup->ring);
+    free((void *)sup->signals);
+    free(sup->status);
+    free(sup->mux);
+    free((void *)sup->labelId);
+    free((void *)sup->lockId);
+    free(sup->changedMs);
+    free(sup);
+}
+
+void supervisor_reconcile(Supervisor *sup, int maxBoxes){
+    Reconcile run;
+    int n = sup->fleet->numBoxes;
+
+    if(n == 0 || maxBoxes <= 0)
+        return;
+    if(maxBoxes > n)
+        maxBoxes = n;
+    run.sup = sup;
+    run.first = sup->nextReconcile;
+    run.nowMs = (unsigned int)((now_us() - sup->openedAt) / 1000);
+    sup->nextReconcile = (run.first + maxBoxes) % n;
+    parallel_for(maxBoxes, 32, reconcile_box, &run);
+}
+
+Rsc2_SignalState supervisor_signal(Supervisor *sup, int box, Rsc2_SignalID id){
+    return ((unsigned long)sup->signals[box] >> id) & 1 ? RSC2_SIG_ASSERTED : RSC2_SIG_DEASSERTED;
+}
+
+Rsc2_BoxStatus supervisor_status(Supervisor *sup, int box){
+    return (Rsc2_BoxStatus)sup->status[box];
+}
+
+Rsc2_UsbMuxState supervisor_usb_mux(Supervisor *sup, int box){
+    return (Rsc2_UsbMuxState)sup->mux[box];
+}
+
+const char *supervisor_label(Supervisor *sup, int box){
+    return string_of(sup, sup->labelId[box]);
+}
+
+const char *supervisor_lock_holder(Supervisor *sup, int box){
+    return string_of(sup, sup->lockId[box]);
+}
+
+int supervisor_events(Supervisor *sup, SupEvent *events, int max){
+    long long first;
+    int n, i;
+
+    EnterCriticalSection(&sup->eventLock);
+    n = sup->numEvents < max ? (int)sup->numEvents : max;
+    if(n > (int)sup->ringMask + 1)
+        n = (int)sup->ringMask + 1;
+    first = sup->numEvents - n;
+    for(i = 0; i < n; i++)
+        events[i] = sup->ring[(first + i) & sup->ringMask];
+    LeaveCriticalSection(&sup->eventLock);
+    return n;
+}
+
+void supervisor_counts(Supervisor *sup, SupCounts *counts){
+    memset(counts, 0, sizeof(*counts));
+    EnterCriticalSection(&sup->eventLock);
+    counts->events = sup->numEvents;
+    if(sup->numEvents > (long long)sup->ringMask + 1)
+        counts->overwritten = sup->numEvents - sup->ringMask - 1;
+    counts->handlerUs = sup->handlerUs;
+    counts->reconciled = sup->reconciled;
+    LeaveCriticalSection(&sup->eventLock);
+    EnterCriticalSection(&sup->stringLock);
+    counts->bytes = sup->bytes;
+    counts->strings = sup->numStrings;
+    counts->refused = sup->refused;
+    counts->stringBytes = sup->stringBytes;
+    LeaveCriticalSection(&sup->stringLock);
+}
@@ -0,0 +1,90 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "common.h"
+
+/**************************************************
+* bounded memory fleet supervisor
+* keeps the state of every box of a large fleet (tens
+* of thousands of boxes) current from the listener
+* events, in memory sized once from the box count:
+* - box state is a struct of arrays: signal states as
+*   bits, flipped by each event without a read and
+*   corrected by supervisor_reconcile,
+*   status and usb mux as bytes, user label and
+*   lock holder as ids of interned strings and the
+*   time of the last change, about 20 bytes a box.
+* - strings are interned into an arena of fixed size
+*   chunks: a label shared by a thousand boxes is
+*   stored once. nothing is freed before the close,
+*   so the distinct strings are capped at two per box
+*   plus 1024; a new one past the cap reads as "?"
+*   and is counted as refused.
+* - events go to a ring of compact records,
+*   eventsPerBox per box, the oldest are overwritten.
+* - one box and one host listener serve every box;
+*   client data holds indexes, not allocations.
+* the supervisor owns the listeners and the client
+* data of the fleet's hosts, boxes and signals.
+**************************************************/
+
+#define SUP_NUM_SIGNALS     NUM_SIGNALS
+
+typedef enum
+{
+    SUP_SIG_STATE,
+    SUP_BOX_STATUS,
+    SUP_LOCK_HOLDER,
+    SUP_USER_LABEL,
+    SUP_USB_MUX,
+    SUP_BOX_REMOVED,
+    SUP_HOST_OFFLINE,
+    SUP_HOST_ONLINE
+} SupEventType;
+
+typedef struct
+{
+    unsigned int box;           /* the host index for host events */
+    unsigned char type;
+    unsigned char signal;
+    unsigned char value;        /* the new state, status or mux position */
+    unsigned char reserved;
+    unsigned int atMs;          /* since the supervisor was opened */
+} SupEvent;
+
+typedef struct
+{
+    long long events;
+    long long overwritten;      /* events that fell out of the ring */
+    long long handlerUs;        /* spent in the listener callbacks */
+    long long reconciled;       /* signal bits corrected by a reconcile */
+    long long bytes;            /* everything the supervisor allocated */
+    int strings;                /* distinct interned strings */
+    int refused;                /* new strings past the cap, kept as "?" */
+    long long stringBytes;
+} SupCounts;
+
+typedef struct Supervisor Supervisor;
+
+/* reads every box once, NULL on failure */
+Supervisor *supervisor_open(Fleet *fleet, int eventsPerBox);
+void supervisor_close(Supervisor *sup);
+
+/* reads the signals of the next "maxBoxes" boxes, round robin, and
+   corrects the bits a lost or coalesced event left wrong. boxes with
+   an event in the last second are skipped. not for a listener thread */
+void supervisor_reconcile(Supervisor *sup, int maxBoxes);
+
+/* "box" indexes fleet->boxes. strings stay valid until the close */
+Rsc2_SignalState supervisor_signal(Supervisor *sup, int box, Rsc2_SignalID id);
+Rsc2_BoxStatus supervisor_status(Supervisor *sup, int box);
+Rsc2_UsbMuxState supervisor_usb_mux(Supervisor *sup, int box);
+const char *supervisor_label(Supervisor *sup, int box);
+const char *supervisor_lock_holder(Supervisor *sup, int box);
+
+/* copies up to "max" of the latest events, oldest first, returns how many */
+int supervisor_events(Supervisor *sup, SupEvent *events, int max);
+
+void supervisor_counts(Supervisor *sup, SupCounts *counts);
+
+#endif /* SUPERVISOR_H */
@@ -0,0 +1,387 @@
+#include "common.h"
+#include "commands.h"
+
+/**************************************************
+* rsctool sync --file inventory [--hosts h1,h2]
+*              [--threads n] [--dry-run]
+* brings box labels, kvm addresses and signal
+* names/types/assertion types in line with an
+* inventory file. one setting per line, tab separated:
+*   <box description>  label                 <text>
+*   <box description>  kvm                   <address>
+*   <box description>  <signal id>.name      <text>
+*   <box description>  <signal id>.type      RSC2_LED ...
+*   <box description>  <signal id>.assertion RSC2_ACTIVE_LOW ...
+* e.g. "RSC2 SN 0042\tRSC2_ID_LED_PWR.name\tPower LED".
+* current values are read in parallel, only the
+* settings that differ are written, again in parallel.
+**************************************************/
+
+#define DESC_LEN        64
+#define VALUE_LEN       64
+#define LINE_LEN        256
+
+enum
+{
+    FIELD_LABEL,
+    FIELD_KVM,
+    FIELD_SIG_NAME,
+    FIELD_SIG_TYPE,
+    FIELD_SIG_ASSERTION
+};
+
+typedef struct
+{
+    char description[DESC_LEN];
+    int line;
+    int field;
+    Rsc2_SignalID sigId;
+    char value[VALUE_LEN];
+    int number;                 /* parsed value of type/assertion settings */
+    char current[VALUE_LEN];
+    int changed;
+    Rsc2_Result result;
+} SyncItem;
+
+typedef struct
+{
+    Rsc2_Box *box;
+    int first;                  /* items of this box are items[first..first+count) */
+    int count;
+    Rsc2_Signal *signals[NUM_SIGNALS];
+} SyncBox;
+
+typedef struct
+{
+    Fleet fleet;
+    int numItems;
+    SyncItem *items;
+    int numBoxes;
+    SyncBox *boxes;
+    char (*descriptions)[DESC_LEN];  /* per fleet box */
+    volatile LONG reads;
+    volatile LONG writes;
+    volatile LONG failures;
+} Sync;
+
+static int lookup_symbol(const Rsc2_SymRec *table, const char *name, int *value){
+    int i;
+
+    for(i = 0; table[i].name != NULL; i++){
+        if(strcmp(table[i].name, name) == 0){
+            *value = table[i].value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const char *symbol_name(const Rsc2_SymRec *table, int value){
+    int i;
+
+    for(i = 0; table[i].name != NULL; i++){
+        if(table[i].value == value)
+            return table[i].name;
+    }
+    return "?";
+}
+
+static int parse_item(SyncItem *item, char *line){
+    char *property = NULL;
+    char *value = NULL;
+    char *dot = NULL;
+
+    property = strchr(line, '\t');
+    if(property == NULL)
+        return -1;
+    *property++ = '\0';
+    value = strchr(property, '\t');
+    if(value == NULL)
+        return -1;
+    *value++ = '\0';
+
+    strncpy(item->description, line, DESC_LEN - 1);
+    strncpy(item->value, value, VALUE_LEN - 1);
+    if(strcmp(property, "label") == 0){
+        item->field = FIELD_LABEL;
+        return 0;
+    }
+    if(strcmp(property, "kvm") == 0){
+        item->field = FIELD_KVM;
+        return 0;
+    }
+
+    dot = strrchr(property, '.');
+    if(dot == NULL)
+        return -1;
+    *dot++ = '\0';
+    if(Rsc2_StringToSignalID(property, &item->sigId) != 0)
+        return -1;
+    if(strcmp(dot, "name") == 0){
+        item->field = FIELD_SIG_NAME;
+        return 0;
+    }
+    if(strcmp(dot, "type") == 0){
+        item->field = FIELD_SIG_TYPE;
+        return lookup_symbol(Rsc2_GetSigTypeTable(), value, &item->number);
+    }
+    if(strcmp(dot, "assertion") == 0){
+        item->field = FIELD_SIG_ASSERTION;
+        return lookup_symbol(Rsc2_GetAssertionTypeTable(), value, &item->number);
+    }
+    return -1;
+}
+
+static int compare_items(const void *a, const void *b){
+    const SyncItem *x = a;
+    const SyncItem *y = b;
+    int order = strcmp(x->description, y->description);
+
+    return order ? order : x->line - y->line;
+}
+
+static int load_inventory(Sync *sync, const char *path){
+    char line[LINE_LEN];
+    int capacity = 0;
+    int lineNo = 0;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        printf("unable to open %s\n", path);
+        return -1;
+    }
+    while(fgets(line, LINE_LEN, file) != NULL){
+        SyncItem *item = NULL;
+
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+        if(sync->numItems == capacity){
+            capacity = capacity ? capacity * 2 : 256;
+            sync->items = realloc(sync->items, capacity * sizeof(SyncItem));
+        }
+        item = &sync->items[sync->numItems];
+        memset(item, 0, sizeof(*item));
+        item->line = lineNo;
+        if(parse_item(item, line) != 0){
+            printf("%s:%d: invalid inventory line\n", path, lineNo);
+            fclose(file);
+            return -1;
+        }
+        sync->numItems++;
+    }
+    fclose(file);
+
+    qsort(sync->items, sync->numItems, sizeof(SyncItem), compare_items);
+    return 0;
+}
+
+static void read_description(int index, void *ctx){
+    Sync *sync = ctx;
+
+    Rsc2_GetDescription(sync->fleet.boxes[index].box, sync->descriptions[index], DESC_LEN);
+    InterlockedIncrement(&sync->reads);
+}
+
+static Rsc2_Signal *box_signal(Sync *sync, SyncBox *sb, Rsc2_SignalID id){
+    if(sb->signals[id] == NULL){
+        sb->signals[id] = Rsc2_GetSignal(sb->box, id);
+        InterlockedIncrement(&sync->reads);
+    }
+    return sb->signals[id];
+}
+
+/* reads the current value of every setting of one box and marks the
+ * ones that differ from the inventory. a setting whose read failed is
+ * a failure and is not written. */
+static void diff_box(int index, void *ctx){
+    long long start = trace_begin();
+    Sync *sync = ctx;
+    SyncBox *sb = &sync->boxes[index];
+    int i;
+
+    for(i = sb->first; i < sb->first + sb->count; i++){
+        SyncItem *item = &sync->items[i];
+        Rsc2_Signal *sig = NULL;
+        int number = 0;
+        int len = 0;
+
+        if(item->field >= FIELD_SIG_NAME){
+            sig = box_signal(sync, sb, item->sigId);
+            if(sig == NULL){
+                item->result = RSC2_ERR_INVALID_OBJ_REF;
+                InterlockedIncrement(&sync->failures);
+                continue;
+            }
+        }
+
+        switch(item->field){
+        case FIELD_LABEL:
+            len = Rsc2_GetUserLabel(sb->box, item->current, VALUE_LEN);
+            break;
+        case FIELD_KVM:
+            len = Rsc2_GetKvmAddress(sb->box, item->current, VALUE_LEN);
+            break;
+        case FIELD_SIG_NAME:
+            len = Rsc2_GetSigName(sig, item->current, VALUE_LEN);
+            break;
+        case FIELD_SIG_TYPE:
+            number = Rsc2_GetSigType(sig);
+            strcpy(item->current, symbol_name(Rsc2_GetSigTypeTable(), number));
+            break;
+        case FIELD_SIG_ASSERTION:
+            number = Rsc2_GetSigAssertionType(sig);
+            strcpy(item->current, symbol_name(Rsc2_GetAssertionTypeTable(), number));
+            break;
+        }
+        InterlockedIncrement(&sync->reads);
+        if(len < 0 || number < 0){
+            item->result = RSC2_ERR_COMMAND_FAILED;
+            InterlockedIncrement(&sync->failures);
+            continue;
+        }
+
+        if(item->field == FIELD_SIG_TYPE || item->field == FIELD_SIG_ASSERTION)
+            item->changed = number != item->number;
+        else
+            item->changed = strcmp(item->current, item->value) != 0;
+    }
+    trace_end("diff_box", start, sb->box);
+}
+
+static void apply_box(int index, void *ctx){
+    long long start = trace_begin();
+    Sync *sync = ctx;
+    SyncBox *sb = &sync->boxes[index];
+    int i;
+
+    for(i = sb->first; i < sb->first + sb->count; i++){
+        SyncItem *item = &sync->items[i];
+        Rsc2_Signal *sig = sb->signals[item->sigId];
+
+        if(!item->changed || item->result != RSC2_SUCCESS)
+            continue;
+        switch(item->field){
+        case FIELD_LABEL:
+            item->result = Rsc2_SetUserLabel(sb->box, item->value);
+            break;
+        case FIELD_KVM:
+            item->result = Rsc2_SetKvmAddress(sb->box, item->value);
+            break;
+        case FIELD_SIG_NAME:
+            item->result = Rsc2_SetSigName(sig, item->value);
+            break;
+        case FIELD_SIG_TYPE:
+            /* Rsc2_SetSigType reports nothing, read it back */
+            Rsc2_SetSigType(sig, (Rsc2_SignalType)item->number);
+            if(Rsc2_GetSigType(sig) != (Rsc2_SignalType)item->number)
+                item->result = RSC2_ERR_COMMAND_FAILED;
+            break;
+        case FIELD_SIG_ASSERTION:
+            item->result = Rsc2_SetSigAssertionType(sig, (Rsc2_AssertionType)item->number);
+            break;
+        }
+        InterlockedIncrement(&sync->writes);
+        if(item->result != RSC2_SUCCESS)
+            InterlockedIncrement(&sync->failures);
+    }
+    trace_end("apply_box", start, sb->box);
+}
+
+static const char *field_name(SyncItem *item, char *buf){
+    if(item->field == FIELD_LABEL)
+        return "label";
+    if(item->field == FIELD_KVM)
+        return "kvm";
+    sprintf(buf, "%s.%s", Rsc2_SignalIDToAssignedString(item->sigId),
+            item->field == FIELD_SIG_NAME ? "name" :
+            item->field == FIELD_SIG_TYPE ? "type" : "assertion");
+    return buf;
+}
+
+int sync_main(int argc, char *argv[]){
+    Sync sync;
+    const char *path = opt_str(argc, argv, "--file", NULL);
+    int threads = opt_int(argc, argv, "--threads", 32);
+    int dryRun = opt_flag(argc, argv, "--dry-run");
+    long long started = now_us();
+    int changes = 0, missing = 0;
+    int i, first;
+
+    if(path == NULL){
+        printf("sync needs --file\n");
+        return -1;
+    }
+    memset(&sync, 0, sizeof(sync));
+    if(load_inventory(&sync, path) != 0)
+        return -1;
+    if(fleet_open(&sync.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+
+    sync.descriptions = calloc(sync.fleet.numBoxes + 1, DESC_LEN);
+    parallel_for(sync.fleet.numBoxes, threads, read_description, &sync);
+
+    /* group the sorted items per box and find each box in the fleet */
+    sync.boxes = calloc(sync.numItems + 1, sizeof(SyncBox));
+    for(first = 0; first < sync.numItems; ){
+        SyncBox *sb = &sync.boxes[sync.numBoxes];
+        int last = first;
+
+        while(last < sync.numItems
+           && strcmp(sync.items[last].description, sync.items[first].description) == 0)
+            last++;
+        for(i = 0; i < sync.fleet.numBoxes; i++){
+            if(strcmp(sync.descriptions[i], sync.items[first].description) == 0)
+                break;
+        }
+        if(i == sync.fleet.numBoxes){
+            printf("box \"%s\" not found\n", sync.items[first].description);
+            missing++;
+        }else{
+            sb->box = sync.fleet.boxes[i].box;
+            sb->first = first;
+            sb->count = last - first;
+            sync.numBoxes++;
+        }
+        first = last;
+    }
+
+    parallel_for(sync.numBoxes, threads, diff_box, &sync);
+    for(i = 0; i < sync.numBoxes; i++){
+        SyncBox *sb = &sync.boxes[i];
+        int j;
+
+        for(j = sb->first; j < sb->first + sb->count; j++){
+            SyncItem *item = &sync.items[j];
+            char name[VALUE_LEN];
+
+            if(!item->changed)
+                continue;
+            changes++;
+            printf("%s %s: \"%s\" -> \"%s\"\n", item->description,
+                   field_name(item, name), item->current, item->value);
+        }
+    }
+
+    if(!dryRun && changes > 0)
+        parallel_for(sync.numBoxes, threads, apply_box, &sync);
+
+    for(i = 0; i < sync.numItems; i++){
+        SyncItem *item = &sync.items[i];
+        char name[VALUE_LEN];
+
+        if(item->result != RSC2_SUCCESS)
+            printf("%s %s: %s\n", item->description, field_name(item, name),
+                   Rsc2_ResultCodeToString(item->result));
+    }
+    printf("sync: %d boxes, %d settings, %d changed, %ld reads, %ld writes, %ld failed, %d missing boxes, %.0f ms%s\n",
+           sync.numBoxes, sync.numItems, changes, sync.reads, sync.writes, sync.failures,
+           missing, (now_us() - started) / 1000.0, dryRun ? " (dry run)" : "");
+
+    free(sync.descriptions);
+    free(sync.boxes);
+    free(sync.items);
+    fleet_close(&sync.fleet);
+    return sync.failures || missing ? -1 : 0;
+}
@@ -0,0 +1,249 @@
+#include "topology.h"
+
+#define LINE_LEN        512
+
+typedef struct
+{
+    char name[HOST_NAME_LEN];
+    Rsc2_Host *host;
+    volatile LONG stale;        /* boxes were added or removed since the index was written */
+} TopoHost;
+
+struct Topology
+{
+    char path[MAX_PATH];
+    TopologyEntry *entries;
+    int numEntries;
+    int dirty;
+    TopoHost hosts[MAX_HOSTS];
+    int numHosts;
+    Rsc2_HostListener listener;
+};
+
+static int compare_entries(const void *a, const void *b){
+    const TopologyEntry *x = a, *y = b;
+    int diff = strcmp(x->key, y->key);
+
+    if(diff != 0)
+        return diff;
+    diff = strcmp(x->host, y->host);
+    return diff != 0 ? diff : x->boxIndex - y->boxIndex;
+}
+
+int topology_scan_host(Rsc2_Host *host, const char *name, TopologyEntry **entries){
+    int num = Rsc2_GetNumBoxes(host);
+    int i;
+
+    *entries = calloc(num + 1, sizeof(TopologyEntry));
+    for(i = 0; i < num; i++){
+        TopologyEntry *entry = &(*entries)[i];
+        Rsc2_Box *box = Rsc2_GetBox(host, i);
+
+        if(box == NULL){
+            free(*entries);
+            *entries = NULL;
+            return -1;
+        }
+        strncpy(entry->host, name, HOST_NAME_LEN - 1);
+        entry->boxIndex = i;
+        Rsc2_GetDescription(box, entry->description, TOPOLOGY_TEXT_LEN);
+        Rsc2_GetUserLabel(box, entry->key, TOPOLOGY_TEXT_LEN);
+        if(entry->key[0] == '\0')
+            strcpy(entry->key, entry->description);
+    }
+    return num;
+}
+
+int topology_write(const char *path, TopologyEntry *entries, int count){
+    FILE *file = NULL;
+    int i;
+
+    qsort(entries, count, sizeof(TopologyEntry), compare_entries);
+    file = fopen(path, "w");
+    if(file == NULL){
+        printf("unable to write %s\n", path);
+        return -1;
+    }
+    fprintf(file, "# rsctool topology index: label, host, box index, description\n");
+    for(i = 0; i < count; i++)
+        fprintf(file, "%s\t%s\t%d\t%s\n", entries[i].key, entries[i].host, entries[i].boxIndex, entries[i].description);
+    fclose(file);
+    return 0;
+}
+
+Topology *topology_load(const char *path){
+    Topology *topo = NULL;
+    char line[LINE_LEN];
+    int capacity = 256;
+    int lineNo = 0;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        printf("unable to open %s, run rsctool discover first\n", path);
+        return NULL;
+    }
+    topo = calloc(1, sizeof(Topology));
+    strncpy(topo->path, path, MAX_PATH - 1);
+    topo->entries = malloc(capacity * sizeof(TopologyEntry));
+    while(fgets(line, LINE_LEN, file) != NULL){
+        TopologyEntry *entry = NULL;
+        char *fields[4];
+        int i;
+
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+        fields[0] = strtok(line, "\t");
+        for(i = 1; i < 4; i++)
+            fields[i] = strtok(NULL, "\t");
+        if(fields[3] == NULL){
+            printf("%s:%d: invalid index line\n", path, lineNo);
+            fclose(file);
+            free(topo->entries);
+            free(topo);
+            return NULL;
+        }
+        if(topo->numEntries == capacity){
+            capacity *= 2;
+            topo->entries = realloc(topo->entries, capacity * sizeof(TopologyEntry));
+        }
+        entry = &topo->entries[topo->numEntries++];
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->key, fields[0], TOPOLOGY_TEXT_LEN - 1);
+        strncpy(entry->host, fields[1], HOST_NAME_LEN - 1);
+        entry->boxIndex = atoi(fields[2]);
+        strncpy(entry->description, fields[3], TOPOLOGY_TEXT_LEN - 1);
+    }
+    fclose(file);
+    /* the file is written sorted, a hand edited one may not be */
+    qsort(topo->entries, topo->numEntries, sizeof(TopologyEntry), compare_entries);
+    return topo;
+}
+
+static void on_box_changed(Rsc2_Host *host, Rsc2_Box *box){
+    TopoHost *th = Rsc2_GetObjectClientData((Rsc2_Object *)host);
+
+    (void)box;
+    if(th != NULL)
+        InterlockedExchange(&th->stale, 1);
+}
+
+static TopoHost *connect_host(Topology *topo, const char *name){
+    TopoHost *th = NULL;
+    int i;
+
+    for(i = 0; i < topo->numHosts; i++){
+        if(strcmp(topo->hosts[i].name, name) == 0)
+            return &topo->hosts[i];
+    }
+    if(topo->numHosts == MAX_HOSTS)
+        return NULL;
+    th = &topo->hosts[topo->numHosts];
+    th->host = Rsc2_ConnectToHost(name);
+    if(th->host == NULL)
+        return NULL;
+    strcpy(th->name, name);
+    topo->numHosts++;
+    topo->listener.boxAdded = on_box_changed;
+    topo->listener.boxRemoved = on_box_changed;
+    Rsc2_SetObjectClientData((Rsc2_Object *)th->host, th);
+    Rsc2_AttachHostListener(th->host, &topo->listener);
+    return th;
+}
+
+static TopologyEntry *find_entry(Topology *topo, const char *key){
+    int low = 0, high = topo->numEntries - 1;
+
+    while(low <= high){
+        int middle = (low + high) / 2;
+        int diff = strcmp(key, topo->entries[middle].key);
+
+        if(diff == 0){
+            /* the first of duplicate labels */
+            while(middle > 0 && strcmp(key, topo->entries[middle - 1].key) == 0)
+                middle--;
+            return &topo->entries[middle];
+        }
+        if(diff < 0)
+            high = middle - 1;
+        else
+            low = middle + 1;
+    }
+    return NULL;
+}
+
+/* replaces the entries of one host with what it has now */
+static int rescan_host(Topology *topo, TopoHost *th){
+    TopologyEntry *fresh = NULL;
+    int num, i, kept = 0;
+
+    InterlockedExchange(&th->stale, 0);
+    num = topology_scan_host(th->host, th->name, &fresh);
+    if(num < 0)
+        return -1;
+    for(i = 0; i < topo->numEntries; i++){
+        if(strcmp(topo->entries[i].host, th->name) != 0)
+            topo->entries[kept++] = topo->entries[i];
+    }
+    topo->entries = realloc(topo->entries, (kept + num + 1) * sizeof(TopologyEntry));
+    memcpy(&topo->entries[kept], fresh, num * sizeof(TopologyEntry));
+    topo->numEntries = kept + num;
+    qsort(topo->entries, topo->numEntries, sizeof(TopologyEntry), compare_entries);
+    topo->dirty = 1;
+    free(fresh);
+    return 0;
+}
+
+Rsc2_Box *topology_box(Topology *topo, const char *key){
+    char description[TOPOLOGY_TEXT_LEN];
+    TopologyEntry *entry = find_entry(topo, key);
+    TopoHost *th = NULL;
+    Rsc2_Box *box = NULL;
+
+    if(entry == NULL){
+        printf("%s is not in %s, run rsctool discover again\n", key, topo->path);
+        return NULL;
+    }
+    th = connect_host(topo, entry->host);
+    if(th == NULL){
+        print_rsc_error("unable to connect to the host of the box");
+        return NULL;
+    }
+    if(!th->stale){
+        box = Rsc2_GetBox(th->host, entry->boxIndex);
+        description[0] = '\0';
+        if(box != NULL)
+            Rsc2_GetDescription(box, description, TOPOLOGY_TEXT_LEN);
+        if(strcmp(description, entry->description) == 0)
+            return box;
+    }
+
+    /* the host changed under the index */
+    printf("%s moved, enumerating %s again\n", key, th->name);
+    if(rescan_host(topo, th) != 0){
+        print_rsc_error("unable to enumerate the host");
+        return NULL;
+    }
+    entry = find_entry(topo, key);
+    if(entry == NULL || strcmp(entry->host, th->name) != 0){
+        printf("%s is no longer on %s, run rsctool discover again\n", key, th->name);
+        return NULL;
+    }
+    return Rsc2_GetBox(th->host, entry->boxIndex);
+}
+
+void topology_close(Topology *topo){
+    int i;
+
+    if(topo == NULL)
+        return;
+    for(i = 0; i < topo->numHosts; i++){
+        Rsc2_DetachHostListener(topo->hosts[i].host, &topo->listener);
+        Rsc2_SetObjectClientData((Rsc2_Object *)topo->hosts[i].host, NULL);
+    }
+    if(topo->dirty)
+        topology_write(topo->path, topo->entries, topo->numEntries);
+    free(topo->entries);
+    free(topo);
+}
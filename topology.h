@@ -0,0 +1,52 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "common.h"
+
+/**************************************************
+* on-disk topology index
+* written by rsctool discover: one line per box,
+*   <key>  <host>  <box index>  <description>
+* tab separated and sorted by key, the user label of
+* the box or its description when it has no label.
+* commands open a box by label straight from the
+* index: one connect and one GetBox instead of
+* enumerating every host. an entry is checked against
+* the description of the box it names; a host whose
+* boxes were added or removed since (boxAdded and
+* boxRemoved), or whose entry does not match, is
+* enumerated again and the index rewritten on close.
+* the topology owns the host listeners and the client
+* data of the hosts it connects to.
+**************************************************/
+
+#define TOPOLOGY_PATH       "rsctool.idx"
+#define TOPOLOGY_TEXT_LEN   64
+
+typedef struct
+{
+    char key[TOPOLOGY_TEXT_LEN];
+    char host[HOST_NAME_LEN];
+    int boxIndex;
+    char description[TOPOLOGY_TEXT_LEN];
+} TopologyEntry;
+
+typedef struct Topology Topology;
+
+/* enumerates the boxes of a connected host into a new array
+ * of entries, returns how many or -1 when the host failed */
+int topology_scan_host(Rsc2_Host *host, const char *name, TopologyEntry **entries);
+
+/* sorts the entries by key and writes them to "path" */
+int topology_write(const char *path, TopologyEntry *entries, int count);
+
+/* NULL when the index can not be read */
+Topology *topology_load(const char *path);
+
+/* the box with label (or description) "key", NULL when there is none */
+Rsc2_Box *topology_box(Topology *topo, const char *key);
+
+/* rewrites the index when entries were revalidated */
+void topology_close(Topology *topo);
+
+#endif /* TOPOLOGY_H */
@@ -0,0 +1,343 @@
+#define TRACE_NO_WRAP
+#include "common.h"
+
+#define TRACE_NAMES         65536       /* named objects, power of two */
+#define TRACE_NAME_LEN      96
+
+enum
+{
+    TRACE_STEP,
+    TRACE_RESULT,                       /* value is an Rsc2_Result */
+    TRACE_VALUE,
+    TRACE_POINTER,                      /* value tells whether one was returned */
+    TRACE_VOID
+};
+
+typedef struct
+{
+    const char *name;
+    long long start;
+    long long duration;
+    const void *object;
+    int kind;
+    int value;
+    DWORD tid;
+} TraceEvent;
+
+typedef struct TraceThread TraceThread;
+
+/* one thread at a time records into a ring, each event keeps its tid */
+struct TraceThread
+{
+    DWORD tid;                          /* the thread using it now */
+    TraceEvent *events;                 /* ring of ringSize */
+    long count;                         /* events ever recorded */
+    TraceThread *next;                  /* every ring */
+    TraceThread *nextFree;
+};
+
+typedef struct
+{
+    const void *object;
+    char name[TRACE_NAME_LEN];
+} TraceName;
+
+volatile LONG traceEnabled;
+static volatile LONG recording;         /* threads inside record() */
+
+static struct
+{
+    FILE *file;
+    int ringSize;
+    DWORD fls;
+    CRITICAL_SECTION lock;              /* threads list, free list and names */
+    TraceThread *threads;
+    TraceThread *free;
+    int numThreads;
+    TraceName *names;
+    int numNames;
+} trace;
+
+/* fls callback, runs when a thread that recorded exits */
+static void WINAPI release_thread(PVOID data){
+    TraceThread *thread = data;
+
+    EnterCriticalSection(&trace.lock);
+    thread->nextFree = trace.free;
+    trace.free = thread;
+    LeaveCriticalSection(&trace.lock);
+}
+
+static TraceThread *this_thread(void){
+    TraceThread *thread = FlsGetValue(trace.fls);
+
+    if(thread != NULL)
+        return thread;
+    EnterCriticalSection(&trace.lock);
+    thread = trace.free;
+    if(thread != NULL)
+        trace.free = thread->nextFree;
+    LeaveCriticalSection(&trace.lock);
+    if(thread == NULL){
+        thread = calloc(1, sizeof(TraceThread));
+        thread->events = calloc(trace.ringSize, sizeof(TraceEvent));
+        if(thread->events == NULL){
+            free(thread);
+            return NULL;
+        }
+        EnterCriticalSection(&trace.lock);
+        thread->next = trace.threads;
+        trace.threads = thread;
+        trace.numThreads++;
+        LeaveCriticalSection(&trace.lock);
+    }
+    thread->tid = GetCurrentThreadId();
+    FlsSetValue(trace.fls, thread);
+    return thread;
+}
+
+/* counted in before traceEnabled is tested again, trace_stop clears
+ * it first and then waits for the count to drain */
+static void record(const char *name, long long start, const void *object, int kind, int value){
+    TraceThread *thread = NULL;
+    TraceEvent *event = NULL;
+
+    InterlockedIncrement(&recording);
+    if(traceEnabled && (thread = this_thread()) != NULL){
+        event = &thread->events[thread->count % trace.ringSize];
+        event->name = name;
+        event->start = start;
+        event->duration = now_us() - start;
+        event->object = object;
+        event->kind = kind;
+        event->value = value;
+        event->tid = thread->tid;
+        thread->count++;
+    }
+    InterlockedDecrement(&recording);
+}
+
+void trace_end(const char *name, long long start, const void *object){
+    if(traceEnabled && start != 0)
+        record(name, start, object, TRACE_STEP, 0);
+}
+
+static TraceName *find_name(const void *object){
+    unsigned int slot = (unsigned int)(((size_t)object >> 4) * 2654435761u) & (TRACE_NAMES - 1);
+
+    while(trace.names[slot].object != NULL && trace.names[slot].object != object)
+        slot = (slot + 1) & (TRACE_NAMES - 1);
+    return &trace.names[slot];
+}
+
+void trace_name(const void *object, const void *parent, const char *name){
+    TraceName *entry = NULL;
+
+    if(!traceEnabled || object == NULL)
+        return;
+    EnterCriticalSection(&trace.lock);
+    entry = find_name(object);
+    if(entry->object == NULL && trace.numNames < TRACE_NAMES * 3 / 4){
+        TraceName *parentEntry = parent != NULL ? find_name(parent) : NULL;
+
+        if(parentEntry != NULL && parentEntry->object != NULL)
+            snprintf(entry->name, TRACE_NAME_LEN, "%s/%s", parentEntry->name, name);
+        else
+            snprintf(entry->name, TRACE_NAME_LEN, "%s", name);
+        entry->object = object;
+        trace.numNames++;
+    }
+    LeaveCriticalSection(&trace.lock);
+}
+
+int trace_start(const char *path, int ringSize){
+    trace.file = fopen(path, "w");
+    if(trace.file == NULL){
+        printf("unable to open trace file %s\n", path);
+        return -1;
+    }
+    trace.ringSize = ringSize > 0 ? ringSize : 1;
+    trace.fls = FlsAlloc(release_thread);
+    trace.names = calloc(TRACE_NAMES, sizeof(TraceName));
+    if(trace.fls == FLS_OUT_OF_INDEXES || trace.names == NULL){
+        printf("unable to start tracing\n");
+        fclose(trace.file);
+        return -1;
+    }
+    InitializeCriticalSection(&trace.lock);
+    now_us();
+    InterlockedExchange(&traceEnabled, 1);
+    return 0;
+}
+
+static void write_string(FILE *f, const char *text){
+    fputc('"', f);
+    for(; *text != '\0'; text++){
+        if(*text == '"' || *text == '\\')
+            fputc('\\', f);
+        if((unsigned char)*text >= ' ')
+            fputc(*text, f);
+    }
+    fputc('"', f);
+}
+
+static void write_event(FILE *f, const TraceEvent *event, DWORD pid){
+    TraceName *name = find_name(event->object);
+
+    fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%lu,\"tid\":%lu,\"args\":{",
+            event->name, event->kind == TRACE_STEP ? "step" : "rsc2", event->start, event->duration,
+            (unsigned long)pid, (unsigned long)event->tid);
+    if(name->object != NULL){
+        fprintf(f, "\"object\":");
+        write_string(f, name->name);
+    }else if(event->object != NULL){
+        fprintf(f, "\"object\":\"%p\"", event->object);
+    }
+    switch(event->kind){
+    case TRACE_RESULT:
+        fprintf(f, ",\"result\":\"%s\"", Rsc2_ResultCodeToString((Rsc2_Result)event->value));
+        break;
+    case TRACE_VALUE:
+        fprintf(f, ",\"value\":%d", event->value);
+        break;
+    case TRACE_POINTER:
+        fprintf(f, ",\"result\":\"%s\"", event->value ? "ok" : "NULL");
+        break;
+    }
+    fprintf(f, "}}");
+}
+
+void trace_stop(void){
+    DWORD pid = GetCurrentProcessId();
+    TraceThread *thread = NULL;
+    long events = 0, dropped = 0;
+
+    if(!traceEnabled)
+        return;
+    InterlockedExchange(&traceEnabled, 0);
+    /* calls that return from here on record nothing */
+    while(recording != 0)
+        YieldProcessor();
+    fprintf(trace.file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"name\":\"rsctool\"}}", (unsigned long)pid);
+    EnterCriticalSection(&trace.lock);
+    for(thread = trace.threads; thread != NULL; thread = thread->next){
+        long first = thread->count > trace.ringSize ? thread->count - trace.ringSize : 0;
+        long i;
+
+        for(i = first; i < thread->count; i++)
+            write_event(trace.file, &thread->events[i % trace.ringSize], pid);
+        events += thread->count - first;
+        dropped += first;
+    }
+    LeaveCriticalSection(&trace.lock);
+    fprintf(trace.file, "\n]}\n");
+    fclose(trace.file);
+    printf("trace: %ld events written from %d rings", events, trace.numThreads);
+    if(dropped > 0)
+        printf(", %ld older ones overwritten (raise --trace-events)", dropped);
+    printf("\n");
+}
+
+/* the wrappers. the library is called directly while tracing is off */
+
+#define TRACED(type, fn, kind, object, params, args) \
+    type traced_##fn params{ \
+        long long start; \
+        type result; \
+        if(!traceEnabled) \
+            return fn args; \
+        start = now_us(); \
+        result = fn args; \
+        record(#fn, start, object, kind, (int)(size_t)result); \
+        return result; \
+    }
+
+#define TRACED_VOID(fn, object, params, args) \
+    void traced_##fn params{ \
+        long long start; \
+        if(!traceEnabled){ \
+            fn args; \
+            return; \
+        } \
+        start = now_us(); \
+        fn args; \
+        record(#fn, start, object, TRACE_VOID, 0); \
+    }
+
+Rsc2_Host *traced_Rsc2_ConnectToHost(const char *name){
+    long long start;
+    Rsc2_Host *host;
+
+    if(!traceEnabled)
+        return Rsc2_ConnectToHost(name);
+    start = now_us();
+    host = Rsc2_ConnectToHost(name);
+    trace_name(host, NULL, name);
+    record("Rsc2_ConnectToHost", start, host, TRACE_POINTER, host != NULL);
+    return host;
+}
+
+Rsc2_Box *traced_Rsc2_GetBox(Rsc2_Host *host, int index){
+    char name[16];
+    long long start;
+    Rsc2_Box *box;
+
+    if(!traceEnabled)
+        return Rsc2_GetBox(host, index);
+    start = now_us();
+    box = Rsc2_GetBox(host, index);
+    sprintf(name, "%d", index);
+    trace_name(box, host, name);
+    record("Rsc2_GetBox", start, box != NULL ? (const void *)box : (const void *)host, TRACE_POINTER, box != NULL);
+    return box;
+}
+
+Rsc2_Signal *traced_Rsc2_GetSignal(Rsc2_Box *box, Rsc2_SignalID signalId){
+    const char *name = NULL;
+    long long start;
+    Rsc2_Signal *sig;
+
+    if(!traceEnabled)
+        return Rsc2_GetSignal(box, signalId);
+    start = now_us();
+    sig = Rsc2_GetSignal(box, signalId);
+    name = Rsc2_SignalIDToAssignedString(signalId);
+    trace_name(sig, box, strncmp(name, "RSC2_ID_", 8) == 0 ? name + 8 : name);
+    record("Rsc2_GetSignal", start, sig != NULL ? (const void *)sig : (const void *)box, TRACE_POINTER, sig != NULL);
+    return sig;
+}
+
+TRACED_VOID(Rsc2_AttachHostListener, host, (Rsc2_Host *host, Rsc2_HostListener *listener), (host, listener))
+TRACED_VOID(Rsc2_DetachHostListener, host, (Rsc2_Host *host, Rsc2_HostListener *listener), (host, listener))
+TRACED(int, Rsc2_GetNumBoxes, TRACE_VALUE, host, (Rsc2_Host *host), (host))
+TRACED_VOID(Rsc2_AttachBoxListener, box, (Rsc2_Box *box, Rsc2_BoxListener *listener), (box, listener))
+TRACED_VOID(Rsc2_DetachBoxListener, box, (Rsc2_Box *box, Rsc2_BoxListener *listener), (box, listener))
+TRACED(Rsc2_Result, Rsc2_SetUserLabel, TRACE_RESULT, box, (Rsc2_Box *box, const char *label), (box, label))
+TRACED(Rsc2_Result, Rsc2_SetKvmAddress, TRACE_RESULT, box, (Rsc2_Box *box, const char *address), (box, address))
+TRACED(Rsc2_Result, Rsc2_LockBox, TRACE_RESULT, box, (Rsc2_Box *box, const char *contact), (box, contact))
+TRACED(Rsc2_Result, Rsc2_UnlockBox, TRACE_RESULT, box, (Rsc2_Box *box), (box))
+TRACED(Rsc2_Result, Rsc2_SetUsbMux, TRACE_RESULT, box, (Rsc2_Box *box, Rsc2_UsbMuxState state), (box, state))
+TRACED(int, Rsc2_GetDescription, TRACE_VALUE, box, (Rsc2_Box *box, char *buf, int size), (box, buf, size))
+TRACED(int, Rsc2_GetUserLabel, TRACE_VALUE, box, (Rsc2_Box *box, char *buf, int size), (box, buf, size))
+TRACED(int, Rsc2_GetKvmAddress, TRACE_VALUE, box, (Rsc2_Box *box, char *buf, int size), (box, buf, size))
+TRACED(int, Rsc2_GetLockHolder, TRACE_VALUE, box, (Rsc2_Box *box, char *buf, int size), (box, buf, size))
+TRACED(Rsc2_BoxStatus, Rsc2_GetOnlineStatus, TRACE_VALUE, box, (Rsc2_Box *box), (box))
+TRACED(Rsc2_UsbMuxState, Rsc2_GetUsbMuxState, TRACE_VALUE, box, (Rsc2_Box *box), (box))
+TRACED(Rsc2_Result, Rsc2_PwrCycleStart, TRACE_RESULT, box,
+       (Rsc2_Box *box, Rsc2_PwrCycleType cycleType, int cycleCount, int bootTimeout,
+        int startOffTime, int endOffTime, int offTimeStep, int acDcDelay),
+       (box, cycleType, cycleCount, bootTimeout, startOffTime, endOffTime, offTimeStep, acDcDelay))
+TRACED(Rsc2_Result, Rsc2_PwrCycleGetStatus, TRACE_RESULT, box, (Rsc2_Box *box, Rsc2_PwrCycleStatus *status), (box, status))
+TRACED(Rsc2_Result, Rsc2_PwrCycleStop, TRACE_RESULT, box, (Rsc2_Box *box), (box))
+TRACED(Rsc2_Result, Rsc2_PwrCycleContinue, TRACE_RESULT, box, (Rsc2_Box *box), (box))
+TRACED(Rsc2_Result, Rsc2_PwrCycleGetTotalTime, TRACE_RESULT, box, (Rsc2_Box *box, int *time), (box, time))
+TRACED(Rsc2_Result, Rsc2_SetSigAssertionState, TRACE_RESULT, sig, (Rsc2_Signal *sig, Rsc2_SignalState state), (sig, state))
+TRACED(Rsc2_SignalState, Rsc2_GetSigAssertionState, TRACE_VALUE, sig, (Rsc2_Signal *sig), (sig))
+TRACED(Rsc2_Result, Rsc2_SetSigAssertionType, TRACE_RESULT, sig, (Rsc2_Signal *sig, Rsc2_AssertionType type), (sig, type))
+TRACED(Rsc2_AssertionType, Rsc2_GetSigAssertionType, TRACE_VALUE, sig, (Rsc2_Signal *sig), (sig))
+TRACED(int, Rsc2_GetSigName, TRACE_VALUE, sig, (Rsc2_Signal *sig, char *buf, int size), (sig, buf, size))
+TRACED(Rsc2_Result, Rsc2_SetSigName, TRACE_RESULT, sig, (Rsc2_Signal *sig, const char *name), (sig, name))
+TRACED(int, Rsc2_GetSigGenericName, TRACE_VALUE, sig, (Rsc2_Signal *sig, char *buf, int size), (sig, buf, size))
+TRACED(Rsc2_SignalType, Rsc2_GetSigType, TRACE_VALUE, sig, (Rsc2_Signal *sig), (sig))
+TRACED_VOID(Rsc2_SetSigType, sig, (Rsc2_Signal *sig, Rsc2_SignalType type), (sig, type))
@@ -0,0 +1,111 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "rsc2/include/Rsc2CApi.h"
+#include <windows.h>
+
+/**************************************************
+* call tracing in chrome trace-event format
+* "rsctool <command> --trace file" records every
+* remote rsc2 api call (the wrappers below replace
+* them in every file that includes common.h) and
+* the steps marked with trace_begin/trace_end into
+* a ring buffer per thread, and writes them as json
+* when the command returns. the ring of a thread that
+* exits is taken over by the next new one, so there
+* are as many rings as threads traced at once. open the file in
+* ui.perfetto.dev or chrome://tracing.
+* while tracing is off a call costs one test of
+* traceEnabled. local helpers (string conversions,
+* symbol tables, client data) are not traced.
+* define TRACE_NO_WRAP before including common.h to
+* call the library directly (trace.c, standin.c).
+**************************************************/
+
+extern volatile LONG traceEnabled;
+
+/* starts recording, "path" is written by trace_stop. events per
+ * thread beyond "ringSize" overwrite the oldest ones. */
+int trace_start(const char *path, int ringSize);
+void trace_stop(void);
+
+/* a step from trace_begin() to trace_end(), "name" must be a literal */
+#define trace_begin() (traceEnabled ? now_us() : 0)
+void trace_end(const char *name, long long start, const void *object);
+
+/* names an object (host, box, signal) in the trace */
+void trace_name(const void *object, const void *parent, const char *name);
+
+Rsc2_Host *traced_Rsc2_ConnectToHost(const char *host);
+void traced_Rsc2_AttachHostListener(Rsc2_Host *host, Rsc2_HostListener *listener);
+void traced_Rsc2_DetachHostListener(Rsc2_Host *host, Rsc2_HostListener *listener);
+int traced_Rsc2_GetNumBoxes(Rsc2_Host *host);
+Rsc2_Box *traced_Rsc2_GetBox(Rsc2_Host *host, int index);
+void traced_Rsc2_AttachBoxListener(Rsc2_Box *box, Rsc2_BoxListener *listener);
+void traced_Rsc2_DetachBoxListener(Rsc2_Box *box, Rsc2_BoxListener *listener);
+Rsc2_Result traced_Rsc2_SetUserLabel(Rsc2_Box *box, const char *label);
+Rsc2_Result traced_Rsc2_SetKvmAddress(Rsc2_Box *box, const char *address);
+Rsc2_Result traced_Rsc2_LockBox(Rsc2_Box *box, const char *contactString);
+Rsc2_Result traced_Rsc2_UnlockBox(Rsc2_Box *box);
+Rsc2_Result traced_Rsc2_SetUsbMux(Rsc2_Box *box, Rsc2_UsbMuxState state);
+Rsc2_Signal *traced_Rsc2_GetSignal(Rsc2_Box *box, Rsc2_SignalID signalId);
+int traced_Rsc2_GetDescription(Rsc2_Box *box, char *buf, int size);
+int traced_Rsc2_GetUserLabel(Rsc2_Box *box, char *buf, int size);
+int traced_Rsc2_GetKvmAddress(Rsc2_Box *box, char *buf, int size);
+int traced_Rsc2_GetLockHolder(Rsc2_Box *box, char *buf, int size);
+Rsc2_BoxStatus traced_Rsc2_GetOnlineStatus(Rsc2_Box *box);
+Rsc2_UsbMuxState traced_Rsc2_GetUsbMuxState(Rsc2_Box *box);
+Rsc2_Result traced_Rsc2_PwrCycleStart(Rsc2_Box *box, Rsc2_PwrCycleType cycleType, int cycleCount,
+                                      int bootTimeout, int startOffTime, int endOffTime,
+                                      int offTimeStep, int acDcDelay);
+Rsc2_Result traced_Rsc2_PwrCycleGetStatus(Rsc2_Box *box, Rsc2_PwrCycleStatus *status);
+Rsc2_Result traced_Rsc2_PwrCycleStop(Rsc2_Box *box);
+Rsc2_Result traced_Rsc2_PwrCycleContinue(Rsc2_Box *box);
+Rsc2_Result traced_Rsc2_PwrCycleGetTotalTime(Rsc2_Box *box, int *time);
+Rsc2_Result traced_Rsc2_SetSigAssertionState(Rsc2_Signal *sig, Rsc2_SignalState state);
+Rsc2_SignalState traced_Rsc2_GetSigAssertionState(Rsc2_Signal *sig);
+Rsc2_Result traced_Rsc2_SetSigAssertionType(Rsc2_Signal *sig, Rsc2_AssertionType type);
+Rsc2_AssertionType traced_Rsc2_GetSigAssertionType(Rsc2_Signal *sig);
+int traced_Rsc2_GetSigName(Rsc2_Signal *sig, char *buf, int size);
+Rsc2_Result traced_Rsc2_SetSigName(Rsc2_Signal *sig, const char *name);
+int traced_Rsc2_GetSigGenericName(Rsc2_Signal *sig, char *buf, int size);
+Rsc2_SignalType traced_Rsc2_GetSigType(Rsc2_Signal *sig);
+void traced_Rsc2_SetSigType(Rsc2_Signal *sig, Rsc2_SignalType type);
+
+#ifndef TRACE_NO_WRAP
+#define Rsc2_ConnectToHost          traced_Rsc2_ConnectToHost
+#define Rsc2_AttachHostListener     traced_Rsc2_AttachHostListener
+#define Rsc2_DetachHostListener     traced_Rsc2_DetachHostListener
+#define Rsc2_GetNumBoxes            traced_Rsc2_GetNumBoxes
+#define Rsc2_GetBox                 traced_Rsc2_GetBox
+#define Rsc2_AttachBoxListener      traced_Rsc2_AttachBoxListener
+#define Rsc2_DetachBoxListener      traced_Rsc2_DetachBoxListener
+#define Rsc2_SetUserLabel           traced_Rsc2_SetUserLabel
+#define Rsc2_SetKvmAddress          traced_Rsc2_SetKvmAddress
+#define Rsc2_LockBox                traced_Rsc2_LockBox
+#define Rsc2_UnlockBox              traced_Rsc2_UnlockBox
+#define Rsc2_SetUsbMux              traced_Rsc2_SetUsbMux
+#define Rsc2_GetSignal              traced_Rsc2_GetSignal
+#define Rsc2_GetDescription         traced_Rsc2_GetDescription
+#define Rsc2_GetUserLabel           traced_Rsc2_GetUserLabel
+#define Rsc2_GetKvmAddress          traced_Rsc2_GetKvmAddress
+#define Rsc2_GetLockHolder          traced_Rsc2_GetLockHolder
+#define Rsc2_GetOnlineStatus        traced_Rsc2_GetOnlineStatus
+#define Rsc2_GetUsbMuxState         traced_Rsc2_GetUsbMuxState
+#define Rsc2_PwrCycleStart          traced_Rsc2_PwrCycleStart
+#define Rsc2_PwrCycleGetStatus      traced_Rsc2_PwrCycleGetStatus
+#define Rsc2_PwrCycleStop           traced_Rsc2_PwrCycleStop
+#define Rsc2_PwrCycleContinue       traced_Rsc2_PwrCycleContinue
+#define Rsc2_PwrCycleGetTotalTime   traced_Rsc2_PwrCycleGetTotalTime
+#define Rsc2_SetSigAssertionState   traced_Rsc2_SetSigAssertionState
+#define Rsc2_GetSigAssertionState   traced_Rsc2_GetSigAssertionState
+#define Rsc2_SetSigAssertionType    traced_Rsc2_SetSigAssertionType
+#define Rsc2_GetSigAssertionType    traced_Rsc2_GetSigAssertionType
+#define Rsc2_GetSigName             traced_Rsc2_GetSigName
+#define Rsc2_SetSigName             traced_Rsc2_SetSigName
+#define Rsc2_GetSigGenericName      traced_Rsc2_GetSigGenericName
+#define Rsc2_GetSigType             traced_Rsc2_GetSigType
+#define Rsc2_SetSigType             traced_Rsc2_SetSigType
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,458 @@
+#include "common.h"
+#include "commands.h"
+#include "leddecode.h"
+#ifdef RSC_STANDIN
+#include "standin.h"
+#endif
+
+/**************************************************
+* rsctool watchdog [--hosts h1,h2] [--duration sec]
+*                  [--led green|amber|blue] [--expect on|blink]
+*                  [--grace sec] [--boot-grace sec]
+*                  [--host-burst n] [--host-rate n]
+*                  [--steady-ms ms] [--log file] [--boot]
+*                  [--hang n] [--hang-every sec]
+* watches the power led and a liveness led of every
+* box. a powered box whose liveness led is not steady
+* on (--expect on) or blinking (--expect blink) for
+* --grace seconds is hung and gets, one after the
+* other until it is healthy again within --boot-grace:
+*   1. a reset button press
+*   2. a 5 s power button press, then power on
+*   3. an ac cycle of both ports, then power on
+* a box none of them recovers is given up on until
+* its liveness led is healthy again, e.g. repaired.
+* each host has a token bucket for the actions: up to
+* --host-burst of them back to back, refilled at
+* --host-rate per minute. every action goes to
+* the console and, as csv, to --log.
+* --hang hangs n random boxes, one every --hang-every
+* seconds (Standin build only).
+**************************************************/
+
+#define DESC_LEN        64
+#define TICK_MS         200
+#define NUM_STEPS       3
+#define SHORT_PRESS_MS  200
+#define LONG_PRESS_MS   5000
+#define OFF_TIME_MS     2000
+#define AC_OFF_MS       5000
+
+enum
+{
+    DOG_OFF,            /* power led off, not judged */
+    DOG_HEALTHY,
+    DOG_SUSPECT,        /* unhealthy, still within --grace */
+    DOG_HUNG,           /* waiting for the host to allow an action */
+    DOG_ACTING,         /* recovery action running */
+    DOG_VERIFY,         /* action done, waiting up to --boot-grace */
+    DOG_GAVE_UP         /* watched again once healthy */
+};
+
+static const char *stepNames[NUM_STEPS] = { "reset", "power long press", "ac cycle" };
+
+typedef struct DogBox DogBox;
+
+typedef struct
+{
+    DogBox *owner;
+    int index;          /* 0 power led, 1 liveness led */
+    Rsc2_Signal *sig;
+} DogWatch;
+
+struct DogBox
+{
+    Rsc2_Box *box;
+    int hostIndex;
+    char description[DESC_LEN];
+    CRITICAL_SECTION lock;
+    LedDecoder leds[2];
+    DogWatch watch[2];
+    int state;
+    int step;                   /* next recovery step */
+    long long since;            /* entered the current state */
+    long long hungAt;
+    volatile LONG acting;
+    Rsc2_Result actionResult;
+    long long healthyUs;
+    long long hungUs;
+};
+
+typedef struct
+{
+    double tokens;
+    long long refilledAt;
+} DogBucket;
+
+typedef struct
+{
+    Fleet fleet;
+    DogBox *boxes;
+    DogBucket buckets[MAX_HOSTS];
+    Rsc2_SignalID liveLed;
+    int expectBlink;
+    long long graceUs;
+    long long bootGraceUs;
+    int hostBurst;
+    int hostRate;
+    int steadyMs;
+    long long startedAt;
+    FILE *log;
+    Rsc2_BoxListener listener;
+    int hangs;
+    int actions[NUM_STEPS];
+    int recovered[NUM_STEPS];
+    int gaveUp;
+    int throttled;
+    long long recoverSum;
+    long long recoverMax;
+} Watchdog;
+
+static Watchdog dog;
+
+/* runs on the library's event thread, no remote calls here: the level
+ * is inferred from the transition, update_box re-reads a led that
+ * went steady in case an event was lost */
+static void on_sig_state_changed(Rsc2_Signal *sig){
+    DogWatch *watch = Rsc2_GetObjectClientData((Rsc2_Object *)sig);
+    long long at = now_us();
+    LedDecoder *led = NULL;
+
+    if(watch == NULL)
+        return;
+    led = &watch->owner->leds[watch->index];
+    EnterCriticalSection(&watch->owner->lock);
+    led_decoder_edge(led, !led->level, at);
+    LeaveCriticalSection(&watch->owner->lock);
+}
+
+/* off the event thread: a lost event leaves the inferred level wrong */
+static void resync_led(DogBox *owner, int index, long long now){
+    int level = Rsc2_GetSigAssertionState(owner->watch[index].sig);
+
+    EnterCriticalSection(&owner->lock);
+    if(level >= 0 && level != owner->leds[index].level)
+        led_decoder_init(&owner->leds[index], level, now, dog.steadyMs);
+    LeaveCriticalSection(&owner->lock);
+}
+
+static void record(DogBox *db, const char *event, const char *detail){
+    double at = (now_us() - dog.startedAt) / 1000000.0;
+
+    printf("%8.1f s  %-24s %-10s %s\n", at, db->description, event, detail);
+    if(dog.log != NULL){
+        fprintf(dog.log, "%.3f,%s,%s,%s\n", at, db->description, event, detail);
+        fflush(dog.log);
+    }
+}
+
+/* token bucket per host, refilled at --host-rate per minute */
+static int take_token(int hostIndex){
+    DogBucket *bucket = &dog.buckets[hostIndex];
+    long long now = now_us();
+
+    bucket->tokens += (now - bucket->refilledAt) / 60000000.0 * dog.hostRate;
+    if(bucket->tokens > dog.hostBurst)
+        bucket->tokens = dog.hostBurst;
+    bucket->refilledAt = now;
+    if(bucket->tokens < 1.0)
+        return 0;
+    bucket->tokens -= 1.0;
+    return 1;
+}
+
+static DWORD WINAPI action_thread(LPVOID arg){
+    DogBox *db = arg;
+    long long start = trace_begin();
+    Rsc2_Result result = RSC2_SUCCESS;
+
+    switch(db->step){
+    case 0:
+        result = press_button(db->box, RSC2_ID_FPBUT_RESET, SHORT_PRESS_MS);
+        break;
+    case 1:
+        result = press_button(db->box, RSC2_ID_FPBUT_PWR, LONG_PRESS_MS);
+        Sleep(OFF_TIME_MS);
+        if(result == RSC2_SUCCESS)
+            result = press_button(db->box, RSC2_ID_FPBUT_PWR, SHORT_PRESS_MS);
+        break;
+    default:
+        result = Rsc2_SetSigAssertionState(Rsc2_GetSignal(db->box, RSC2_ID_AC_1), RSC2_AC_OFF);
+        if(result == RSC2_SUCCESS)
+            result = Rsc2_SetSigAssertionState(Rsc2_GetSignal(db->box, RSC2_ID_AC_2), RSC2_AC_OFF);
+        Sleep(AC_OFF_MS);
+        if(result == RSC2_SUCCESS)
+            result = power_on_box(db->box);
+        break;
+    }
+    trace_end("recovery_action", start, db->box);
+    db->actionResult = result;
+    InterlockedExchange(&db->acting, 0);
+    return 0;
+}
+
+static void start_action(DogBox *db){
+    HANDLE thread = NULL;
+    char detail[64];
+
+    sprintf(detail, "step %d: %s", db->step + 1, stepNames[db->step]);
+    record(db, "action", detail);
+    dog.actions[db->step]++;
+    db->acting = 1;
+    thread = CreateThread(NULL, 0, action_thread, db, 0, NULL);
+    if(thread == NULL){
+        db->acting = 0;
+        db->actionResult = RSC2_ERR_UNSPECIFIED;
+    }else{
+        CloseHandle(thread);
+    }
+}
+
+static int is_healthy(DogBox *db){
+    LedDecoder *live = &db->leds[1];
+
+    if(dog.expectBlink)
+        return live->state == LED_BLINKING || live->state == LED_PATTERN;
+    return live->state == LED_STEADY_ON;
+}
+
+static void set_state(DogBox *db, int state, long long now){
+    db->state = state;
+    db->since = now;
+}
+
+static void update_box(DogBox *db, long long now, long long elapsed){
+    int powered, healthy, resync[2], i;
+    char detail[64];
+
+    EnterCriticalSection(&db->lock);
+    for(i = 0; i < 2; i++)
+        resync[i] = led_decoder_tick(&db->leds[i], now)
+                 && (db->leds[i].state == LED_STEADY_ON || db->leds[i].state == LED_STEADY_OFF);
+    LeaveCriticalSection(&db->lock);
+    for(i = 0; i < 2; i++){
+        if(resync[i])
+            resync_led(db, i, now);
+    }
+
+    EnterCriticalSection(&db->lock);
+    powered = db->leds[0].level;
+    healthy = powered && is_healthy(db);
+    LeaveCriticalSection(&db->lock);
+
+    if(healthy)
+        db->healthyUs += elapsed;
+    else if(db->state >= DOG_HUNG && db->state <= DOG_VERIFY)
+        db->hungUs += elapsed;
+
+    switch(db->state){
+    case DOG_OFF:
+    case DOG_HEALTHY:
+    case DOG_SUSPECT:
+        if(healthy)
+            set_state(db, DOG_HEALTHY, now);
+        else if(!powered)
+            set_state(db, DOG_OFF, now);
+        else if(db->state != DOG_SUSPECT)
+            set_state(db, DOG_SUSPECT, now);
+        else if(now - db->since >= dog.graceUs){
+            dog.hangs++;
+            db->hungAt = now;
+            db->step = 0;
+            set_state(db, DOG_HUNG, now);
+            record(db, "hung", "liveness led lost");
+        }
+        break;
+    case DOG_GAVE_UP:
+        if(healthy){
+            record(db, "healthy", "watched again");
+            set_state(db, DOG_HEALTHY, now);
+        }
+        break;
+    case DOG_HUNG:
+        if(take_token(db->hostIndex)){
+            start_action(db);
+            set_state(db, DOG_ACTING, now);
+        }else if(now - db->since < TICK_MS * 1000){
+            dog.throttled++;
+            record(db, "throttled", "host action budget used up");
+        }
+        break;
+    case DOG_ACTING:
+        if(!db->acting){
+            if(db->actionResult != RSC2_SUCCESS)
+                record(db, "failed", Rsc2_ResultCodeToString(db->actionResult));
+            set_state(db, DOG_VERIFY, now);
+        }
+        break;
+    case DOG_VERIFY:
+        if(healthy){
+            long long took = now - db->hungAt;
+
+            dog.recovered[db->step]++;
+            dog.recoverSum += took;
+            if(took > dog.recoverMax)
+                dog.recoverMax = took;
+            sprintf(detail, "after step %d, %.1f s since hang", db->step + 1, took / 1000000.0);
+            record(db, "recovered", detail);
+            set_state(db, DOG_HEALTHY, now);
+        }else if(now - db->since >= dog.bootGraceUs){
+            if(++db->step < NUM_STEPS){
+                set_state(db, DOG_HUNG, now);
+            }else{
+                dog.gaveUp++;
+                record(db, "gave up", "all recovery steps failed");
+                set_state(db, DOG_GAVE_UP, now);
+            }
+        }
+        break;
+    }
+}
+
+static int watch_box(DogBox *db, FleetBox *fb){
+    Rsc2_SignalID ids[2];
+    long long now = now_us();
+    int i;
+
+    ids[0] = RSC2_ID_LED_PWR;
+    ids[1] = dog.liveLed;
+    db->box = fb->box;
+    db->hostIndex = fb->hostIndex;
+    db->state = DOG_OFF;
+    db->since = now;
+    InitializeCriticalSection(&db->lock);
+    Rsc2_GetDescription(db->box, db->description, DESC_LEN);
+    for(i = 0; i < 2; i++){
+        Rsc2_Signal *sig = Rsc2_GetSignal(db->box, ids[i]);
+
+        if(sig == NULL)
+            return -1;
+        db->watch[i].owner = db;
+        db->watch[i].index = i;
+        db->watch[i].sig = sig;
+        led_decoder_init(&db->leds[i], Rsc2_GetSigAssertionState(sig) == RSC2_SIG_ASSERTED, now, dog.steadyMs);
+        Rsc2_SetObjectClientData((Rsc2_Object *)sig, &db->watch[i]);
+    }
+    Rsc2_AttachBoxListener(db->box, &dog.listener);
+    return 0;
+}
+
+static void power_on(int index, void *ctx){
+    (void)ctx;
+    if(power_on_box(dog.fleet.boxes[index].box) != RSC2_SUCCESS)
+        print_rsc_error("power on failed");
+}
+
+static void report(void){
+    long long healthy = 0, hung = 0;
+    long long total = (now_us() - dog.startedAt) * dog.fleet.numBoxes;
+    int recovered = 0, i;
+
+    for(i = 0; i < dog.fleet.numBoxes; i++){
+        healthy += dog.boxes[i].healthyUs;
+        hung += dog.boxes[i].hungUs;
+    }
+    printf("\nhangs: %d, gave up: %d, throttled: %d\n", dog.hangs, dog.gaveUp, dog.throttled);
+    for(i = 0; i < NUM_STEPS; i++){
+        printf("step %d %-17s %d actions, %d recoveries\n",
+               i + 1, stepNames[i], dog.actions[i], dog.recovered[i]);
+        recovered += dog.recovered[i];
+    }
+    if(recovered)
+        printf("time to recover: avg %.1f s, max %.1f s\n",
+               dog.recoverSum / 1000000.0 / recovered, dog.recoverMax / 1000000.0);
+    if(total > 0)
+        printf("box time: %.1f%% healthy, %.1f%% hung or recovering\n",
+               100.0 * healthy / total, 100.0 * hung / total);
+}
+
+int watchdog_main(int argc, char *argv[]){
+    const char *led = opt_str(argc, argv, "--led", "green");
+    const char *logPath = opt_str(argc, argv, "--log", NULL);
+    int duration = opt_int(argc, argv, "--duration", 0);
+    long long lastTick;
+    int i;
+#ifdef RSC_STANDIN
+    int hangs = opt_int(argc, argv, "--hang", 0);
+    int hangEvery = opt_int(argc, argv, "--hang-every", 30);
+    long long nextHang;
+#endif
+
+    memset(&dog, 0, sizeof(dog));
+    if(strcmp(led, "green") == 0){
+        dog.liveLed = RSC2_ID_LED_STATUS_GREEN;
+    }else if(strcmp(led, "amber") == 0){
+        dog.liveLed = RSC2_ID_LED_STATUS_AMBER;
+    }else if(strcmp(led, "blue") == 0){
+        dog.liveLed = RSC2_ID_LED_ID_BLUE;
+    }else{
+        printf("invalid --led %s, only green, amber or blue is supported\n", led);
+        return -1;
+    }
+    dog.expectBlink = strcmp(opt_str(argc, argv, "--expect", "on"), "blink") == 0;
+    dog.graceUs = (long long)opt_int(argc, argv, "--grace", 30) * 1000000;
+    dog.bootGraceUs = (long long)opt_int(argc, argv, "--boot-grace", 180) * 1000000;
+    dog.hostBurst = opt_int(argc, argv, "--host-burst", 2);
+    dog.hostRate = opt_int(argc, argv, "--host-rate", 6);
+    dog.steadyMs = opt_int(argc, argv, "--steady-ms", 2500);
+    dog.listener.sigStateChanged = on_sig_state_changed;
+    if(logPath != NULL){
+        dog.log = fopen(logPath, "a");
+        if(dog.log == NULL){
+            printf("unable to open %s\n", logPath);
+            return -1;
+        }
+    }
+
+    if(fleet_open(&dog.fleet, opt_str(argc, argv, "--hosts", NULL)) != 0)
+        return -1;
+    dog.boxes = calloc(dog.fleet.numBoxes + 1, sizeof(DogBox));
+    for(i = 0; i < dog.fleet.numBoxes; i++){
+        if(watch_box(&dog.boxes[i], &dog.fleet.boxes[i]) != 0){
+            print_rsc_error("unable to get led signals");
+            return -1;
+        }
+    }
+    dog.startedAt = now_us();
+    for(i = 0; i < dog.fleet.numHosts; i++){
+        dog.buckets[i].tokens = dog.hostBurst;
+        dog.buckets[i].refilledAt = dog.startedAt;
+    }
+    printf("watchdog: %d boxes on %d hosts, %s led expected %s\n", dog.fleet.numBoxes,
+           dog.fleet.numHosts, led, dog.expectBlink ? "blinking" : "on");
+    if(opt_flag(argc, argv, "--boot"))
+        parallel_for(dog.fleet.numBoxes, 32, power_on, NULL);
+
+#ifdef RSC_STANDIN
+    nextHang = dog.startedAt + (long long)hangEvery * 1000000;
+#endif
+    lastTick = now_us();
+    while(duration == 0 || now_us() - dog.startedAt < (long long)duration * 1000000){
+        long long now = now_us();
+
+        for(i = 0; i < dog.fleet.numBoxes; i++)
+            update_box(&dog.boxes[i], now, now - lastTick);
+        lastTick = now;
+#ifdef RSC_STANDIN
+        if(hangs > 0 && now >= nextHang && dog.fleet.numBoxes > 0){
+            DogBox *db = &dog.boxes[rand() % dog.fleet.numBoxes];
+
+            standin_hang_sut(db->box, 1 + hangs % NUM_STEPS);
+            hangs--;
+            nextHang = now + (long long)hangEvery * 1000000;
+        }
+#endif
+        Sleep(TICK_MS);
+    }
+
+    for(i = 0; i < dog.fleet.numBoxes; i++){
+        /* leave the listener alone while an action still runs */
+        while(dog.boxes[i].acting)
+            Sleep(TICK_MS);
+        Rsc2_DetachBoxListener(dog.boxes[i].box, &dog.listener);
+    }
+    report();
+    if(dog.log != NULL)
+        fclose(dog.log);
+    return 0;
+}